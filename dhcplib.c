@@ -58,10 +58,8 @@ char *dhcp_strerror(int errno)
 }
 
 // DHCP header preamble interpretation
-int dhcp_write_preamble(int sockfd, DHCPHeaderPreamble *preamble)
+static void dhcp_pack_preamble(DHCPHeaderPreamble *preamble, uint8_t *header)
 {
-	uint8_t header[12];
-
 	header[0] = preamble->op;
 	header[1] = preamble->htype;
 	header[2] = preamble->hlen;
@@ -70,16 +68,22 @@ int dhcp_write_preamble(int sockfd, DHCPHeaderPreamble *preamble)
 	wiznet_htons(preamble->xid1, header+6);
 	wiznet_htons(preamble->secs, header+8);
 	wiznet_htons(preamble->flags, header+10);
+}
 
-	return wiznet_sendto(sockfd, header, 12, NULL, 0, 0);
+int dhcp_write_preamble(WIZNETWriter *wr, DHCPHeaderPreamble *preamble)
+{
+	uint8_t header[12];
+
+	dhcp_pack_preamble(preamble, header);
+	return wiznet_writer_write(wr, header, 12);
 }
 
-int dhcp_read_preamble(int sockfd, DHCPHeaderPreamble *preamble)
+int dhcp_read_preamble(WIZNETReader *rd, DHCPHeaderPreamble *preamble)
 {
 	uint8_t header[12];
 	int ret;
 
-	ret = wiznet_recv(sockfd, header, 12, 0);
+	ret = wiznet_reader_read(rd, header, 12);
 	if (ret < 0)
 		return ret;
 
@@ -94,52 +98,45 @@ int dhcp_read_preamble(int sockfd, DHCPHeaderPreamble *preamble)
 	return ret;
 }
 
-// Write initial DHCP information
-int dhcp_write_header(int sockfd, DHCPHeaderPreamble *preamble, uint16_t *ciaddr, uint16_t *yiaddr, uint16_t *siaddr, uint16_t *giaddr, uint16_t *chaddr)
+/* Write initial DHCP information
+ * The fixed fields are staged in the writer; the zero padding goes out with them in one TX buffer write,
+ * and the magic cookie stays staged along with the options that follow.
+ */
+int dhcp_write_header(WIZNETWriter *wr, DHCPHeaderPreamble *preamble, uint16_t *ciaddr, uint16_t *yiaddr, uint16_t *siaddr, uint16_t *giaddr, uint16_t *chaddr)
 {
-	uint8_t scratch[6];
+	uint8_t addrs[22], cookie[4];
 	int ret;
 
-	dhcp_write_preamble(sockfd, preamble);
-	wiznet_htons(ciaddr[0], scratch);
-	wiznet_htons(ciaddr[1], scratch+2);
-	if ( (ret = wiznet_sendto(sockfd, scratch, 4, NULL, 0, 0)) < 0 )   // CIADDR
-		return ret;
-
-	wiznet_htons(yiaddr[0], scratch);
-	wiznet_htons(yiaddr[1], scratch+2);
-	if ( (ret = wiznet_sendto(sockfd, scratch, 4, NULL, 0, 0)) < 0 )   // YIADDR
+	if ( (ret = dhcp_write_preamble(wr, preamble)) < 0 )
 		return ret;
+	wiznet_htons(ciaddr[0], addrs);     // CIADDR
+	wiznet_htons(ciaddr[1], addrs+2);
+	wiznet_htons(yiaddr[0], addrs+4);   // YIADDR
+	wiznet_htons(yiaddr[1], addrs+6);
+	wiznet_htons(siaddr[0], addrs+8);   // SIADDR
+	wiznet_htons(siaddr[1], addrs+10);
+	wiznet_htons(giaddr[0], addrs+12);  // GIADDR
+	wiznet_htons(giaddr[1], addrs+14);
+	wiznet_htons(chaddr[0], addrs+16);  // CHADDR
+	wiznet_htons(chaddr[1], addrs+18);
+	wiznet_htons(chaddr[2], addrs+20);
 
-	wiznet_htons(siaddr[0], scratch);
-	wiznet_htons(siaddr[1], scratch+2);
-	if ( (ret = wiznet_sendto(sockfd, scratch, 4, NULL, 0, 0)) < 0 )   // SIADDR
-		return ret;
-
-	wiznet_htons(giaddr[0], scratch);
-	wiznet_htons(giaddr[1], scratch+2);
-	if ( (ret = wiznet_sendto(sockfd, scratch, 4, NULL, 0, 0)) < 0 )   // GIADDR
-		return ret;
+	// Magic Cookie
+	wiznet_htons(DHCP_MAGIC_COOKIE_0, cookie);
+	wiznet_htons(DHCP_MAGIC_COOKIE_1, cookie+2);
 
-	wiznet_htons(chaddr[0], scratch);
-	wiznet_htons(chaddr[1], scratch+2);
-	wiznet_htons(chaddr[2], scratch+4);
-	if ( (ret = wiznet_sendto(sockfd, scratch, 6, NULL, 0, 0)) < 0 )   // CHADDR
+	if ( (ret = wiznet_writer_write(wr, addrs, 22)) < 0 )
 		return ret;
-	// Fill zeroes to pad CHADDR
-	wiznet_fill_txbuf(sockfd, 192+10, 0x00);
-
-	// Magic Cookie
-	wiznet_htons(DHCP_MAGIC_COOKIE_0, scratch);
-	wiznet_htons(DHCP_MAGIC_COOKIE_1, scratch+2);
-	if ( (ret = wiznet_sendto(sockfd, scratch, 4, NULL, 0, 0)) < 0 )   // DHCP Magic Cookie
+	if ( (ret = wiznet_writer_write(wr, NULL, 192+10)) < 0 )  // Fill zeroes to pad CHADDR
 		return ret;
-
-	return 0;
+	return wiznet_writer_write(wr, cookie, 4);
 }
 
-// Read initial DHCP information
-int dhcp_read_header(int sockfd, DHCPHeaderPreamble *preamble, uint16_t *ciaddr, uint16_t *yiaddr, uint16_t *siaddr, uint16_t *giaddr, uint16_t *chaddr)
+/* Read initial DHCP information
+ * Fields come out of the reader's window; the 202 bytes of SNAME/FILE padding are skipped without touching
+ * the bus.  Nothing is released from the RX buffer here, the caller flushes the whole packet when done.
+ */
+int dhcp_read_header(WIZNETReader *rd, DHCPHeaderPreamble *preamble, uint16_t *ciaddr, uint16_t *yiaddr, uint16_t *siaddr, uint16_t *giaddr, uint16_t *chaddr)
 {
 	uint8_t scratch[6];
 	int ret;
@@ -148,38 +145,38 @@ int dhcp_read_header(int sockfd, DHCPHeaderPreamble *preamble, uint16_t *ciaddr,
 	const char *funcname = "dhcp_read_header()";
 	#endif
 
-	dhcp_read_preamble(sockfd, preamble);
+	dhcp_read_preamble(rd, preamble);
 
-	if ( (ret = wiznet_recv(sockfd, scratch, 4, 0)) < 0 )   // CIADDR
+	if ( (ret = wiznet_reader_read(rd, scratch, 4)) < 0 )   // CIADDR
 		return ret;
 	ciaddr[0] = wiznet_ntohs(scratch);
 	ciaddr[1] = wiznet_ntohs(scratch+2);
 
-	if ( (ret = wiznet_recv(sockfd, scratch, 4, 0)) < 0 )   // YIADDR
+	if ( (ret = wiznet_reader_read(rd, scratch, 4)) < 0 )   // YIADDR
 		return ret;
 	yiaddr[0] = wiznet_ntohs(scratch);
 	yiaddr[1] = wiznet_ntohs(scratch+2);
 
-	if ( (ret = wiznet_recv(sockfd, scratch, 4, 0)) < 0 )   // SIADDR
+	if ( (ret = wiznet_reader_read(rd, scratch, 4)) < 0 )   // SIADDR
 		return ret;
 	siaddr[0] = wiznet_ntohs(scratch);
 	siaddr[1] = wiznet_ntohs(scratch+2);
 
-	if ( (ret = wiznet_recv(sockfd, scratch, 4, 0)) < 0 )   // GIADDR
+	if ( (ret = wiznet_reader_read(rd, scratch, 4)) < 0 )   // GIADDR
 		return ret;
 	giaddr[0] = wiznet_ntohs(scratch);
 	giaddr[1] = wiznet_ntohs(scratch+2);
 
-	if ( (ret = wiznet_recv(sockfd, scratch, 6, 0)) < 0 )   // CHADDR
+	if ( (ret = wiznet_reader_read(rd, scratch, 6)) < 0 )   // CHADDR
 		return ret;
 	chaddr[0] = wiznet_ntohs(scratch);
 	chaddr[1] = wiznet_ntohs(scratch+2);
 	chaddr[2] = wiznet_ntohs(scratch+4);
 
-	if ( (ret = wiznet_flush(sockfd, 192+10, 0)) < 0 )     // Flush superfluous 0's
-		return ret;
+	if (wiznet_reader_skip(rd, 192+10) < 192+10)          // Skip superfluous 0's
+		return -EAGAIN;
 
-	if ( (ret = wiznet_recv(sockfd, scratch, 4, 0)) < 0 )   // Magic Cookie
+	if ( (ret = wiznet_reader_read(rd, scratch, 4)) < 0 )   // Magic Cookie
 		return ret;
 
 	// Magic Cookie
@@ -192,20 +189,19 @@ int dhcp_read_header(int sockfd, DHCPHeaderPreamble *preamble, uint16_t *ciaddr,
 	return 0;
 }
 
-int dhcp_write_option(int sockfd, uint8_t option, uint8_t len, void *buf)
+int dhcp_write_option(WIZNETWriter *wr, uint8_t option, uint8_t len, void *buf)
 {
 	uint8_t opthdr[2];
 	int ret;
 
 	opthdr[0] = option;
 	opthdr[1] = len;
-	if ( (ret = wiznet_sendto(sockfd, opthdr, 2, NULL, 0, 0)) < 0 )
+	if ( (ret = wiznet_writer_write(wr, opthdr, 2)) < 0 )
 		return ret;
-	
-	return wiznet_sendto(sockfd, (uint8_t *)buf, len, NULL, 0, 0);
+	return wiznet_writer_write(wr, buf, len);
 }
 
-int dhcp_read_option(int sockfd, uint8_t *option, uint8_t *len, void *buf)
+int dhcp_read_option(WIZNETReader *rd, uint8_t *option, uint8_t *len, void *buf)
 {
 	uint8_t opthdr[2];
 	int ret;
@@ -214,14 +210,14 @@ int dhcp_read_option(int sockfd, uint8_t *option, uint8_t *len, void *buf)
 	const char *funcname = "dhcp_read_option()";
 	#endif
 
-	if ( (ret = wiznet_recv(sockfd, opthdr, 2, 0)) < 0 ) {
+	if ( (ret = wiznet_reader_read(rd, opthdr, 2)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d reading 2 byte option header\n", funcname, ret);
 		return ret;
 	}
 	*option = opthdr[0];
 	*len = opthdr[1];
 	wiznet_debug3_printf("%s: optcode=%u, optlen=%u\n", funcname, opthdr[0], opthdr[1]);
-	return wiznet_recv(sockfd, (uint8_t *)buf, opthdr[1], 0);
+	return wiznet_reader_read(rd, (uint8_t *)buf, opthdr[1]);
 }
 
 int dhcp_send_dhcpdiscover(int sockfd)
@@ -230,6 +226,7 @@ int dhcp_send_dhcpdiscover(int sockfd)
 	uint16_t ipzero[2], ipone[2], ourmac[3];
 	uint8_t scratch[8];
 	int ret;
+	WIZNETWriter wr;
 
 	#if WIZNET_DEBUG > 1
 	const char *funcname = "dhcp_send_dhcpdiscover()";
@@ -258,8 +255,9 @@ int dhcp_send_dhcpdiscover(int sockfd)
 		wiznet_debug2_printf("%s: Error %d preparing UDP packet\n", funcname, ret);
 		return ret;
 	}
+	wiznet_writer_begin(&wr, sockfd);  // Header and options are staged, going out in a couple of TX buffer writes
 
-	ret = dhcp_write_header(sockfd, &hdr, ipzero, ipzero, ipzero, ipzero, ourmac);
+	ret = dhcp_write_header(&wr, &hdr, ipzero, ipzero, ipzero, ipzero, ourmac);
 	if (ret < 0) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP Header\n", funcname, ret);
 		return ret;
@@ -268,7 +266,7 @@ int dhcp_send_dhcpdiscover(int sockfd)
 	
 	// DHCP option 53: DHCPDISCOVER
 	scratch[0] = DHCP_MSGTYPE_DHCPDISCOVER;
-	if ( (ret = dhcp_write_option(sockfd, DHCP_OPTCODE_DHCP_MSGTYPE, 1, scratch)) < 0 ) {
+	if ( (ret = dhcp_write_option(&wr, DHCP_OPTCODE_DHCP_MSGTYPE, 1, scratch)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP MSGTYPE=DHCPDISCOVER option\n", funcname, ret);
 		return ret;
 	}
@@ -278,16 +276,16 @@ int dhcp_send_dhcpdiscover(int sockfd)
 	scratch[0] = DHCP_OPTCODE_SUBNET_MASK;
 	scratch[1] = DHCP_OPTCODE_ROUTER;
 	scratch[2] = DHCP_OPTCODE_DOMAIN_SERVER;
-	if ( (ret = dhcp_write_option(sockfd, DHCP_OPTCODE_PARAM_LIST, 3, scratch)) < 0 ) {
+	if ( (ret = dhcp_write_option(&wr, DHCP_OPTCODE_PARAM_LIST, 3, scratch)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP OPTCODE PARAM LIST option\n", funcname, ret);
 		return ret;
 	}
 	
-	if ( (ret = dhcp_write_option(sockfd, DHCP_OPTCODE_END, 0, NULL)) < 0 ) {
+	if ( (ret = dhcp_write_option(&wr, DHCP_OPTCODE_END, 0, NULL)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP OPTCODE END option\n", funcname, ret);
 		return ret;
 	}
-	if ( (ret = wiznet_txcommit(sockfd)) < 0 ) {
+	if ( (ret = wiznet_writer_commit(&wr)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d committing DHCPDISCOVER packet\n", funcname, ret);
 		return ret;
 	}
@@ -302,6 +300,7 @@ int dhcp_send_dhcprequest(int sockfd, uint16_t *yiaddr, uint16_t *dhcpserver)
 	uint16_t ipzero[2], ipone[2], ourmac[3];
 	uint8_t scratch[8];
 	int ret;
+	WIZNETWriter wr;
 
 	#if WIZNET_DEBUG > 1
 	const char *funcname = "dhcp_send_dhcprequest()";
@@ -330,8 +329,9 @@ int dhcp_send_dhcprequest(int sockfd, uint16_t *yiaddr, uint16_t *dhcpserver)
 		wiznet_debug2_printf("%s: Error %d preparing UDP packet\n", funcname, ret);
 		return ret;
 	}
+	wiznet_writer_begin(&wr, sockfd);  // Header and options are staged, going out in a couple of TX buffer writes
 
-	ret = dhcp_write_header(sockfd, &hdr, ipzero, ipzero, dhcpserver, ipzero, ourmac);
+	ret = dhcp_write_header(&wr, &hdr, ipzero, ipzero, dhcpserver, ipzero, ourmac);
 	if (ret < 0) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP Header\n", funcname, ret);
 		return ret;
@@ -340,7 +340,7 @@ int dhcp_send_dhcprequest(int sockfd, uint16_t *yiaddr, uint16_t *dhcpserver)
 	
 	// DHCP Option 53: DHCP REQUEST
 	scratch[0] = DHCP_MSGTYPE_DHCPREQUEST;
-	if ( (ret = dhcp_write_option(sockfd, DHCP_OPTCODE_DHCP_MSGTYPE, 1, scratch)) < 0 ) {
+	if ( (ret = dhcp_write_option(&wr, DHCP_OPTCODE_DHCP_MSGTYPE, 1, scratch)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP MSGTYPE=DHCPREQUEST option\n", funcname, ret);
 		return ret;
 	}
@@ -348,7 +348,7 @@ int dhcp_send_dhcprequest(int sockfd, uint16_t *yiaddr, uint16_t *dhcpserver)
 	// DHCP Option 50: Request IP address
 	wiznet_htons(yiaddr[0], scratch);
 	wiznet_htons(yiaddr[1], scratch+2);
-	if ( (ret = dhcp_write_option(sockfd, DHCP_OPTCODE_IP_ADDRESS_REQUEST, 4, scratch)) < 0 ) {
+	if ( (ret = dhcp_write_option(&wr, DHCP_OPTCODE_IP_ADDRESS_REQUEST, 4, scratch)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP IP ADDRESS REQUEST option\n", funcname, ret);
 		return ret;
 	}
@@ -356,16 +356,16 @@ int dhcp_send_dhcprequest(int sockfd, uint16_t *yiaddr, uint16_t *dhcpserver)
 	// DHCP Option 54: DHCP server IP
 	wiznet_htons(dhcpserver[0], scratch);
 	wiznet_htons(dhcpserver[1], scratch+2);
-	if ( (ret = dhcp_write_option(sockfd, DHCP_OPTCODE_DHCP_SERVER_IP, 4, scratch)) < 0 ) {
+	if ( (ret = dhcp_write_option(&wr, DHCP_OPTCODE_DHCP_SERVER_IP, 4, scratch)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP SERVER IP option\n", funcname, ret);
 		return ret;
 	}
 	
-	if ( (ret = dhcp_write_option(sockfd, DHCP_OPTCODE_END, 0, NULL)) < 0 ) {
+	if ( (ret = dhcp_write_option(&wr, DHCP_OPTCODE_END, 0, NULL)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d writing DHCP OPTCODE END option\n", funcname, ret);
 		return ret;
 	}
-	if ( (ret = wiznet_txcommit(sockfd)) < 0 ) {
+	if ( (ret = wiznet_writer_commit(&wr)) < 0 ) {
 		wiznet_debug2_printf("%s: Error %d committing DHCPREQUEST packet\n", funcname, ret);
 		return ret;
 	}
@@ -386,6 +386,7 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 	uint16_t yiaddr[2], yiaddr_ack[2], siaddr_ack[2], siaddr[2], giaddr[2], ipzero[2], subnetmask[2], dns[2];
 	uint16_t loopcount=0, srcport;
 	DHCPHeaderPreamble pamb;
+	WIZNETReader rd;
 
 	#if WIZNET_DEBUG > 0
 	const char *funcname = "dhcp_loop_configure()";
@@ -451,8 +452,11 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 						wiznet_debug2_printf("%s: %s (found %u)\n", funcname, dhcplib_errno_descriptions[dhcplib_errno-1], srcport);
 						continue;
 					}
+					// Parse the rest through a reader; the packet is released in one go by the wiznet_flush() below
+					wiznet_reader_begin(&rd, sockfd);
+
 					// Read DHCP header
-					if ( (ret = dhcp_read_header(sockfd, &pamb, ipzero, yiaddr, siaddr, ipzero, (uint16_t *)scratch)) < 0 ) {
+					if ( (ret = dhcp_read_header(&rd, &pamb, ipzero, yiaddr, siaddr, ipzero, (uint16_t *)scratch)) < 0 ) {
 						dhcplib_errno = DHCP_ERRNO_DHCPOFFER_READHEADER_FAULT;
 						exitval = ret;
 						wiznet_debug2_printf("%s: %s (%d)\n", funcname, dhcplib_errno_descriptions[dhcplib_errno-1], ret);
@@ -466,7 +470,7 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 						continue;
 					}
 					// Read first option; should be option 53 = DHCPOFFER
-					if ( (ret = dhcp_read_option(sockfd, &optcode, &optlen, scratch)) < 0 ) {
+					if ( (ret = dhcp_read_option(&rd, &optcode, &optlen, scratch)) < 0 ) {
 						dhcplib_errno = DHCP_ERRNO_DHCPOFFER_READOPT_FAULT;
 						exitval = ret;
 						wiznet_debug2_printf("%s: %s (%d)\n", funcname, dhcplib_errno_descriptions[dhcplib_errno-1], ret);
@@ -477,7 +481,7 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 
 						// Read all headers to extract info
 						do {
-							dhcp_read_option(sockfd, &optcode, &optlen, scratch);
+							dhcp_read_option(&rd, &optcode, &optlen, scratch);
 							switch (optcode) {
 								case DHCP_OPTCODE_SUBNET_MASK:
 									if (optlen == 4) {
@@ -554,8 +558,11 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 						wiznet_debug2_printf("%s: %s (found %u)\n", funcname, dhcplib_errno_descriptions[dhcplib_errno-1], srcport);
 						continue;
 					}
+					// Parse the rest through a reader; the packet is released in one go by the wiznet_flush() below
+					wiznet_reader_begin(&rd, sockfd);
+
 					// Read DHCP header
-					if ( (ret = dhcp_read_header(sockfd, &pamb, ipzero, yiaddr_ack, siaddr_ack, ipzero, (uint16_t *)scratch)) < 0 ) {
+					if ( (ret = dhcp_read_header(&rd, &pamb, ipzero, yiaddr_ack, siaddr_ack, ipzero, (uint16_t *)scratch)) < 0 ) {
 						dhcplib_errno = DHCP_ERRNO_DHCPACK_READHEADER_FAULT;
 						exitval = ret;
 						wiznet_debug2_printf("%s: %s (%d)\n", funcname, dhcplib_errno_descriptions[dhcplib_errno-1], ret);
@@ -569,7 +576,7 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 						continue;
 					}
 					// Read first option; should be option 53 = DHCPACK
-					if ( (ret = dhcp_read_option(sockfd, &optcode, &optlen, scratch)) < 0 ) {
+					if ( (ret = dhcp_read_option(&rd, &optcode, &optlen, scratch)) < 0 ) {
 						dhcplib_errno = DHCP_ERRNO_DHCPACK_READOPT_FAULT;
 						exitval = ret;
 						wiznet_debug2_printf("%s: %s (%d)\n", funcname, dhcplib_errno_descriptions[dhcplib_errno-1], ret);
@@ -580,7 +587,7 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 
 						// Read all headers to extract info
 						do {
-							dhcp_read_option(sockfd, &optcode, &optlen, scratch);
+							dhcp_read_option(&rd, &optcode, &optlen, scratch);
 
 							switch (optcode) {
 								case DHCP_OPTCODE_DHCP_SERVER_IP:
@@ -619,9 +626,11 @@ int dhcp_loop_configure(uint16_t *dnsaddr)
 						// Set IP, gateway, router!
 						wiznet_debug1_printf("%s: Configuring WizNet IP settings\n", funcname);
 
+						wiznet_wc_begin();
 						wiznet_ip_bin_w_reg(W52_GATEWAY, giaddr);
 						wiznet_ip_bin_w_reg(W52_SUBNETMASK, subnetmask);
 						wiznet_ip_bin_w_reg(W52_SOURCEIP, yiaddr);
+						wiznet_wc_end();
 						exitval = 0;  // All done!
 						state = 4;
 						break;
@@ -244,12 +244,12 @@ extern int dhcplib_errno;
 
 
 /* Functions */
-int dhcp_write_preamble(int, DHCPHeaderPreamble *);
-int dhcp_read_preamble(int, DHCPHeaderPreamble *);
-int dhcp_write_header(int, DHCPHeaderPreamble *, uint16_t *, uint16_t *, uint16_t *, uint16_t *, uint16_t *);
-int dhcp_read_header(int, DHCPHeaderPreamble *, uint16_t *, uint16_t *, uint16_t *, uint16_t *, uint16_t *);
-int dhcp_write_option(int, uint8_t, uint8_t, void *);
-int dhcp_read_option(int, uint8_t *, uint8_t *, void *);
+int dhcp_write_preamble(WIZNETWriter *, DHCPHeaderPreamble *);
+int dhcp_read_preamble(WIZNETReader *, DHCPHeaderPreamble *);
+int dhcp_write_header(WIZNETWriter *, DHCPHeaderPreamble *, uint16_t *, uint16_t *, uint16_t *, uint16_t *, uint16_t *);
+int dhcp_read_header(WIZNETReader *, DHCPHeaderPreamble *, uint16_t *, uint16_t *, uint16_t *, uint16_t *, uint16_t *);
+int dhcp_write_option(WIZNETWriter *, uint8_t, uint8_t, void *);
+int dhcp_read_option(WIZNETReader *, uint8_t *, uint8_t *, void *);
 
 char *dhcp_strerror(int);  // Return descriptive string of dhcplib_errno value
 
@@ -57,7 +57,8 @@ char *dnslib_strerror(int err)
 int dnslib_send_qname(int sockfd, const char *dnsname, uint16_t qtype, uint16_t qclass)
 {
 	int i=0, j, found;
-	uint8_t len, metabuf[5];
+	uint8_t lens[DNSLIB_QNAME_LABELS_PER_WRITE], nlabels = 0, metabuf[5];
+	WIZNETIOVec iov[DNSLIB_QNAME_LABELS_PER_WRITE*2 + 1];
 
 	#if WIZNET_DEBUG > 1
 	const char *funcname = "dnslib_send_qname()";
@@ -67,15 +68,23 @@ int dnslib_send_qname(int sockfd, const char *dnsname, uint16_t qtype, uint16_t
 		return -EBADF;
 	}
 
+	// Labels are gathered (length byte + text) and written several at a time with a single TX_WR update
 	do {
 		if (dnsname[i] != '.') {
 			j = 1;
 			found = 0;
 			do {
 				if (dnsname[i+j] == '.' || dnsname[i+j] == '\0') {
-					len = j;
-					wiznet_sendto(sockfd, &len, 1, NULL, 0, 0);
-					wiznet_sendto(sockfd, (char *)dnsname+i, j, NULL, 0, 0);
+					if (nlabels == DNSLIB_QNAME_LABELS_PER_WRITE) {
+						wiznet_sendv(sockfd, iov, nlabels*2, 0);
+						nlabels = 0;
+					}
+					lens[nlabels] = j;
+					iov[nlabels*2].base = lens + nlabels;
+					iov[nlabels*2].len = 1;
+					iov[nlabels*2+1].base = dnsname+i;
+					iov[nlabels*2+1].len = j;
+					nlabels++;
 					found = 1;
 					if (dnsname[i+j] != '\0')
 						i += j + 1;
@@ -94,12 +103,14 @@ int dnslib_send_qname(int sockfd, const char *dnsname, uint16_t qtype, uint16_t
 	// qtype & qclass HTONS (little-to-big-endian conversion)
 	wiznet_htons(qtype, metabuf+1);
 	wiznet_htons(qclass, metabuf+3);
-	wiznet_sendto(sockfd, metabuf, 5, NULL, 0, 0);
+	iov[nlabels*2].base = metabuf;
+	iov[nlabels*2].len = 5;
+	wiznet_sendv(sockfd, iov, nlabels*2 + 1, 0);
 
 	return 0;
 }
 
-int dnslib_recv_qname(int sockfd, char *dnsname, uint16_t maxlen)
+int dnslib_recv_qname(WIZNETReader *rd, char *dnsname, uint16_t maxlen)
 {
 	int i=0;
 	uint8_t c, initial=1;
@@ -108,14 +119,14 @@ int dnslib_recv_qname(int sockfd, char *dnsname, uint16_t maxlen)
 	const char *funcname = "dnslib_recv_qname()";
 	#endif
 	do {
-		if (wiznet_recv(sockfd, &c, 1, 0) == -EAGAIN) {
-			wiznet_debug2_printf("%s: EAGAIN attempting to read socket %d\n", funcname, sockfd);
+		if (wiznet_reader_read(rd, &c, 1) == -EAGAIN) {
+			wiznet_debug2_printf("%s: EAGAIN attempting to read socket %d\n", funcname, rd->sockfd);
 			return -EFAULT;
 		}
 		if (c >= 64) {  // Pointer; we don't support these
 			dnsname[i] = '\0';
 			i += 2;
-			wiznet_recv(sockfd, &c, 1, 0);
+			wiznet_reader_skip(rd, 1);
 			wiznet_debug3_printf("%s: Pointer found; not reading further\n", funcname);
 			return i;
 		}
@@ -128,8 +139,8 @@ int dnslib_recv_qname(int sockfd, char *dnsname, uint16_t maxlen)
 		} else {
 			initial = 0;
 		}
-		if (wiznet_recv(sockfd, dnsname+i, c, 0) == -EAGAIN) {
-			wiznet_debug2_printf("%s: EAGAIN attempting to read socket %d\n", funcname, sockfd);
+		if (wiznet_reader_read(rd, dnsname+i, c) == -EAGAIN) {
+			wiznet_debug2_printf("%s: EAGAIN attempting to read socket %d\n", funcname, rd->sockfd);
 			return -EFAULT;
 		}
 		i += c;
@@ -137,7 +148,7 @@ int dnslib_recv_qname(int sockfd, char *dnsname, uint16_t maxlen)
 	return i;
 }
 
-int dnslib_flush_qname(int sockfd)
+int dnslib_flush_qname(WIZNETReader *rd)
 {
 	int i=0;
 	uint8_t c;
@@ -146,16 +157,16 @@ int dnslib_flush_qname(int sockfd)
 	const char *funcname = "dnslib_flush_qname()";
 	#endif
 	do {
-		if (wiznet_recv(sockfd, &c, 1, 0) == -EAGAIN) {
-			wiznet_debug2_printf("%s: EAGAIN attempting to read socket %d\n", funcname, sockfd);
+		if (wiznet_reader_read(rd, &c, 1) == -EAGAIN) {
+			wiznet_debug2_printf("%s: EAGAIN attempting to read socket %d\n", funcname, rd->sockfd);
 			return -EFAULT;
 		}
 		if (c < 64) {  // snippet lengths >= 64 signify pointers
 			i += c + 1;
-			wiznet_flush(sockfd, c, 0);
+			wiznet_reader_skip(rd, c);
 		} else {  // Pointer
 			i += 2;
-			wiznet_flush(sockfd, 1, 0);
+			wiznet_reader_skip(rd, 1);
 			wiznet_debug3_printf("%s: Pointer found; reading no further\n", funcname);
 			return i;  // Read no further after a pointer
 		}
@@ -167,6 +178,7 @@ int dnslib_gethostbyname(char *dnsname, uint16_t *ip)
 {
 	int sockfd, pktlen;
 	DNSPktHeader dns_qry;
+	WIZNETReader rd;
 	static uint16_t dns_id = 0;
 	int i=0;
 	uint8_t netbuf[64], sockimr, ir2bit;
@@ -262,15 +274,18 @@ int dnslib_gethostbyname(char *dnsname, uint16_t *ip)
 		wiznet_debug2_printf("%s: %s\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
 		return -EFAULT;
 	}
-	pktlen = wiznet_recvsize(sockfd);
-	if (pktlen < sizeof(DNSPktHeader)+10) {  // Length of DNS header + A-record Answer frame
+	/* The reply is parsed through a buffered reader; nothing needs releasing from the RX buffer afterwards
+	 * since the socket is closed either way.
+	 */
+	pktlen = wiznet_reader_begin(&rd, sockfd);
+	if (pktlen < (int)(sizeof(DNSPktHeader)+10)) {  // Length of DNS header + A-record Answer frame
 		wiznet_close(sockfd);
 		dnslib_errno = DNSLIB_ERRNO_PKTSIZEFAULT;
 		wiznet_debug2_printf("%s: %s (found %d)\n", funcname, dnslib_errno_strings[dnslib_errno-1], pktlen);
 		return -EFAULT;
 	}
 
-	i = wiznet_recv(sockfd, netbuf, sizeof(DNSPktHeader), 0);
+	i = wiznet_reader_read(&rd, netbuf, sizeof(DNSPktHeader));
 	if (i < 0 || i != sizeof(DNSPktHeader)) {
 		dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 		wiznet_debug2_printf("%s: %s (found %d, expected %d)\n", funcname, dnslib_errno_strings[dnslib_errno-1], i, sizeof(DNSPktHeader));
@@ -316,20 +331,20 @@ int dnslib_gethostbyname(char *dnsname, uint16_t *ip)
 	// Read answer packet
 
 	if (dns_qry.qdcount) {  // Need to read our original query first
-		if (dnslib_flush_qname(sockfd) < 0) {
+		if (dnslib_flush_qname(&rd) < 0) {
 			wiznet_close(sockfd);
 			dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 			wiznet_debug2_printf("%s: %s (flushing qname of original query)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
 			return -EFAULT;
 		}
 		
-		if (wiznet_recv(sockfd, netbuf, 2, 0) < 0) {  // Query type
+		if (wiznet_reader_read(&rd, netbuf, 2) < 0) {  // Query type
 			wiznet_close(sockfd);
 			dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 			wiznet_debug2_printf("%s: %s (recv query type of original query)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
 			return -EFAULT;
 		}
-		if (wiznet_recv(sockfd, netbuf, 2, 0) < 0) {  // Query class
+		if (wiznet_reader_read(&rd, netbuf, 2) < 0) {  // Query class
 			wiznet_close(sockfd);
 			dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 			wiznet_debug2_printf("%s: %s (recv query class of original query)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
@@ -338,13 +353,13 @@ int dnslib_gethostbyname(char *dnsname, uint16_t *ip)
 	}
 
 	// Answer
-	if (dnslib_flush_qname(sockfd) < 0) {  // NAME that was queried
+	if (dnslib_flush_qname(&rd) < 0) {  // NAME that was queried
 		wiznet_close(sockfd);
 		dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 		wiznet_debug2_printf("%s: %s (flush qname of answer)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
 		return -EFAULT;
 	}
-	if (wiznet_recv(sockfd, netbuf, 2, 0) < 0) {  // Query type
+	if (wiznet_reader_read(&rd, netbuf, 2) < 0) {  // Query type
 		dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 		wiznet_debug2_printf("%s: %s (recv query type of answer)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
 		return -EFAULT;
@@ -355,7 +370,7 @@ int dnslib_gethostbyname(char *dnsname, uint16_t *ip)
 		wiznet_debug2_printf("%s: %s (found %u)\n", funcname, dnslib_errno_strings[dnslib_errno-1], wiznet_ntohs(netbuf));
 		return -EFAULT;
 	}
-	if (wiznet_recv(sockfd, netbuf, 2, 0) < 0) {  // Query class
+	if (wiznet_reader_read(&rd, netbuf, 2) < 0) {  // Query class
 		wiznet_close(sockfd);
 		dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 		wiznet_debug2_printf("%s: %s (recv query class of answer)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
@@ -367,13 +382,13 @@ int dnslib_gethostbyname(char *dnsname, uint16_t *ip)
 		wiznet_debug2_printf("%s: %s (found %u)\n", funcname, dnslib_errno_strings[dnslib_errno-1], wiznet_ntohs(netbuf));
 		return -EFAULT;
 	}
-	if (wiznet_recv(sockfd, netbuf, 4, 0) < 0) {  // TTL (32-bit integer)
+	if (wiznet_reader_read(&rd, netbuf, 4) < 0) {  // TTL (32-bit integer)
 		wiznet_close(sockfd);
 		dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 		wiznet_debug2_printf("%s: %s (recv TTL of answer)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
 		return -EFAULT;
 	}
-	if (wiznet_recv(sockfd, netbuf, 2, 0) < 0) {  // RDLENGTH
+	if (wiznet_reader_read(&rd, netbuf, 2) < 0) {  // RDLENGTH
 		wiznet_close(sockfd);
 		dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 		wiznet_debug2_printf("%s: %s (recv RDLENGTH of answer)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
@@ -386,7 +401,7 @@ int dnslib_gethostbyname(char *dnsname, uint16_t *ip)
 		return -EFAULT;
 	}
 
-	if (wiznet_recv(sockfd, netbuf, 4, 0) < 0) {
+	if (wiznet_reader_read(&rd, netbuf, 4) < 0) {
 		wiznet_close(sockfd);
 		dnslib_errno = DNSLIB_ERRNO_PARSE_TRUNCATED;
 		wiznet_debug2_printf("%s: %s (read IP address of answer)\n", funcname, dnslib_errno_strings[dnslib_errno-1]);
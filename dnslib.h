@@ -27,6 +27,8 @@
 #include "w5200_buf.h"
 #include "w5200_sock.h"
 
+/* QNAME labels gathered per scatter-gather TX write in dnslib_send_qname() */
+#define DNSLIB_QNAME_LABELS_PER_WRITE 4
 
 /* DNS packet - Header */
 typedef struct {
@@ -115,8 +117,8 @@ typedef struct {
 char *dnslib_strerror(int);  // Return a const char * pointer describing the named error.
 
 int dnslib_send_qname(int sockfd, const char *dnsname, uint16_t qtype, uint16_t qclass);  // Internal
-int dnslib_recv_qname(int sockfd, char *dnsname, uint16_t maxlen);  // Internal
-int dnslib_flush_qname(int sockfd);
+int dnslib_recv_qname(WIZNETReader *rd, char *dnsname, uint16_t maxlen);  // Internal
+int dnslib_flush_qname(WIZNETReader *rd);
 
 int dnslib_gethostbyname(char *dnsname, uint16_t *ip);  // Resolve hostname to IP address -- A records only!
 
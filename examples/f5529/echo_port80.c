@@ -5,6 +5,7 @@
 #include "w5200_config.h"
 #include "w5200_buf.h"
 #include "w5200_sock.h"
+#include "w5200_reactor.h"
 #include "w5200_debug.h"
 
 // Using our new ip2binary routines for this...
@@ -17,9 +18,32 @@ volatile int res1, res2;
 #define GREEN_SET P4OUT|=BIT7
 #define GREEN_CLEAR P4OUT&=~BIT7
 
+// Echo whatever arrives; the reactor quickbinds port 80 again when the peer disconnects
+void echo_readable(int sockfd, void *ctx)
+{
+	uint8_t *netbuf = ctx;
+
+	while ((res1 = wiznet_recv(sockfd, netbuf, 32, 1)) > 0) {
+		wiznet_debug_printf("RECV: %d\n", res1);
+		res2 = wiznet_send(sockfd, netbuf, res1, 1);
+		wiznet_debug_printf("send returned: %d\n", res2);
+		if (res2 < 0)
+			break;
+	}
+}
+
+void echo_accept(int sockfd, void *ctx)
+{
+	wiznet_debug_printf("accept: socket %d\n", sockfd);
+}
+
+const WIZNETHandlers echo_handlers = {
+	.on_accept = echo_accept,
+	.on_readable = echo_readable,
+};
+
 int main() {
 	int sockfd;
-	uint8_t sockopen = 0;
 	uint8_t netbuf[32];
 
 	P1DIR |= BIT0;
@@ -48,46 +72,9 @@ int main() {
 	if (res1 < 0)
 		LPM4;
 
+	wiznet_reactor_register(sockfd, &echo_handlers, netbuf);
 	RED_CLEAR;
-	while(1) {
-		if (!sockopen) {
-			res1 = wiznet_accept(sockfd);
-			wiznet_debug_printf("accept: %d\n", res1);
-			if (!res1 || res1 == -EISCONN)
-				sockopen = 1;
-		} else {
-			res1 = wiznet_recv(sockfd, netbuf, 32, 1);
-			wiznet_debug_printf("RECV: %d\n", res1);
-			switch (res1) {
-				case -ENOTCONN:
-				case -ECONNABORTED:
-				case -ENETDOWN:
-					sockopen = 0;
-					break;
-				case -EAGAIN:
-					break;
-				default:
-					wiznet_debug_printf("sending;\n");
-					switch (res2 = wiznet_send(sockfd, netbuf, res1, 1)) {
-						case -ENOTCONN:
-						case -ECONNABORTED:
-						case -ETIMEDOUT:
-						case -ENETDOWN:
-							wiznet_debug_printf("send failed: %d\n", res2);
-							sockopen = 0;
-							break;
-						default:
-							wiznet_debug_printf("send returned: %d\n", res2);
-					}
-			}
-		}
-		wiznet_debug_printf("irq_getsocket() = %d; recvsize = %d\n", wiznet_irq_getsocket(), wiznet_recvsize(sockfd));
-		if (wiznet_irq_getsocket() == -EAGAIN && !wiznet_recvsize(sockfd)) {
-			wiznet_debug_printf("LPM0;\n");
-			LPM0;
-			wiznet_debug_printf("wake;\n");
-		}
-	}
+	wiznet_reactor_run();
 
 	return 0;
 }
@@ -16,11 +16,15 @@ volatile int res1, res2;
 
 int adc_temp_read();
 
+#define HTTP_POOL_SIZE 3  // Clients served at once
+
 int main() {
 	int sockfd, tempF;
-	uint8_t sockopen = 0;
+	uint8_t active = 0;
 	uint16_t i;
-	uint8_t netbuf[32], tempFstr[8];
+	uint8_t tempFstr[8];
+	WIZNETWriter wr;
+	WIZNETListenPool pool;
 
 	WDTCTL = WDTPW | WDTHOLD;
 	ucs_clockinit(16000000, 1, 0);
@@ -36,53 +40,50 @@ int main() {
 	wiznet_ip_str_w_reg(W52_SOURCEIP, "10.104.115.180");
 	wiznet_ip_str_w_reg(W52_GATEWAY, "10.104.115.1");
 
-	sockfd = wiznet_socket(IPPROTO_TCP);
-	if (sockfd < 0)
-		LPM4;
-	wiznet_debug_printf("wiznet_socket(): %d\n", sockfd);
-
-	res1 = wiznet_bind(sockfd, 80);  // Bind port 80
+	res1 = wiznet_listen_pool(&pool, 80, HTTP_POOL_SIZE);  // Bind port 80
 	if (res1 < 0)
 		LPM4;
+	wiznet_debug_printf("wiznet_listen_pool(): %d sockets\n", res1);
 
 	while(1) {
-		if (!sockopen) {
-			res1 = wiznet_accept(sockfd);
-			wiznet_debug_printf("accept: %d\n", res1);
-			if (!res1 || res1 == -EISCONN)
-				sockopen = 1;
-		} else {
-			res1 = wiznet_recv(sockfd, netbuf, 32, 1);
-			wiznet_debug_printf("RECV: %d\n", res1);
+		while ((sockfd = wiznet_pool_accept(&pool)) >= 0) {
+			wiznet_debug_printf("accept: %d\n", sockfd);
+			active |= 1 << sockfd;
+		}
+
+		for (sockfd=0; sockfd < W52_MAX_SOCKETS; sockfd++) {
+			if (!(active & (1 << sockfd)))
+				continue;
+
+			// Find the end of the request headers without pulling the request into RAM
+			res1 = wiznet_search_recv_pattern(sockfd, NULL, W52_SOCK_RXSIZE(sockfd), "\r\n\r\n", 4, W52_SEARCH_PEEK);
+			wiznet_debug_printf("SEARCH(%d): %d\n", sockfd, res1);
 			switch (res1) {
+				case -EAGAIN:
+				case 0:
+					break;
+				case -ENOBUFS:  // Headers fill the RX buffer; drop the client
 				case -ENOTCONN:
 				case -ENETDOWN:
-					sockopen = 0;
-					break;
-				case -EAGAIN:
+					wiznet_pool_release(&pool, sockfd);
+					active &= ~(1 << sockfd);
 					break;
 				default:
-					for (i=0; i < res1-3; i++) {
-						if (netbuf[i] == '\r' && netbuf[i+1] == '\n' && netbuf[i+2] == '\r' && netbuf[i+3] == '\n') {
-							// Request submitted by client; server sends reply
-							tempF = adc_temp_read();
-							i = s_printf((char *)tempFstr, "%d F", tempF);
-
-							strcpy((char *)netbuf, "HTTP/1.1 200 OK\r\n");
-							wiznet_send(sockfd, netbuf, strlen((char *)netbuf), 0);
-							strcpy((char *)netbuf, "Content-Type: text/plain\r\n");
-							wiznet_send(sockfd, netbuf, strlen((char *)netbuf), 0);
-							s_printf((char *)netbuf, "Content-Length: %d\r\n\r\n", i);
-							wiznet_send(sockfd, netbuf, strlen((char *)netbuf), 0);
-							if (wiznet_send(sockfd, tempFstr, strlen((char *)tempFstr), 1) < 0) {
-								sockopen = 0;
-							}
-							wiznet_quickbind(sockfd);  // Close client connection & re-establish port 80 binding
-						}
-					}
+					wiznet_flush(sockfd, res1, 1);
+
+					// Request submitted by client; server sends reply
+					tempF = adc_temp_read();
+					i = s_printf((char *)tempFstr, "%d F", tempF);
+
+					wiznet_writer_begin(&wr, sockfd);
+					wiznet_writer_printf(&wr, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n\r\n%s", i, tempFstr);
+					wiznet_writer_commit(&wr);
+					wiznet_pool_release(&pool, sockfd);  // Close client connection & put the socket back in LISTEN
+					active &= ~(1 << sockfd);
 			}
 		}
-		if (wiznet_irq_getsocket() == -EAGAIN && !wiznet_recvsize(sockfd)) {  // No IRQs pending
+
+		if (wiznet_irq_getsocket() == -EAGAIN && !pool.arming) {  // No IRQs pending
 			wiznet_debug_printf("LPM0;\n");
 			LPM0;
 			wiznet_debug_printf("wake;\n");
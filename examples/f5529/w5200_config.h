@@ -30,6 +30,11 @@
 #define SPI_DRIVER_USCI_B
 //#define SPI_DRIVER_USCI_A
 
+/* Expand spi_transfer() inline within the W5200 I/O layer (see msp430_spi_inline.h)
+ * Comment this out to call the out-of-line msp430_spi.c version instead.
+ */
+#define SPI_DRIVER_INLINE
+
 // Chip Select pin
 #define W52_CHIPSELECT_PORTDIR P6DIR
 #define W52_CHIPSELECT_PORTBIT BIT5
@@ -55,8 +60,33 @@
  * Use this to minimize the SPI bitrate divider and restore it as needed (in case other
  * attached devices require lower SPI speeds)
  */
+#define W52_SPI_AUTOCAL 1
+
+/* SPI bitrate calibration (W52_SPI_AUTOCAL)
+ * wiznet_init() steps the divider down from W52_SPI_SAFE_DIVIDER toward W52_SPI_MIN_DIVIDER, verifying
+ * each step W52_SPI_CAL_PASSES times with read-back patterns, and keeps the fastest reliable one in
+ * w52_spi_divider.  W52_SPI_SET applies it; with W52_SPI_SHARED_BUS set to 1, W52_SPI_UNSET restores the
+ * safe divider afterwards for slower devices on the same bus.  If the chip stops answering even at the safe
+ * divider, wiznet_init() fails with -EFAULT.
+ * Set W52_SPI_AUTOCAL to 0 to supply your own W52_SPI_SET/W52_SPI_UNSET below.
+ */
+#define W52_SPI_SAFE_DIVIDER 4
+#define W52_SPI_MIN_DIVIDER 1
+#define W52_SPI_CAL_PASSES 8
+#define W52_SPI_SHARED_BUS 0
+
+#if W52_SPI_AUTOCAL
+extern uint16_t w52_spi_divider;
+#define W52_SPI_SET spi_set_divider(w52_spi_divider)
+#if W52_SPI_SHARED_BUS
+#define W52_SPI_UNSET spi_set_divider(W52_SPI_SAFE_DIVIDER)
+#else
+#define W52_SPI_UNSET ;
+#endif
+#else
 #define W52_SPI_SET ;
 #define W52_SPI_UNSET ;
+#endif
 
 /* Base port used as source-port for outbound TCP connections */
 #define W52_TCP_SRCPORT_BASE 40000
@@ -71,10 +101,73 @@
 #define W52_PEDANTIC_CHECKING 1
 
 /* Socket memory buffer sizes
- * Defaults to 2KB, should be kept here unless you lower the # of max sockets.
+ * Per-socket RX and TX size programmed by wiznet_init(); defaults to 2KB, should be kept here unless you
+ * lower the # of max sockets.  Use wiznet_set_bufsizes() to give individual sockets more (up to 16KB).
  */
 #define W52_SOCK_MEM_SIZE 2048
-#define W52_SOCK_MEM_MASK 2047
+
+/* Per-socket buffer sizing (wiznet_set_bufsizes(), required by W52_BUF_POLICY)
+ * Keeps each socket's buffer base and size in RAM; costs 8 bytes of RAM per socket.
+ * Set to 0 to give every socket a fixed W52_SOCK_MEM_SIZE buffer.
+ */
+#define W52_BUF_SIZING 1
+
+/* Bytes handed to a wiznet_recv_stream() visitor per call (held on the stack)
+ */
+#define W52_RECV_STREAM_CHUNK 8
+
+/* Bytes requested from a wiznet_send_generate() producer per call (held on the stack)
+ */
+#define W52_SEND_GENERATE_CHUNK 8
+
+/* Size of the RAM window a WIZNETReader refills from the RX buffer in one burst (max 255)
+ */
+#define W52_READER_WINDOW 32
+
+/* Staging buffer of a WIZNETWriter; writes coalesce here until it fills or is flushed (max 255)
+ */
+#define W52_WRITER_BUFSIZE 64
+
+/* Bytes read per SPI frame by wiznet_search_recv_pattern(); the search stops at the frame holding the match
+ * (held on the stack when no buffer is passed)
+ */
+#define W52_SEARCH_CHUNK 32
+
+/* Traffic-adaptive buffer allocation (w5200_bufpolicy.c)
+ * Tracks bytes moved and ring occupancy per socket type (protocol and bound port) and reassigns buffer
+ * memory with the selected policy (see wiznet_bufpol_set()) whenever every socket is closed; each socket
+ * number is sized for the type it served last.  Costs 31 bytes of RAM per socket.
+ * Set to 0 to disable.
+ */
+#define W52_BUF_POLICY 0
+#if W52_BUF_POLICY && !W52_BUF_SIZING
+#error "W52_BUF_POLICY requires W52_BUF_SIZING"
+#endif
+
+/* Per-socket options (wiznet_setsockopt()): MSS, TTL and TOS are written before each OPEN, and the chip-wide
+ * RTR/RCR retransmission timers are switched to the socket's values before each CONNECT, SEND or DISCON
+ * it issues, and TCP sockets can auto-cork (W52_SO_CORK); costs 10 bytes of RAM per socket.
+ * Set to 0 to disable.
+ */
+#define W52_SOCKOPT 1
+
+/* RAM shadow of driver-owned registers (GAR, SUBR, SHAR, SIPR, IMR, Sn_MR, Sn_PORT, Sn_DIPR, Sn_DPORT)
+ * Serves reads locally and drops writes that wouldn't change anything; costs about 100 bytes of RAM.
+ * Set to 0 to disable.
+ */
+#define W52_REG_SHADOW 1
+
+/* Write combining of configuration registers (GAR..SIPR, Sn_PORT..Sn_TTL)
+ * Adjacent writes made between wiznet_wc_begin() and wiznet_wc_end() go out as a single SPI frame.
+ * Set to 0 to disable.
+ */
+#define W52_WRITE_COMBINE 1
+
+/* Asynchronous buffer I/O queue (wiznet_io_submit et al)
+ * When enabled, the user must call wiznet_io_isr() from the DMA ISR (F5xxx) or the USCI RX ISR (others).
+ * Set to 0 to disable.
+ */
+#define W52_ASYNC_IO 0
 
 /* End user configuration */
 
@@ -88,15 +181,88 @@ extern volatile uint8_t w5200_irq;
 // Structure for holding socket information
 #define W52_MAX_SOCKETS 8
 
+#if W52_SOCKOPT
+typedef struct {
+	uint16_t mss;  // 0 = chip default
+	uint16_t rtr;  // Retry time, 100us units
+	uint8_t rcr;   // Retry count
+	uint8_t ttl;
+	uint8_t tos;
+	uint8_t cork;  // Auto-cork delay in wiznet_cork_tick() ticks, 0 = off
+} WIZNETSockOpts;
+#endif
+
 typedef struct {
 	uint8_t mode;
 	uint8_t srcport_idx;
 	uint8_t is_bind;
+	uint8_t connecting;  // wiznet_connect_nb() progress, W52_CONN_*
+	uint8_t tx_state;    // wiznet_txcommit_async() progress, W52_TX_*
 	uint16_t tx_wr;
 	uint16_t rx_rd;
+	uint16_t tx_rd;    // Cached Sn_TX_RD, as of the last wiznet_txcommit_async()/wiznet_tx_poll()
+	uint16_t tx_sent;  // TX_WR covered by the SEND in flight
+	uint16_t tx_commit;  // tx_wr as of the last commit; a chained SEND goes no further
+	#if W52_BUF_SIZING
+	uint16_t tx_base;  // Buffer memory layout, set by wiznet_set_bufsizes()
+	uint16_t tx_size;
+	uint16_t rx_base;
+	uint16_t rx_size;
+	#endif
+	#if W52_SOCKOPT
+	WIZNETSockOpts opts;  // See wiznet_setsockopt()
+	volatile uint8_t cork_age;  // Ticks since corked data started waiting
+	uint8_t cork_held;  // Data written since the last commit; cork_age restarted at its first byte
+	#endif
 } WIZNETSocketState;
 
 extern WIZNETSocketState w52_sockets[W52_MAX_SOCKETS];
+#if W52_BUF_SIZING
+#define W52_SOCK_TXBASE(sock) (w52_sockets[sock].tx_base)
+#define W52_SOCK_TXSIZE(sock) (w52_sockets[sock].tx_size)
+#define W52_SOCK_RXBASE(sock) (w52_sockets[sock].rx_base)
+#define W52_SOCK_RXSIZE(sock) (w52_sockets[sock].rx_size)
+#else
+#define W52_SOCK_TXBASE(sock) (W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * (sock))
+#define W52_SOCK_TXSIZE(sock) W52_SOCK_MEM_SIZE
+#define W52_SOCK_RXBASE(sock) (W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * (sock))
+#define W52_SOCK_RXSIZE(sock) W52_SOCK_MEM_SIZE
+#endif
+#define W52_SOCK_TXMASK(sock) (W52_SOCK_TXSIZE(sock) - 1)
+#define W52_SOCK_RXMASK(sock) (W52_SOCK_RXSIZE(sock) - 1)
+
+// Streamed-read consumer (context, data, length); returns # of bytes consumed, fewer than length stops the stream
+typedef uint16_t (*WIZNETVisitor)(void *, const uint8_t *, uint16_t);
+// TX content generator (context, buffer, room); returns # of bytes written to the buffer, 0 when done.
+// Runs with the W5200 selected, so it must not do any SPI I/O itself.
+typedef uint16_t (*WIZNETProducer)(void *, uint8_t *, uint16_t);
+
+// Asynchronous I/O request descriptor, see wiznet_io_submit()
+#if W52_ASYNC_IO
+#define W52_IOREQ_IDLE 0
+#define W52_IOREQ_QUEUED 1
+#define W52_IOREQ_DONE 2
+
+#define W52_IOREQ_FLAG_RECV 0x01  // Clear Sn_IR RECV and issue the RECV command once data has been read
+
+typedef struct WIZNETIOReq WIZNETIOReq;
+struct WIZNETIOReq {
+	uint16_t addr;       // W5200 memory address
+	uint16_t len;
+	uint16_t wrap_addr;  // Continue at this address for wrap_len more bytes (ring buffer wrap-around)
+	uint16_t wrap_len;
+	uint16_t opcode;     // W52_SPI_OPCODE_READ or W52_SPI_OPCODE_WRITE
+	uint8_t *buf;
+	uint16_t ptr_reg;    // 16-bit register written with ptr_val after the data moves (0 = none)
+	uint16_t ptr_val;
+	int sockfd;
+	uint8_t flags;
+	volatile uint8_t status;
+	void (*callback)(WIZNETIOReq *);  // Runs in interrupt context; may be NULL; no synchronous I/O
+	void *userdata;
+	WIZNETIOReq *next;
+};
+#endif
 
 /* Relevant ERRNO values */
 #define ENETDOWN 100
@@ -104,6 +270,9 @@ extern WIZNETSocketState w52_sockets[W52_MAX_SOCKETS];
 #define EFAULT 14
 #define EPROTONOSUPPORT 93
 #define ENFILE 23
+#define EINVAL 22
+#define EBUSY 16
+#define ENOBUFS 105
 
 #define EADDRINUSE 98
 
@@ -117,6 +286,7 @@ extern WIZNETSocketState w52_sockets[W52_MAX_SOCKETS];
 #define ETIMEDOUT 110
 
 #define EINPROGRESS 115
+#define EALREADY 114
 #define EISCONN 106
 #define EAGAIN 11
 
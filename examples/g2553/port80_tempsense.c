@@ -4,6 +4,7 @@
 #include "uartdbg.h"
 #include "sprintf.h"
 #include <stdint.h>
+#include <string.h>
 #include "w5200_config.h"
 #include "w5200_buf.h"
 #include "w5200_sock.h"
@@ -16,11 +17,50 @@ char uartbuf[8];
 
 int adc_temp_read();
 
+// Tracks progress through "\r\n\r\n" across calls; stops consuming at the end of the request header
+uint16_t http_eoh_visitor(void *ctx, const uint8_t *data, uint16_t len)
+{
+	uint8_t *matched = (uint8_t *)ctx;
+	uint16_t i;
+
+	for (i=0; i < len; i++) {
+		if (data[i] == ((*matched & 1) ? '\n' : '\r'))
+			(*matched)++;
+		else
+			*matched = (data[i] == '\r');
+		if (*matched == 4)
+			return i+1;
+	}
+	return len;
+}
+
+// Emits a NULL-terminated list of strings, resuming where the previous call left off
+typedef struct {
+	const char **part;
+	const char *pos;
+} StrListGen;
+
+uint16_t strlist_producer(void *ctx, uint8_t *buf, uint16_t maxlen)
+{
+	StrListGen *gen = (StrListGen *)ctx;
+	uint16_t n = 0;
+
+	while (n < maxlen && gen->pos != NULL) {
+		if (*gen->pos)
+			buf[n++] = *gen->pos++;
+		else
+			gen->pos = *++gen->part;
+	}
+	return n;
+}
+
 int main() {
 	int sockfd, tempF;
-	uint8_t sockopen = 0;
-	uint16_t i;
-	uint8_t netbuf[32], tempFstr[8];
+	uint8_t sockopen = 0, eoh = 0;
+	uint16_t i, len;
+	char tempFstr[8], lenstr[6];
+	const char *reply[] = { "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: ", lenstr, "\r\n\r\n", tempFstr, NULL };
+	StrListGen gen;
 
 	WDTCTL = WDTPW | WDTHOLD;
         DCOCTL = CALDCO_16MHZ;
@@ -55,34 +95,35 @@ int main() {
 			if (!res1 || res1 == -EISCONN)
 				sockopen = 1;
 		} else {
-			res1 = wiznet_recv(sockfd, netbuf, 32, 1);
+			// Scan the request straight out of the W5200's RX buffer; no staging copy needed
+			res1 = wiznet_recv_stream(sockfd, W52_SOCK_MEM_SIZE, http_eoh_visitor, &eoh);
 			uartcli_print_str("RECV: "); uartcli_println_int(res1);
 			//wiznet_debug_uart(sockfd);
 			switch (res1) {
 				case -ENOTCONN:
 				case -ENETDOWN:
 					sockopen = 0;
+					eoh = 0;
 					break;
 				case -EAGAIN:
 					break;
 				default:
-					for (i=0; i < res1-3; i++) {
-						if (netbuf[i] == '\r' && netbuf[i+1] == '\n' && netbuf[i+2] == '\r' && netbuf[i+3] == '\n') {
-							// Request submitted by client; server sends reply
-							tempF = adc_temp_read();
-							i = s_printf(tempFstr, "%d F", tempF);
-
-							strcpy(netbuf, "HTTP/1.1 200 OK\r\n");
-							wiznet_send(sockfd, netbuf, strlen(netbuf), 0);
-							strcpy(netbuf, "Content-Type: text/plain\r\n");
-							wiznet_send(sockfd, netbuf, strlen(netbuf), 0);
-							s_printf(netbuf, "Content-Length: %d\r\n\r\n", i);
-							wiznet_send(sockfd, netbuf, strlen(netbuf), 0);
-							if (wiznet_send(sockfd, tempFstr, strlen(tempFstr), 1) < 0) {
-								sockopen = 0;
-							}
-							wiznet_quickbind(sockfd);  // Close client connection & re-establish port 80 binding
+					if (eoh == 4) {
+						// Request submitted by client; server sends reply
+						eoh = 0;
+						tempF = adc_temp_read();
+						i = s_printf(tempFstr, "%d F", tempF);
+						s_printf(lenstr, "%d", i);
+
+						// Whole reply is produced straight into the TX buffer; no staging copy
+						for (i=0, len=0; reply[i] != NULL; i++)
+							len += strlen(reply[i]);
+						gen.part = reply;
+						gen.pos = reply[0];
+						if (wiznet_send_generate(sockfd, len, strlist_producer, &gen, 1) < 0) {
+							sockopen = 0;
 						}
+						wiznet_quickbind(sockfd);  // Close client connection & re-establish port 80 binding
 					}
 			}
 		}
@@ -8,6 +8,11 @@
  * 4. USCI_A F5xxx - developed on MSP430F5172, added F5529
  * 5. USCI_B F5xxx - developed on MSP430F5172, added F5529
  *
+ * Block transfers (spi_transfer_block, spi_fill_block) use DMA channels 0 (RX) and 1 (TX)
+ * on F5xxx chips with a DMA controller, a TXBUF-preloading burst loop on other USCI chips and
+ * a per-byte loop on USI.
+ * spi_block_start() runs the same transfers to completion under the DMA (or USCI RX) interrupt.
+ *
  * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
  *
  * Permission to use, copy, modify, and/or distribute this software for any purpose
@@ -23,7 +28,9 @@
  */
 
 #include <msp430.h>
+#include <stdlib.h>
 #include "msp430_spi.h"
+#include "msp430_spi_regs.h"
 
 
 #ifdef __MSP430_HAS_USI__
@@ -848,3 +855,275 @@ uint16_t spi_transfer9(uint16_t inw)
 #endif
 
 #endif
+
+/* Bit-rate divider (SMCLK / divider), used by the W5200 I/O layer's W52_SPI_SET/W52_SPI_UNSET */
+#ifdef SPI_BR0
+void spi_set_divider(uint16_t div)
+{
+	if (div == spi_get_divider())
+		return;
+	SPI_CTLRST |= UCSWRST;
+	SPI_BR0 = div & 0xFF;
+	SPI_BR1 = div >> 8;
+	SPI_CTLRST &= ~UCSWRST;
+}
+
+uint16_t spi_get_divider()
+{
+	return SPI_BR0 | (SPI_BR1 << 8);
+}
+#endif
+
+#ifdef __MSP430_HAS_USI__
+// USI only divides by powers of 2 (up to 128); round up to the next one
+void spi_set_divider(uint16_t div)
+{
+	uint8_t n = 0;
+
+	while (n < 7 && (1 << n) < div)
+		n++;
+	USICKCTL = (USICKCTL & ~USIDIV_7) | (n << 5);
+}
+
+uint16_t spi_get_divider()
+{
+	return 1 << ((USICKCTL & USIDIV_7) >> 5);
+}
+#endif
+
+/* Block transfers
+ * spi_transfer_block() clocks 'len' bytes; a NULL txbuf sends 0xFF for every byte and a NULL rxbuf
+ * discards whatever comes back.  spi_fill_block() sends the same byte 'len' times.
+ */
+#ifdef SPI_IFG
+/* USCI burst loops keep TXBUF loaded while the previous byte is still shifting, so the shifter
+ * never idles waiting on the CPU.  With RX discarded we only ever wait on TXIFG, then wait for
+ * the last byte to finish and read RXBUF once to clear RXIFG/UCOE for the next spi_transfer().
+ * At SMCLK/1 a byte shifts in fewer cycles than the loop takes to get from loading TXBUF back to
+ * reading RXBUF, so the byte behind it would overrun RXBUF; below a divider of 2 each received
+ * byte is read out before the next one is loaded.
+ */
+static void spi_burst_block(const uint8_t *txptr, uint8_t txincr, uint8_t *rxptr, uint16_t len)
+{
+	if (!len)
+		return;
+
+	if (rxptr == NULL) {
+		do {
+			while ( !(SPI_IFG & SPI_TXIFG) )
+				;
+			SPI_TXBUF = *txptr;
+			txptr += txincr;
+		} while (--len);
+		while (SPI_STAT & UCBUSY)
+			;
+		(void)SPI_RXBUF;  // Dummy read; clears RXIFG and overrun
+		return;
+	}
+
+	if (spi_get_divider() < 2) {
+		do {
+			SPI_TXBUF = *txptr;
+			txptr += txincr;
+			while ( !(SPI_IFG & SPI_RXIFG) )
+				;
+			*rxptr++ = SPI_RXBUF;
+		} while (--len);
+		return;
+	}
+
+	SPI_TXBUF = *txptr;
+	txptr += txincr;
+	while (--len) {
+		while ( !(SPI_IFG & SPI_TXIFG) )  // Previous byte has moved into the shifter
+			;
+		SPI_TXBUF = *txptr;
+		txptr += txincr;
+		while ( !(SPI_IFG & SPI_RXIFG) )  // Previous byte fully received
+			;
+		*rxptr++ = SPI_RXBUF;
+	}
+	while ( !(SPI_IFG & SPI_RXIFG) )
+		;
+	*rxptr = SPI_RXBUF;
+}
+#endif
+
+#if defined(SPI_DMA_TRIGGER_RX) && (defined(__MSP430_HAS_DMAX_3__) || defined(__MSP430_HAS_DMAX_6__) || defined(__MSP430_HAS_DMAX_8__))
+
+// Below this size the DMA setup costs more than it saves
+#ifndef SPI_DMA_THRESHOLD
+#define SPI_DMA_THRESHOLD 8
+#endif
+
+static const uint8_t spi_dma_idle = 0xFF;
+static uint8_t spi_dma_discard;
+
+/* RX runs on channel 0 (highest priority) so RXBUF is always emptied before the next byte lands.
+ * TX runs on channel 1 off TXIFG; TXIFG is already high when idle, so the first byte is written
+ * by hand and the DMA feeds the remaining len-1 bytes on each TXIFG rising edge.
+ * 'rxie' is OR'd into DMA0CTL so spi_block_start() can take the completion interrupt.
+ */
+static void spi_dma_start(const uint8_t *txptr, uint16_t txincr, uint8_t *rxptr, uint16_t len, uint16_t rxie)
+{
+	DMA0CTL = 0;
+	DMA1CTL = 0;
+	DMACTL0 = SPI_DMA_TRIGGER_RX | (SPI_DMA_TRIGGER_TX << 8);
+
+	DMA0SAL = (uint16_t)&SPI_RXBUF;
+	DMA0DAL = (uint16_t)(rxptr != NULL ? rxptr : &spi_dma_discard);
+	DMA0SZ = len;
+	DMA0CTL = DMADT_0 | DMASRCINCR_0 | (rxptr != NULL ? DMADSTINCR_3 : DMADSTINCR_0) | DMASBDB | rxie | DMAEN;
+
+	if (len > 1) {
+		DMA1SAL = (uint16_t)(txincr ? txptr+1 : txptr);
+		DMA1DAL = (uint16_t)&SPI_TXBUF;
+		DMA1SZ = len - 1;
+		DMA1CTL = DMADT_0 | txincr | DMADSTINCR_0 | DMASBDB | DMAEN;
+	}
+
+	SPI_TXBUF = *txptr;
+}
+
+static void spi_dma_block(const uint8_t *txptr, uint16_t txincr, uint8_t *rxptr, uint16_t len)
+{
+	spi_dma_start(txptr, txincr, rxptr, len, 0);
+	while (DMA0CTL & DMAEN)  // DMAEN clears itself once the last byte has been received
+		;
+}
+
+void spi_transfer_block(const void *txbuf, void *rxbuf, uint16_t len)
+{
+	const uint8_t *txptr = (txbuf != NULL ? (const uint8_t *)txbuf : &spi_dma_idle);
+
+	if (len < SPI_DMA_THRESHOLD)
+		spi_burst_block(txptr, (txbuf != NULL), (uint8_t *)rxbuf, len);
+	else
+		spi_dma_block(txptr, (txbuf != NULL ? DMASRCINCR_3 : DMASRCINCR_0), (uint8_t *)rxbuf, len);
+}
+
+void spi_fill_block(uint8_t val, uint16_t len)
+{
+	if (len < SPI_DMA_THRESHOLD)
+		spi_burst_block(&val, 0, NULL, len);
+	else
+		spi_dma_block(&val, DMASRCINCR_0, NULL, len);
+}
+
+/* Interrupt-completed block transfers
+ * spi_block_start() arms both DMA channels with DMAIE on the RX channel and returns immediately;
+ * spi_block_isr() is called from the user's DMA ISR and reports when the RX channel has finished.
+ * DMAEN is checked rather than DMAIFG so it doesn't matter whether the ISR has read DMAIV already.
+ */
+static volatile uint8_t spi_block_active;
+
+int spi_block_start(const void *txbuf, void *rxbuf, uint16_t len)
+{
+	if (!len)
+		return 0;
+	spi_block_active = 1;
+	spi_dma_start( (txbuf != NULL ? (const uint8_t *)txbuf : &spi_dma_idle),
+		       (txbuf != NULL ? DMASRCINCR_3 : DMASRCINCR_0), (uint8_t *)rxbuf, len, DMAIE );
+	return 1;
+}
+
+int spi_block_isr()
+{
+	if (!spi_block_active || (DMA0CTL & DMAEN))
+		return 0;
+	DMA0CTL &= ~(DMAIE | DMAIFG);
+	spi_block_active = 0;
+	return 1;
+}
+
+#elif defined(SPI_IFG)
+
+static const uint8_t spi_burst_idle = 0xFF;
+
+void spi_transfer_block(const void *txbuf, void *rxbuf, uint16_t len)
+{
+	if (txbuf != NULL)
+		spi_burst_block((const uint8_t *)txbuf, 1, (uint8_t *)rxbuf, len);
+	else
+		spi_burst_block(&spi_burst_idle, 0, (uint8_t *)rxbuf, len);
+}
+
+void spi_fill_block(uint8_t val, uint16_t len)
+{
+	spi_burst_block(&val, 0, NULL, len);
+}
+
+/* Interrupt-completed block transfers
+ * Without DMA each byte completes in the USCI RX interrupt; spi_block_isr() is called from the
+ * user's USCI RX ISR, stores the received byte and loads the next one into TXBUF.
+ */
+static const uint8_t *spi_block_txptr;
+static uint8_t *spi_block_rxptr;
+static uint16_t spi_block_len;
+static volatile uint8_t spi_block_active;
+
+int spi_block_start(const void *txbuf, void *rxbuf, uint16_t len)
+{
+	if (!len)
+		return 0;
+	spi_block_txptr = (const uint8_t *)txbuf;
+	spi_block_rxptr = (uint8_t *)rxbuf;
+	spi_block_len = len;
+	spi_block_active = 1;
+	(void)SPI_RXBUF;  // Clear any stale RXIFG
+	SPI_IE |= SPI_RXIE;
+	SPI_TXBUF = (spi_block_txptr != NULL ? *spi_block_txptr++ : 0xFF);
+	return 1;
+}
+
+int spi_block_isr()
+{
+	uint8_t inb;
+
+	if (!spi_block_active || !(SPI_IFG & SPI_RXIFG))
+		return 0;
+	inb = SPI_RXBUF;
+	if (spi_block_rxptr != NULL)
+		*spi_block_rxptr++ = inb;
+	if (--spi_block_len) {
+		SPI_TXBUF = (spi_block_txptr != NULL ? *spi_block_txptr++ : 0xFF);
+		return 0;
+	}
+	SPI_IE &= ~SPI_RXIE;
+	spi_block_active = 0;
+	return 1;
+}
+
+#else
+
+void spi_transfer_block(const void *txbuf, void *rxbuf, uint16_t len)
+{
+	const uint8_t *txptr = (const uint8_t *)txbuf;
+	uint8_t *rxptr = (uint8_t *)rxbuf, inb;
+
+	while (len--) {
+		inb = spi_transfer(txptr != NULL ? *txptr++ : 0xFF);
+		if (rxptr != NULL)
+			*rxptr++ = inb;
+	}
+}
+
+void spi_fill_block(uint8_t val, uint16_t len)
+{
+	while (len--)
+		spi_transfer(val);
+}
+
+// USI has no interrupt-driven path here; the transfer completes before spi_block_start() returns.
+int spi_block_start(const void *txbuf, void *rxbuf, uint16_t len)
+{
+	spi_transfer_block(txbuf, rxbuf, len);
+	return 0;
+}
+
+int spi_block_isr()
+{
+	return 0;
+}
+
+#endif
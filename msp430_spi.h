@@ -24,5 +24,11 @@ void spi_init();
 uint8_t spi_transfer(uint8_t);  // SPI xfer 1 byte
 uint16_t spi_transfer16(uint16_t);  // SPI xfer 2 bytes
 uint16_t spi_transfer9(uint16_t);   // SPI xfer 9 bits (courtesy for driving LCD screens)
+void spi_set_divider(uint16_t);  // SPI bitrate = SMCLK / divider
+uint16_t spi_get_divider();
+void spi_transfer_block(const void *, void *, uint16_t);  // SPI xfer a block; NULL tx sends 0xFF, NULL rx discards
+void spi_fill_block(uint8_t, uint16_t);  // SPI xfer the same byte repeatedly
+int spi_block_start(const void *, void *, uint16_t);  // Begin an interrupt-completed block xfer; returns 0 if already complete
+int spi_block_isr();  // Call from the DMA/USCI RX ISR; returns 1 once the block xfer has completed
 
 #endif
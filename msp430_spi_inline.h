@@ -0,0 +1,58 @@
+/* msp430_spi_inline.h
+ * Header-only single-byte SPI transfer for the MSP430, selected at compile time.
+ *
+ * Include this after w5200_config.h (which picks SPI_DRIVER_USCI_A/_B) in translation units that
+ * want spi_transfer() expanded inline; spi_init() and the block transfers still come from msp430_spi.c.
+ * The peripheral selection comes from msp430_spi_regs.h, shared with msp430_spi.c.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _MSP430_SPI_INLINE_H_
+#define _MSP430_SPI_INLINE_H_
+
+#include <msp430.h>
+#include <stdint.h>
+#include "msp430_spi.h"
+#include "msp430_spi_regs.h"
+
+#if defined(__MSP430_HAS_USI__)
+static inline uint8_t spi_transfer_inline(uint8_t inb)
+{
+	USISRL = inb;
+	USICNT = 8;            // Start SPI transfer
+	while ( !(USICTL1 & USIIFG) )
+		;
+	return USISRL;
+}
+#else
+
+#ifndef SPI_TXBUF
+#error "msp430_spi_inline.h: no SPI peripheral matches this chip and SPI_DRIVER_* selection"
+#endif
+
+static inline uint8_t spi_transfer_inline(uint8_t inb)
+{
+	SPI_TXBUF = inb;
+	while ( !(SPI_IFG & SPI_RXIFG) )  // Wait for RXIFG indicating remote byte received via SOMI
+		;
+	return SPI_RXBUF;
+}
+
+#endif
+
+// Route this translation unit's spi_transfer() calls to the inline version
+#define spi_transfer(inb) spi_transfer_inline(inb)
+
+#endif
@@ -0,0 +1,134 @@
+/* msp430_spi_regs.h
+ * Private to msp430_spi.c and msp430_spi_inline.h: maps the SPI_* register aliases onto the USCI/eUSCI
+ * peripheral picked by the chip and SPI_DRIVER_* selection.  USI chips define none of them.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _MSP430_SPI_REGS_H_
+#define _MSP430_SPI_REGS_H_
+
+#include <msp430.h>
+
+// USCI for F2xxx and G2xxx devices (the same registers with or without Timer_B3)
+#if defined(__MSP430_HAS_USCI__) && defined(SPI_DRIVER_USCI_A)
+#define SPI_TXBUF UCA0TXBUF
+#define SPI_RXBUF UCA0RXBUF
+#define SPI_IFG IFG2
+#define SPI_TXIFG UCA0TXIFG
+#define SPI_RXIFG UCA0RXIFG
+#define SPI_STAT UCA0STAT
+#define SPI_IE IE2
+#define SPI_RXIE UCA0RXIE
+#define SPI_CTLRST UCA0CTL1
+#define SPI_BR0 UCA0BR0
+#define SPI_BR1 UCA0BR1
+#endif
+
+#if defined(__MSP430_HAS_USCI__) && defined(SPI_DRIVER_USCI_B)
+#define SPI_TXBUF UCB0TXBUF
+#define SPI_RXBUF UCB0RXBUF
+#define SPI_IFG IFG2
+#define SPI_TXIFG UCB0TXIFG
+#define SPI_RXIFG UCB0RXIFG
+#define SPI_STAT UCB0STAT
+#define SPI_IE IE2
+#define SPI_RXIE UCB0RXIE
+#define SPI_CTLRST UCB0CTL1
+#define SPI_BR0 UCB0BR0
+#define SPI_BR1 UCB0BR1
+#endif
+
+// USCI for F5xxx/6xxx devices
+#if defined(__MSP430_HAS_USCI_A0__) && defined(SPI_DRIVER_USCI_A)
+#define SPI_TXBUF UCA0TXBUF
+#define SPI_RXBUF UCA0RXBUF
+#define SPI_IFG UCA0IFG
+#define SPI_TXIFG UCTXIFG
+#define SPI_RXIFG UCRXIFG
+#define SPI_STAT UCA0STAT
+#define SPI_IE UCA0IE
+#define SPI_RXIE UCRXIE
+#define SPI_CTLRST UCA0CTL1
+#define SPI_BR0 UCA0BR0
+#define SPI_BR1 UCA0BR1
+#ifndef SPI_DMA_TRIGGER_RX
+#define SPI_DMA_TRIGGER_RX 16  // UCA0RXIFG (F5529, F5172)
+#define SPI_DMA_TRIGGER_TX 17  // UCA0TXIFG
+#endif
+#endif
+
+#if defined(__MSP430_HAS_USCI_B0__) && defined(SPI_DRIVER_USCI_B)
+#define SPI_TXBUF UCB0TXBUF
+#define SPI_RXBUF UCB0RXBUF
+#define SPI_IFG UCB0IFG
+#define SPI_TXIFG UCTXIFG
+#define SPI_RXIFG UCRXIFG
+#define SPI_STAT UCB0STAT
+#define SPI_IE UCB0IE
+#define SPI_RXIE UCRXIE
+#define SPI_CTLRST UCB0CTL1
+#define SPI_BR0 UCB0BR0
+#define SPI_BR1 UCB0BR1
+#ifndef SPI_DMA_TRIGGER_RX
+#define SPI_DMA_TRIGGER_RX 18  // UCB0RXIFG (F5529, F5172)
+#define SPI_DMA_TRIGGER_TX 19  // UCB0TXIFG
+#endif
+#endif
+
+// eUSCI for Wolverine and other FRAM series chips
+#if defined(__MSP430_HAS_EUSCI_A0__) && (defined(SPI_DRIVER_USCI_A) || defined(SPI_DRIVER_USCI_A0))
+#define SPI_TXBUF UCA0TXBUF
+#define SPI_RXBUF UCA0RXBUF
+#define SPI_IFG UCA0IFG
+#define SPI_TXIFG UCTXIFG
+#define SPI_RXIFG UCRXIFG
+#define SPI_STAT UCA0STATW
+#define SPI_IE UCA0IE
+#define SPI_RXIE UCRXIE
+#define SPI_CTLRST UCA0CTLW0
+#define SPI_BR0 UCA0BR0
+#define SPI_BR1 UCA0BR1
+#endif
+
+#if defined(__MSP430_HAS_EUSCI_A1__) && defined(SPI_DRIVER_USCI_A1)
+#define SPI_TXBUF UCA1TXBUF
+#define SPI_RXBUF UCA1RXBUF
+#define SPI_IFG UCA1IFG
+#define SPI_TXIFG UCTXIFG
+#define SPI_RXIFG UCRXIFG
+#define SPI_STAT UCA1STATW
+#define SPI_IE UCA1IE
+#define SPI_RXIE UCRXIE
+#define SPI_CTLRST UCA1CTLW0
+#define SPI_BR0 UCA1BR0
+#define SPI_BR1 UCA1BR1
+#endif
+
+#if defined(__MSP430_HAS_EUSCI_B0__) && (defined(SPI_DRIVER_USCI_B) || defined(SPI_DRIVER_USCI_B0))
+#define SPI_TXBUF UCB0TXBUF
+#define SPI_RXBUF UCB0RXBUF
+#define SPI_IFG UCB0IFG
+#define SPI_TXIFG UCTXIFG
+#define SPI_RXIFG UCRXIFG
+#define SPI_STAT UCB0STATW
+#define SPI_IE UCB0IE
+#define SPI_RXIE UCRXIE
+#define SPI_CTLRST UCB0CTLW0
+#define SPI_BR0 UCB0BR0
+#define SPI_BR1 UCB0BR1
+#endif
+
+
+#endif
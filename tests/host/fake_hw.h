@@ -0,0 +1,76 @@
+/* fake_hw.h
+ * Test-side view of the host stand-ins: the USCI_B0/DMA model (fake_msp430.c) and the W5200 model
+ * (fake_w5200.c).
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FAKE_HW_H
+#define FAKE_HW_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* SPI master (USCI_B0 + DMA channels 0/1) */
+extern uint8_t (*fake_spi_slave)(uint8_t);  // Returns MISO for each MOSI byte; NULL = W5200 model on chip select
+extern uint32_t fake_spi_bytes;   // Bytes clocked since fake_msp430_reset()
+extern uint32_t fake_dma_bytes;   // ... of which moved by the DMA
+extern uint32_t fake_spi_overruns;
+extern uint32_t fake_spi_queued;    // Bytes loaded into TXBUF while another was still shifting
+extern uint16_t fake_spi_min_divider;  // Lowest UCB0BR0/1 divider any byte was clocked at
+void fake_msp430_reset();
+uint16_t fake_spi_divider();
+
+/* W5200: 64KB address space, 4-byte frame header, Sn_CR self-clears */
+extern uint8_t *fake_w5200_mem;  // 64KB, allocated by fake_w5200_reset()
+extern uint32_t fake_w5200_frames;  // Frames completed (chip select raised)
+extern uint8_t (*fake_w5200_read_hook)(uint16_t, uint8_t);  // Sees (address, byte) for every byte read; returns what goes on MISO
+void fake_w5200_reset();
+
+/* W5200 SENDs and socket commands, logged in order (counts keep going past FAKE_LOG_SIZE) */
+#define FAKE_LOG_SIZE 64
+typedef struct {
+	uint8_t sock;
+	uint16_t start;  // Sn_TX_RD when SEND was issued
+	uint16_t len;    // Sn_TX_WR - Sn_TX_RD
+} FakeSend;
+typedef struct {
+	uint8_t sock;
+	uint8_t cmd;
+} FakeCommand;
+extern FakeSend fake_w5200_sends[FAKE_LOG_SIZE];
+extern int fake_w5200_nsends;
+extern int fake_w5200_send_overlaps;  // SEND issued while the socket's previous SEND was still running
+extern uint8_t fake_w5200_send_hold;  // Bit per socket: SENDs wait for fake_w5200_send_complete()
+extern FakeCommand fake_w5200_cmds[FAKE_LOG_SIZE];
+extern int fake_w5200_ncmds;
+void fake_w5200_send_complete(int);
+void fake_w5200_select();
+void fake_w5200_deselect();
+uint8_t fake_w5200_xfer(uint8_t);
+
+/* Each test defines test_main(); fake_msp430.c's main() runs it on a stack the DMA model can address */
+int test_main();
+
+/* Checks */
+extern int fake_failures;
+#define FAKE_CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		fake_failures++; \
+	} \
+} while (0)
+
+
+#endif
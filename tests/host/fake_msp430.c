@@ -0,0 +1,268 @@
+/* fake_msp430.c
+ * Host stand-in for the F5529's USCI_B0 in SPI master mode and DMA channels 0/1.
+ *
+ * Every access to a modelled register first advances the model by one step, then latches the access.
+ * TXBUF feeds a one-byte shifter that takes FAKE_SHIFT_STEPS steps per byte, so a byte written while
+ * another is shifting waits in TXBUF like it does on the chip, and RXBUF is overrun (UCOE) if it isn't
+ * read in time.  DMA channels trigger on the RXIFG/TXIFG edges selected in DMACTL0.
+ *
+ * DMA addresses are only 16 bits wide, while host pointers are not.  main() here therefore runs the
+ * test's test_main() on a stack inside .bss, so that everything a DMA channel may point at (.rodata,
+ * .data, .bss, stack) lies in one window under 64KB starting at etext, and a 16-bit address maps back
+ * to exactly one host address.  DMA buffers must be statics or live on the stack; the fake W5200's
+ * memory is on the heap to keep .bss small.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include "w5200_config.h"
+#include "fake_hw.h"
+
+#define FAKE_SHIFT_STEPS 3
+#define FAKE_DMA_TRIGGER_RX 18  // UCB0RXIFG, as msp430_spi_regs.h
+#define FAKE_DMA_TRIGGER_TX 19  // UCB0TXIFG
+
+/* Plain RAM registers */
+volatile uint8_t P2DIR, P2OUT, P2IN, P2REN, P2IES, P2IE, P2IFG;
+volatile uint8_t P3SEL, P3DIR, P4SEL, P6DIR;
+volatile uint8_t UCA1TXBUF, UCA1RXBUF, UCA1STAT, UCA1CTL0, UCA1CTL1, UCA1BR0, UCA1BR1, UCA1MCTL;
+volatile uint8_t UCA1IFG, UCA1IE;
+uint16_t fake_sr;
+
+uint8_t (*fake_spi_slave)(uint8_t);
+uint32_t fake_spi_bytes, fake_dma_bytes, fake_spi_overruns, fake_spi_queued;
+uint16_t fake_spi_min_divider;
+int fake_failures;
+
+static volatile uint8_t reg8[10];
+static volatile uint16_t reg16[9];
+static int pending8 = -1, pending16 = -1;  // Register accessed last; its write (if any) is latched next step
+
+static uint8_t tx_full, shift_busy, shift_val, shift_steps, cs_low;
+
+typedef struct {
+	uint8_t en;
+	uint8_t *src, *dst;
+	uint16_t left;
+} FakeDMA;
+static FakeDMA dma[2];
+
+extern char etext, _end;  // GNU ld: end of code, end of .bss
+
+static uint8_t fake_stack[0x6000] __attribute__((aligned(16)));
+static ucontext_t main_ctx, test_ctx;
+static int test_ret;
+
+static uint8_t *fake_dma_addr(uint16_t addr)
+{
+	uintptr_t lo = (uintptr_t)&etext, p;
+
+	p = lo + (uint16_t)(addr - (uint16_t)lo);
+	FAKE_CHECK(p < (uintptr_t)&_end);  // Not a static or stack buffer
+	return (uint8_t *)p;
+}
+
+static void fake_dma_arm(int ch)
+{
+	uint16_t ctl = reg16[ch ? FAKE_DMA1CTL : FAKE_DMA0CTL];
+
+	if (!(ctl & DMAEN)) {
+		dma[ch].en = 0;
+		return;
+	}
+	if (dma[ch].en)
+		return;  // Already running; the chip ignores rewrites of the other bits here too
+	dma[ch].en = 1;
+	dma[ch].left = reg16[ch ? FAKE_DMA1SZ : FAKE_DMA0SZ];
+	if (ch == 0) {
+		dma[0].src = NULL;  // Always RXBUF here
+		dma[0].dst = fake_dma_addr(reg16[FAKE_DMA0DAL]);
+	} else {
+		dma[1].src = fake_dma_addr(reg16[FAKE_DMA1SAL]);
+		dma[1].dst = NULL;  // Always TXBUF here
+	}
+}
+
+static void fake_dma_done(int ch)
+{
+	uint16_t *ctl = (uint16_t *)&reg16[ch ? FAKE_DMA1CTL : FAKE_DMA0CTL];
+
+	dma[ch].en = 0;
+	*ctl = (*ctl & ~DMAEN) | DMAIFG;
+}
+
+static void fake_txbuf_load(uint8_t val)
+{
+	if (shift_busy)
+		fake_spi_queued++;
+	reg8[FAKE_UCB0TXBUF] = val;
+	reg8[FAKE_UCB0IFG] &= ~UCTXIFG;
+	tx_full = 1;
+}
+
+static void fake_step()
+{
+	uint8_t miso;
+
+	if (shift_busy && ++shift_steps >= FAKE_SHIFT_STEPS) {
+		shift_busy = 0;
+		fake_spi_bytes++;
+		if (fake_spi_divider() < fake_spi_min_divider)
+			fake_spi_min_divider = fake_spi_divider();
+		if (fake_spi_slave != NULL)
+			miso = fake_spi_slave(shift_val);
+		else
+			miso = (cs_low ? fake_w5200_xfer(shift_val) : 0xFF);
+		if (reg8[FAKE_UCB0IFG] & UCRXIFG) {
+			reg8[FAKE_UCB0STAT] |= UCOE;
+			fake_spi_overruns++;
+		}
+		reg8[FAKE_UCB0RXBUF] = miso;
+		reg8[FAKE_UCB0IFG] |= UCRXIFG;
+		if (dma[0].en && (reg16[FAKE_DMACTL0] & 0x1F) == FAKE_DMA_TRIGGER_RX) {
+			reg8[FAKE_UCB0IFG] &= ~UCRXIFG;
+			reg8[FAKE_UCB0STAT] &= ~UCOE;
+			*dma[0].dst = miso;
+			if (reg16[FAKE_DMA0CTL] & DMADSTINCR_3)
+				dma[0].dst++;
+			fake_dma_bytes++;
+			if (!--dma[0].left)
+				fake_dma_done(0);
+		}
+	}
+	if (!shift_busy && tx_full) {
+		shift_val = reg8[FAKE_UCB0TXBUF];
+		shift_busy = 1;
+		shift_steps = 0;
+		tx_full = 0;
+		reg8[FAKE_UCB0IFG] |= UCTXIFG;
+		if (dma[1].en && ((reg16[FAKE_DMACTL0] >> 8) & 0x1F) == FAKE_DMA_TRIGGER_TX) {
+			fake_txbuf_load(*dma[1].src);
+			if (reg16[FAKE_DMA1CTL] & DMASRCINCR_3)
+				dma[1].src++;
+			if (!--dma[1].left)
+				fake_dma_done(1);
+		}
+	}
+	if (shift_busy || tx_full)
+		reg8[FAKE_UCB0STAT] |= UCBUSY;
+	else
+		reg8[FAKE_UCB0STAT] &= ~UCBUSY;
+}
+
+// Latch the previous access: a TXBUF write starts a byte, DMAEN arms a channel, P6OUT moves chip select
+static void fake_latch()
+{
+	uint8_t cs;
+
+	switch (pending8) {
+		case FAKE_UCB0TXBUF:
+			fake_txbuf_load(reg8[FAKE_UCB0TXBUF]);
+			break;
+		case FAKE_P6OUT:
+			cs = !(reg8[FAKE_P6OUT] & W52_CHIPSELECT_PORTBIT);
+			if (cs && !cs_low)
+				fake_w5200_select();
+			else if (!cs && cs_low)
+				fake_w5200_deselect();
+			cs_low = cs;
+			break;
+	}
+	switch (pending16) {
+		case FAKE_DMA0CTL:
+			fake_dma_arm(0);
+			break;
+		case FAKE_DMA1CTL:
+			fake_dma_arm(1);
+			break;
+	}
+	pending8 = pending16 = -1;
+}
+
+#define FAKE_DMA_ADDR_REG(reg) ((reg) == FAKE_DMA0SAL || (reg) == FAKE_DMA1DAL)
+
+/* "DMAxxA = (uint16_t)&SPI_TXBUF" goes through the TXBUF hook too (in either order), but isn't a write
+ * to TXBUF, so it mustn't start a byte.
+ */
+volatile uint8_t *fake_reg8(int reg)
+{
+	int addr_only = (reg == FAKE_UCB0TXBUF && FAKE_DMA_ADDR_REG(pending16));
+
+	fake_latch();
+	fake_step();
+	pending8 = (addr_only ? -1 : reg);
+	if (reg == FAKE_UCB0RXBUF) {  // Reading RXBUF clears RXIFG and UCOE
+		reg8[FAKE_UCB0IFG] &= ~UCRXIFG;
+		reg8[FAKE_UCB0STAT] &= ~UCOE;
+	}
+	return &reg8[reg];
+}
+
+volatile uint16_t *fake_reg16(int reg)
+{
+	if (FAKE_DMA_ADDR_REG(reg) && pending8 == FAKE_UCB0TXBUF)
+		pending8 = -1;
+	fake_latch();
+	fake_step();
+	pending16 = reg;
+	return &reg16[reg];
+}
+
+uint16_t fake_spi_divider()
+{
+	return reg8[FAKE_UCB0BR0] | (reg8[FAKE_UCB0BR1] << 8);
+}
+
+void fake_msp430_reset()
+{
+	int i;
+
+	for (i=0; i < 10; i++)
+		reg8[i] = 0;
+	for (i=0; i < 9; i++)
+		reg16[i] = 0;
+	reg8[FAKE_UCB0IFG] = UCTXIFG;
+	reg8[FAKE_P6OUT] = W52_CHIPSELECT_PORTBIT;
+	pending8 = pending16 = -1;
+	tx_full = shift_busy = 0;
+	cs_low = 0;
+	dma[0].en = dma[1].en = 0;
+	fake_spi_bytes = fake_dma_bytes = fake_spi_overruns = fake_spi_queued = 0;
+	fake_spi_min_divider = 0xFFFF;
+	fake_sr = GIE;
+}
+
+static void fake_test_entry()
+{
+	test_ret = test_main();
+}
+
+int main()
+{
+	if ((uintptr_t)&_end - (uintptr_t)&etext > 0x10000) {
+		printf("fake_msp430: data, bss and stack span more than 64KB; DMA addresses would be ambiguous\n");
+		return 1;
+	}
+	getcontext(&test_ctx);
+	test_ctx.uc_stack.ss_sp = fake_stack;
+	test_ctx.uc_stack.ss_size = sizeof(fake_stack);
+	test_ctx.uc_link = &main_ctx;
+	makecontext(&test_ctx, fake_test_entry, 0);
+	swapcontext(&main_ctx, &test_ctx);
+	return test_ret;
+}
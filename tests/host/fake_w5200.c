@@ -0,0 +1,173 @@
+/* fake_w5200.c
+ * Host stand-in for the W5200 behind the SPI bus: a flat 64KB address space with the 4-byte frame header
+ * (address, R/W bit + 15-bit length).  Sn_CR reads back 0 as soon as a command is written, VERSIONR
+ * reads 0x03 and the socket buffer size registers come up at 2KB.  Sn_IR is write-1-to-clear and mirrored
+ * in IR2.  SEND transmits Sn_TX_RD..Sn_TX_WR as of the command: it is logged, and unless the socket's bit
+ * in fake_w5200_send_hold is set it completes at once (Sn_TX_RD moves up, SEND_OK is raised); held SENDs
+ * complete in fake_w5200_send_complete().  DISCON and CLOSE set Sn_SR to CLOSED.  Nothing else is simulated.
+ * fake_w5200_read_hook, if set, may alter each byte read (e.g. to inject bit errors).
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "fake_hw.h"
+
+uint8_t *fake_w5200_mem;  // On the heap, keeping .bss within reach of fake_msp430.c's DMA anchors
+uint32_t fake_w5200_frames;
+uint8_t (*fake_w5200_read_hook)(uint16_t, uint8_t);
+
+static uint8_t hdr[4], hdr_len;
+static uint16_t addr, len;
+
+FakeSend fake_w5200_sends[FAKE_LOG_SIZE];
+int fake_w5200_nsends;
+int fake_w5200_send_overlaps;
+uint8_t fake_w5200_send_hold;
+FakeCommand fake_w5200_cmds[FAKE_LOG_SIZE];
+int fake_w5200_ncmds;
+
+static uint16_t send_end[8];
+static uint8_t send_busy;
+
+#define SOCK_REG(s, reg) (0x4000 + 0x100 * (s) + (reg))
+
+static uint16_t reg16_get(uint16_t a)
+{
+	return (fake_w5200_mem[a] << 8) | fake_w5200_mem[a+1];
+}
+
+static void sock_ir_set(int s, uint8_t bits)
+{
+	fake_w5200_mem[SOCK_REG(s, W52_SOCK_IR)] |= bits;
+	fake_w5200_mem[W52_IR2] |= 1 << s;
+}
+
+void fake_w5200_send_complete(int s)
+{
+	if (!(send_busy & (1 << s)))
+		return;
+	send_busy &= ~(1 << s);
+	fake_w5200_mem[SOCK_REG(s, W52_SOCK_TX_READPTR)] = send_end[s] >> 8;
+	fake_w5200_mem[SOCK_REG(s, W52_SOCK_TX_READPTR) + 1] = send_end[s] & 0xFF;
+	sock_ir_set(s, W52_SOCK_IR_SEND_OK);
+}
+
+static void command(int s, uint8_t cmd)
+{
+	uint16_t tx_rd;
+
+	if (fake_w5200_ncmds < FAKE_LOG_SIZE) {
+		fake_w5200_cmds[fake_w5200_ncmds].sock = s;
+		fake_w5200_cmds[fake_w5200_ncmds].cmd = cmd;
+	}
+	fake_w5200_ncmds++;
+
+	switch (cmd) {
+		case W52_SOCK_CMD_SEND:
+			if (send_busy & (1 << s)) {
+				fake_w5200_send_overlaps++;
+				return;
+			}
+			tx_rd = reg16_get(SOCK_REG(s, W52_SOCK_TX_READPTR));
+			send_end[s] = reg16_get(SOCK_REG(s, W52_SOCK_TX_WRITEPTR));
+			if (fake_w5200_nsends < FAKE_LOG_SIZE) {
+				fake_w5200_sends[fake_w5200_nsends].sock = s;
+				fake_w5200_sends[fake_w5200_nsends].start = tx_rd;
+				fake_w5200_sends[fake_w5200_nsends].len = send_end[s] - tx_rd;
+			}
+			fake_w5200_nsends++;
+			send_busy |= 1 << s;
+			if (!(fake_w5200_send_hold & (1 << s)))
+				fake_w5200_send_complete(s);
+			break;
+		case W52_SOCK_CMD_DISCON:
+		case W52_SOCK_CMD_CLOSE:
+			fake_w5200_mem[SOCK_REG(s, W52_SOCK_SR)] = W52_SOCK_SR_SOCK_CLOSED;
+			send_busy &= ~(1 << s);
+			break;
+	}
+}
+
+void fake_w5200_reset()
+{
+	int i;
+
+	if (fake_w5200_mem == NULL)
+		fake_w5200_mem = malloc(0x10000);
+	memset(fake_w5200_mem, 0, 0x10000);
+	fake_w5200_mem[W52_VERSIONR] = 0x03;
+	for (i=0; i < 8; i++) {
+		fake_w5200_mem[W52_SOCK_REG_RESOLVE(i, W52_SOCK_RXMEM_SIZE)] = 2;
+		fake_w5200_mem[W52_SOCK_REG_RESOLVE(i, W52_SOCK_TXMEM_SIZE)] = 2;
+	}
+	fake_w5200_frames = 0;
+	hdr_len = 0;
+	fake_w5200_nsends = fake_w5200_send_overlaps = fake_w5200_ncmds = 0;
+	fake_w5200_send_hold = 0;
+	send_busy = 0;
+}
+
+void fake_w5200_select()
+{
+	hdr_len = 0;
+}
+
+void fake_w5200_deselect()
+{
+	if (hdr_len == 4)
+		fake_w5200_frames++;
+	hdr_len = 0;
+}
+
+uint8_t fake_w5200_xfer(uint8_t mosi)
+{
+	uint8_t miso;
+
+	if (hdr_len < 4) {
+		hdr[hdr_len++] = mosi;
+		if (hdr_len == 4) {
+			addr = (hdr[0] << 8) | hdr[1];
+			len = ((hdr[2] & 0x7F) << 8) | hdr[3];
+		}
+		return 0x00;
+	}
+	if (!len)
+		return 0xFF;  // Clocked past the end of the frame
+	len--;
+	if (hdr[2] & 0x80) {
+		if (addr >= 0x4000 && addr < 0x4800 && (addr & 0xFF) == W52_SOCK_CR) {
+			// Sn_CR accepts the command and clears itself
+			fake_w5200_mem[addr] = 0x00;
+			command((addr >> 8) & 0x07, mosi);
+		} else if (addr >= 0x4000 && addr < 0x4800 && (addr & 0xFF) == W52_SOCK_IR) {
+			fake_w5200_mem[addr] &= ~mosi;
+			if (!fake_w5200_mem[addr])
+				fake_w5200_mem[W52_IR2] &= ~(1 << ((addr >> 8) & 0x07));
+		} else {
+			fake_w5200_mem[addr] = mosi;
+		}
+		addr++;
+		return 0x00;
+	}
+	miso = fake_w5200_mem[addr];
+	if (fake_w5200_read_hook != NULL)
+		miso = fake_w5200_read_hook(addr, miso);
+	addr++;
+	return miso;
+}
@@ -0,0 +1,136 @@
+/* msp430.h
+ * Host stand-in for the TI device header, so the library builds and runs on a PC under tests/host.
+ *
+ * Describes an F5529-like part (USCI_B0 + DMA).  USCI_B0, the DMA controller and P6OUT (W5200 chip
+ * select) are routed through fake_msp430.c, which clocks bytes into the W5200 model as the library
+ * pokes the registers; everything else is plain RAM.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef HOST_MSP430_H
+#define HOST_MSP430_H
+
+#include <stdint.h>
+
+#define __MSP430_HAS_USCI_B0__
+#define __MSP430_HAS_USCI_A1__
+#define __MSP430_HAS_DMAX_3__
+
+/* Modelled registers */
+#define FAKE_UCB0TXBUF 0
+#define FAKE_UCB0RXBUF 1
+#define FAKE_UCB0IFG 2
+#define FAKE_UCB0STAT 3
+#define FAKE_UCB0IE 4
+#define FAKE_UCB0CTL0 5
+#define FAKE_UCB0CTL1 6
+#define FAKE_UCB0BR0 7
+#define FAKE_UCB0BR1 8
+#define FAKE_P6OUT 9
+
+#define FAKE_DMACTL0 0
+#define FAKE_DMA0CTL 1
+#define FAKE_DMA0SAL 2
+#define FAKE_DMA0DAL 3
+#define FAKE_DMA0SZ 4
+#define FAKE_DMA1CTL 5
+#define FAKE_DMA1SAL 6
+#define FAKE_DMA1DAL 7
+#define FAKE_DMA1SZ 8
+
+volatile uint8_t *fake_reg8(int);
+volatile uint16_t *fake_reg16(int);
+
+#define UCB0TXBUF (*fake_reg8(FAKE_UCB0TXBUF))
+#define UCB0RXBUF (*fake_reg8(FAKE_UCB0RXBUF))
+#define UCB0IFG (*fake_reg8(FAKE_UCB0IFG))
+#define UCB0STAT (*fake_reg8(FAKE_UCB0STAT))
+#define UCB0IE (*fake_reg8(FAKE_UCB0IE))
+#define UCB0CTL0 (*fake_reg8(FAKE_UCB0CTL0))
+#define UCB0CTL1 (*fake_reg8(FAKE_UCB0CTL1))
+#define UCB0BR0 (*fake_reg8(FAKE_UCB0BR0))
+#define UCB0BR1 (*fake_reg8(FAKE_UCB0BR1))
+#define P6OUT (*fake_reg8(FAKE_P6OUT))
+
+#define DMACTL0 (*fake_reg16(FAKE_DMACTL0))
+#define DMA0CTL (*fake_reg16(FAKE_DMA0CTL))
+#define DMA0SAL (*fake_reg16(FAKE_DMA0SAL))
+#define DMA0DAL (*fake_reg16(FAKE_DMA0DAL))
+#define DMA0SZ (*fake_reg16(FAKE_DMA0SZ))
+#define DMA1CTL (*fake_reg16(FAKE_DMA1CTL))
+#define DMA1SAL (*fake_reg16(FAKE_DMA1SAL))
+#define DMA1DAL (*fake_reg16(FAKE_DMA1DAL))
+#define DMA1SZ (*fake_reg16(FAKE_DMA1SZ))
+
+/* Plain RAM */
+extern volatile uint8_t P2DIR, P2OUT, P2IN, P2REN, P2IES, P2IE, P2IFG;
+extern volatile uint8_t P3SEL, P3DIR, P4SEL, P6DIR;
+extern volatile uint8_t UCA1TXBUF, UCA1RXBUF, UCA1STAT, UCA1CTL0, UCA1CTL1, UCA1BR0, UCA1BR1, UCA1MCTL;
+extern volatile uint8_t UCA1IFG, UCA1IE;
+
+#define BIT0 (0x0001)
+#define BIT1 (0x0002)
+#define BIT2 (0x0004)
+#define BIT3 (0x0008)
+#define BIT4 (0x0010)
+#define BIT5 (0x0020)
+#define BIT6 (0x0040)
+#define BIT7 (0x0080)
+#define BIT8 (0x0100)
+#define BIT9 (0x0200)
+#define BITA (0x0400)
+#define BITB (0x0800)
+#define BITC (0x1000)
+#define BITD (0x2000)
+#define BITE (0x4000)
+#define BITF (0x8000)
+
+#define UCSWRST (0x01)
+#define UCCKPH (0x80)
+#define UCMSB (0x20)
+#define UCMST (0x08)
+#define UCMODE_0 (0x00)
+#define UCSYNC (0x01)
+#define UCSSEL_2 (0x80)
+#define UCRXIFG (0x01)
+#define UCTXIFG (0x02)
+#define UCRXIE (0x01)
+#define UCBUSY (0x01)
+#define UCOE (0x20)
+#define UCBRS_0 (0x00)
+#define UCBRF_11 (0xB0)
+#define UCOS16 (0x01)
+
+#define DMADT_0 (0x0000)
+#define DMASRCINCR_0 (0x0000)
+#define DMASRCINCR_3 (0x0300)
+#define DMADSTINCR_0 (0x0000)
+#define DMADSTINCR_3 (0x0C00)
+#define DMASBDB (0x00C0)
+#define DMAEN (0x0010)
+#define DMAIFG (0x0008)
+#define DMAIE (0x0004)
+
+/* Status register and intrinsics; there are no interrupts on the host, only GIE bookkeeping */
+#define GIE (0x0008)
+extern uint16_t fake_sr;
+#define __get_SR_register() (fake_sr)
+#define _DINT() (fake_sr &= ~GIE)
+#define _EINT() (fake_sr |= GIE)
+#define __delay_cycles(x) ((void)(x))
+#define LPM0 ((void)0)
+
+
+#endif
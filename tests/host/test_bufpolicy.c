@@ -0,0 +1,372 @@
+/* test_bufpolicy.c
+ * Replays socket traffic traces through the ring-buffer layer against the fake W5200, rebalancing the
+ * buffer memory with wiznet_bufpol_static, wiznet_bufpol_proportional and wiznet_bufpol_priority between
+ * epochs, and checks every resulting layout (no side over 16KB, sizes the chip accepts, registers and
+ * bases consistent) along with where each policy should have put the memory, including a service that
+ * moves to another socket number and a listen pool sharing one port.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "w5200_bufpolicy.h"
+#include "fake_hw.h"
+
+#if !W52_BUF_POLICY
+#error "test_bufpolicy needs W52_BUF_POLICY (see tests/host/w5200_config.h)"
+#endif
+
+/* Trace events: OPEN opens 'sock' as TCP bound to port 'len'; RX/TX are 'count' transfers of 'len'
+ * bytes on 'sock' (len <= 1KB, the smallest buffer a policy hands out); REBAL closes every socket and
+ * ends an epoch, END ends the trace.
+ */
+#define RX 0
+#define TX 1
+#define REBAL 2
+#define END 3
+#define OPEN 4
+
+typedef struct {
+	uint8_t what;
+	uint8_t sock;
+	uint16_t len;
+	uint16_t count;
+} TraceEvent;
+
+static const TraceEvent trace_idle[] = {
+	{ REBAL }, { END }
+};
+
+// One bulk download on socket 0 with its ACK-sized requests, a trickle on socket 1
+static const TraceEvent trace_bulk[] = {
+	{ OPEN, 0, 80 }, { OPEN, 1, 23 },
+	{ RX, 0, 1024, 40 }, { TX, 0, 64, 40 }, { TX, 1, 100, 4 },
+	{ REBAL }, { END }
+};
+
+// The busy service moves from socket 0 to 5; socket 0 is not reopened
+static const TraceEvent trace_shift[] = {
+	{ OPEN, 0, 80 }, { RX, 0, 1024, 20 }, { TX, 0, 200, 5 },
+	{ REBAL },
+	{ OPEN, 5, 80 }, { RX, 5, 1024, 30 }, { TX, 5, 200, 20 },
+	{ REBAL }, { END }
+};
+
+/* The web server and telnet swap socket numbers after a busy epoch; in a quiet second epoch the web
+ * server's history must follow it to socket 3 rather than stay with socket 0.
+ */
+static const TraceEvent trace_move[] = {
+	{ OPEN, 0, 80 }, { OPEN, 3, 23 },
+	{ RX, 0, 1024, 40 }, { TX, 0, 1024, 40 }, { RX, 3, 16, 10 }, { TX, 3, 16, 10 },
+	{ REBAL },
+	{ OPEN, 3, 80 }, { OPEN, 0, 23 },
+	{ RX, 3, 64, 4 }, { TX, 3, 64, 4 }, { RX, 0, 16, 10 }, { TX, 0, 16, 10 },
+	{ REBAL }, { END }
+};
+
+// A listen pool on port 80 over sockets 0 and 1 where one member drew all the traffic, telnet on 2
+static const TraceEvent trace_pool[] = {
+	{ OPEN, 0, 80 }, { OPEN, 1, 80 }, { OPEN, 2, 23 },
+	{ RX, 0, 1024, 40 }, { TX, 0, 1024, 40 }, { RX, 1, 64, 2 }, { TX, 1, 64, 2 },
+	{ RX, 2, 16, 10 }, { TX, 2, 16, 10 },
+	{ REBAL }, { END }
+};
+
+// A web server on socket 0 moving bulk data, an interactive telnet session on socket 1 (priority 1)
+static const TraceEvent trace_web_telnet[] = {
+	{ OPEN, 0, 80 }, { OPEN, 1, 23 },
+	{ RX, 0, 512, 60 }, { TX, 0, 1024, 30 }, { RX, 1, 16, 10 }, { TX, 1, 16, 10 },
+	{ REBAL }, { END }
+};
+
+static uint8_t data[1024], back[1024];
+
+static uint16_t chip_r16(int s, uint16_t reg)
+{
+	uint16_t a = W52_SOCK_REG_RESOLVE(s, reg);
+
+	return (fake_w5200_mem[a] << 8) | fake_w5200_mem[a+1];
+}
+
+static void chip_w16(int s, uint16_t reg, uint16_t val)
+{
+	uint16_t a = W52_SOCK_REG_RESOLVE(s, reg);
+
+	fake_w5200_mem[a] = val >> 8;
+	fake_w5200_mem[a+1] = val & 0xFF;
+}
+
+// The chip receives 'len' bytes for 's'; the application sizes them up and reads them out
+static void replay_rx(int s, uint16_t len, uint8_t seed)
+{
+	uint16_t i, rx_rd = w52_sockets[s].rx_rd;
+
+	for (i=0; i < len; i++) {
+		data[i] = (uint8_t)(i * 13 + seed);
+		fake_w5200_mem[W52_SOCK_RXBASE(s) + ((rx_rd + i) & W52_SOCK_RXMASK(s))] = data[i];
+	}
+	chip_w16(s, W52_SOCK_RX_WRITEPTR, rx_rd + len);
+	if (len < W52_SOCK_RXSIZE(s))  // A full ring reads as empty from the pointers alone
+		FAKE_CHECK(wiznet_recvsize(s) == len);
+	wiznet_r_rxbuf(s, len, back, 0);
+	FAKE_CHECK(!memcmp(back, data, len));
+	FAKE_CHECK(w52_sockets[s].rx_rd == (uint16_t)(rx_rd + len));
+}
+
+// The application queues 'len' bytes on 's', checks its free space, and the chip sends them
+static void replay_tx(int s, uint16_t len, uint8_t seed)
+{
+	uint16_t i, tx_wr = w52_sockets[s].tx_wr;
+
+	chip_w16(s, W52_SOCK_TX_READPTR, tx_wr);
+	for (i=0; i < len; i++)
+		data[i] = (uint8_t)(i * 7 + seed);
+	wiznet_w_txbuf(s, len, data);
+	for (i=0; i < len; i++)
+		FAKE_CHECK(fake_w5200_mem[W52_SOCK_TXBASE(s) + ((tx_wr + i) & W52_SOCK_TXMASK(s))] == data[i]);
+	if (len < W52_SOCK_TXSIZE(s))
+		FAKE_CHECK(wiznet_read_virtual_fsr(s) == W52_SOCK_TXSIZE(s) - len);
+	chip_w16(s, W52_SOCK_TX_READPTR, tx_wr + len);
+}
+
+static int is_bufsize(uint8_t kb)
+{
+	return kb && kb <= 16 && !(kb & (kb-1));
+}
+
+// Checks every layout must pass, whichever policy produced it
+static void check_layout(uint8_t *rxkb, uint8_t *txkb)
+{
+	int i;
+	uint16_t rxbase = W52_RXMEM_BASE, txbase = W52_TXMEM_BASE, rxttl = 0, txttl = 0;
+
+	for (i=0; i < 8; i++) {
+		if (i >= W52_MAX_SOCKETS) {
+			FAKE_CHECK(chip_r16(i, W52_SOCK_RXMEM_SIZE) == 0x0000);  // Sn_RXMEM_SIZE, Sn_TXMEM_SIZE
+			continue;
+		}
+		rxkb[i] = W52_SOCK_RXSIZE(i) / 1024;
+		txkb[i] = W52_SOCK_TXSIZE(i) / 1024;
+		FAKE_CHECK(is_bufsize(rxkb[i]) && W52_SOCK_RXSIZE(i) == rxkb[i] * 1024);
+		FAKE_CHECK(is_bufsize(txkb[i]) && W52_SOCK_TXSIZE(i) == txkb[i] * 1024);
+		FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(i, W52_SOCK_RXMEM_SIZE)] == rxkb[i]);
+		FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(i, W52_SOCK_TXMEM_SIZE)] == txkb[i]);
+		FAKE_CHECK(W52_SOCK_RXBASE(i) == rxbase);
+		FAKE_CHECK(W52_SOCK_TXBASE(i) == txbase);
+		rxbase += W52_SOCK_RXSIZE(i);
+		txbase += W52_SOCK_TXSIZE(i);
+		rxttl += rxkb[i];
+		txttl += txkb[i];
+	}
+	FAKE_CHECK(rxttl == 16);  // Never over 16KB per side, and no memory left idle
+	FAKE_CHECK(txttl == 16);
+}
+
+/* Replay 'trace' under 'policy'; rxkb[]/txkb[] get the layout after the last epoch.
+ * w52_bufpol_prio[] is whatever the caller set.
+ */
+static void replay(const TraceEvent *trace, WIZNETBufPolicy policy, uint8_t *rxkb, uint8_t *txkb)
+{
+	WIZNETBufType before[W52_BUFPOL_TYPES];
+	uint16_t n;
+	int i;
+
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+	memset(w52_bufstats, 0, sizeof(w52_bufstats));
+	memset(w52_buftypes, 0, sizeof(w52_buftypes));
+	memset(w52_bufpol_type, 0, sizeof(w52_bufpol_type));
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+	wiznet_bufpol_set(policy);
+
+	for (; trace->what != END; trace++) {
+		switch (trace->what) {
+			case OPEN:
+				w52_sockets[trace->sock].mode = IPPROTO_TCP;
+				wiznet_bufpol_open(trace->sock);
+				W52_BUFPOL_BIND(trace->sock, trace->len);
+				break;
+			case RX:
+				for (n=0; n < trace->count; n++)
+					replay_rx(trace->sock, trace->len, n);
+				break;
+			case TX:
+				for (n=0; n < trace->count; n++)
+					replay_tx(trace->sock, trace->len, n);
+				break;
+			case REBAL:
+				// What wiznet_close() does, without the chip side
+				for (i=0; i < W52_MAX_SOCKETS; i++) {
+					if (!w52_sockets[i].mode)
+						continue;
+					wiznet_bufpol_account(i);
+					FAKE_CHECK(!w52_bufstats[i].rx_bytes && !w52_bufstats[i].tx_bytes);
+					if (i != W52_MAX_SOCKETS-1)
+						w52_sockets[i].mode = 0;
+				}
+				memcpy(before, w52_buftypes, sizeof(before));
+				w52_sockets[W52_MAX_SOCKETS-1].mode = IPPROTO_TCP;
+				FAKE_CHECK(wiznet_bufpol_rebalance() == -EBUSY);
+				FAKE_CHECK(!memcmp(before, w52_buftypes, sizeof(before)));
+				w52_sockets[W52_MAX_SOCKETS-1].mode = 0;
+
+				FAKE_CHECK(wiznet_bufpol_rebalance() == 0);
+				check_layout(rxkb, txkb);
+				for (i=0; i < W52_BUFPOL_TYPES; i++) {
+					FAKE_CHECK(w52_buftypes[i].stats.rx_bytes == before[i].stats.rx_bytes >> 1);
+					FAKE_CHECK(w52_buftypes[i].stats.tx_bytes == before[i].stats.tx_bytes >> 1);
+					FAKE_CHECK(!w52_buftypes[i].stats.rx_peak && !w52_buftypes[i].stats.tx_peak);
+				}
+				break;
+		}
+	}
+}
+
+static void check_traces()
+{
+	uint8_t rxkb[W52_MAX_SOCKETS], txkb[W52_MAX_SOCKETS];
+	int i;
+
+	memset(w52_bufpol_prio, 0, sizeof(w52_bufpol_prio));
+
+	// Static: the default layout whatever the traffic; NULL selects it too
+	replay(trace_bulk, wiznet_bufpol_static, rxkb, txkb);
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		FAKE_CHECK(rxkb[i] == W52_SOCK_MEM_SIZE / 1024 && txkb[i] == W52_SOCK_MEM_SIZE / 1024);
+	replay(trace_web_telnet, NULL, rxkb, txkb);
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		FAKE_CHECK(rxkb[i] == W52_SOCK_MEM_SIZE / 1024 && txkb[i] == W52_SOCK_MEM_SIZE / 1024);
+
+	// No traffic spreads memory evenly under every policy
+	replay(trace_idle, wiznet_bufpol_proportional, rxkb, txkb);
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		FAKE_CHECK(rxkb[i] == 16 / W52_MAX_SOCKETS && txkb[i] == 16 / W52_MAX_SOCKETS);
+	replay(trace_idle, wiznet_bufpol_priority, rxkb, txkb);
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		FAKE_CHECK(rxkb[i] == 16 / W52_MAX_SOCKETS && txkb[i] == 16 / W52_MAX_SOCKETS);
+
+	// Bulk: socket 0 takes as much as leaves everyone else 1KB
+	replay(trace_bulk, wiznet_bufpol_proportional, rxkb, txkb);
+	FAKE_CHECK(rxkb[0] == 8 && txkb[0] == 8);
+	replay(trace_bulk, wiznet_bufpol_priority, rxkb, txkb);
+	FAKE_CHECK(rxkb[0] == 8 && txkb[0] == 8);
+
+	// Shift: the service's history goes with it to socket 5, leaving socket 0 nothing
+	replay(trace_shift, wiznet_bufpol_proportional, rxkb, txkb);
+	FAKE_CHECK(rxkb[5] == 8 && txkb[5] == 8);
+	FAKE_CHECK(rxkb[0] <= 2 && txkb[0] <= 2);
+
+	// Move: socket 3 is sized for the web server it now serves, not the telnet session it used to
+	replay(trace_move, wiznet_bufpol_proportional, rxkb, txkb);
+	FAKE_CHECK(rxkb[3] == 8 && txkb[3] == 8);
+	FAKE_CHECK(rxkb[0] < rxkb[3] && txkb[0] < txkb[3]);
+
+	// Pool: both members of the port 80 pool are judged together
+	replay(trace_pool, wiznet_bufpol_proportional, rxkb, txkb);
+	FAKE_CHECK(rxkb[0] == rxkb[1] && txkb[0] == txkb[1]);
+	FAKE_CHECK(rxkb[0] > rxkb[2] && txkb[0] > txkb[2]);
+
+	// Web + telnet: bytes favour the web server, priority favours telnet
+	replay(trace_web_telnet, wiznet_bufpol_proportional, rxkb, txkb);
+	FAKE_CHECK(rxkb[0] == 8 && txkb[0] == 8);
+	FAKE_CHECK(rxkb[1] < rxkb[0] && txkb[1] < txkb[0]);
+	w52_bufpol_prio[1] = 1;
+	replay(trace_web_telnet, wiznet_bufpol_priority, rxkb, txkb);
+	FAKE_CHECK(rxkb[1] == 8 && txkb[1] == 8);
+	FAKE_CHECK(rxkb[0] == 2 && txkb[0] == 2);
+	w52_bufpol_prio[1] = 0;
+}
+
+static uint32_t random_bytes()
+{
+	switch (rand() % 6) {
+		case 0: return 0;
+		case 1: return 0xFFFFFFFFUL;
+		case 2: return rand() % 64;
+	}
+	return ((uint32_t)rand() << 16) ^ rand();
+}
+
+/* The policies on arbitrary statistics (extreme byte counts, full rings, priorities), straight into the
+ * policy functions: _wiznet_bufpol_fill() must always land on valid sizes totalling exactly 16KB a side.
+ */
+static void check_random()
+{
+	static const WIZNETBufPolicy policies[] = { wiznet_bufpol_proportional, wiznet_bufpol_priority };
+	WIZNETBufStats stats[W52_MAX_SOCKETS];
+	uint8_t rxkb[W52_MAX_SOCKETS], txkb[W52_MAX_SOCKETS];
+	uint16_t rxttl, txttl;
+	int n, p, i, j, peaks;
+
+	srand(5200);
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+	for (n=0; n < 2000; n++) {
+		peaks = n & 1;
+		for (i=0; i < W52_MAX_SOCKETS; i++) {
+			stats[i].rx_bytes = random_bytes();
+			stats[i].tx_bytes = random_bytes();
+			stats[i].rx_peak = peaks && (rand() & 1) ? 0xFFFF : 0;
+			stats[i].tx_peak = peaks && (rand() & 1) ? 0xFFFF : 0;
+			w52_bufpol_prio[i] = (n & 2) ? rand() % 3 : 0;
+		}
+		for (p=0; p < 2; p++) {
+			memset(rxkb, 0xEE, sizeof(rxkb));
+			memset(txkb, 0xEE, sizeof(txkb));
+			policies[p](stats, rxkb, txkb);
+			rxttl = txttl = 0;
+			for (i=0; i < W52_MAX_SOCKETS; i++) {
+				FAKE_CHECK(is_bufsize(rxkb[i]) && is_bufsize(txkb[i]));
+				rxttl += rxkb[i];
+				txttl += txkb[i];
+			}
+			FAKE_CHECK(rxttl == 16 && txttl == 16);
+
+			// Without full rings or priorities, more bytes never means a smaller buffer
+			if (peaks || (n & 2) || p != 0)
+				continue;
+			for (i=0; i < W52_MAX_SOCKETS; i++) {
+				for (j=0; j < W52_MAX_SOCKETS; j++) {
+					if (stats[i].rx_bytes > stats[j].rx_bytes)
+						FAKE_CHECK(rxkb[i] >= rxkb[j]);
+					if (stats[i].tx_bytes > stats[j].tx_bytes)
+						FAKE_CHECK(txkb[i] >= txkb[j]);
+				}
+			}
+		}
+	}
+	memset(w52_bufpol_prio, 0, sizeof(w52_bufpol_prio));
+}
+
+int test_main()
+{
+	check_traces();
+	check_random();
+
+	printf("test_bufpolicy: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
@@ -0,0 +1,151 @@
+/* test_cork.c
+ * W52_SO_CORK against the fake W5200's SEND model: small committing sends coalesce into one SEND at the
+ * segment threshold, held data goes out once its delay (counted from the first held byte) runs out, an
+ * explicit wiznet_txcommit() or wiznet_close() flushes it at once, and out-of-range delays are refused.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#define S 2
+#define DELAY 3
+#define MSS 100
+
+static uint8_t data[256];
+
+static void ticks(int n)
+{
+	while (n--)
+		wiznet_cork_tick();
+}
+
+// Socket S connected with empty rings, SENDs completing at once, corked with a 100-byte segment
+static void setup()
+{
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+	w52_sockets[S].mode = W52_SOCK_MR_PROTO_TCP;
+	fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_SR)] = W52_SOCK_SR_SOCK_ESTABLISHED;
+	FAKE_CHECK(wiznet_setsockopt(S, W52_SO_MSS, MSS) == 0);
+	FAKE_CHECK(wiznet_setsockopt(S, W52_SO_CORK, DELAY) == 0);
+}
+
+// Committing sends below the segment size only write to the ring; the one reaching it sends everything
+static void test_coalesce()
+{
+	setup();
+	FAKE_CHECK(wiznet_send(S, data, 30, 1) == 0);
+	FAKE_CHECK(wiznet_send(S, data, 30, 1) == 0);
+	FAKE_CHECK(wiznet_send(S, data, 30, 1) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 0);
+	FAKE_CHECK(wiznet_send(S, data, 30, 1) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].start == 0 && fake_w5200_sends[0].len == 120);
+	FAKE_CHECK(wiznet_cork_poll() == 0);  // Nothing left held
+}
+
+// Held data goes out from wiznet_cork_poll() once DELAY ticks have passed since its first byte
+static void test_tick_flush()
+{
+	setup();
+	FAKE_CHECK(wiznet_send(S, data, 10, 1) == 0);
+	ticks(DELAY - 1);
+	FAKE_CHECK(wiznet_cork_poll() == 0);
+	FAKE_CHECK(fake_w5200_nsends == 0);
+	ticks(1);
+	FAKE_CHECK(wiznet_cork_poll() == 1);
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].len == 10);
+
+	/* An idle socket's age saturates; the delay must restart at the next held byte even when it was
+	 * written without a commit and the commit that follows holds more than it wrote.
+	 */
+	ticks(300);
+	FAKE_CHECK(wiznet_send(S, data, 20, 0) == 0);
+	FAKE_CHECK(wiznet_send(S, data, 10, 1) == 0);
+	FAKE_CHECK(wiznet_cork_poll() == 0);
+	FAKE_CHECK(fake_w5200_nsends == 1);
+	ticks(DELAY);
+	FAKE_CHECK(wiznet_cork_poll() == 1);
+	FAKE_CHECK(fake_w5200_nsends == 2 && fake_w5200_sends[1].start == 10 && fake_w5200_sends[1].len == 30);
+}
+
+// wiznet_txcommit() bypasses the cork
+static void test_explicit_commit()
+{
+	setup();
+	FAKE_CHECK(wiznet_send(S, data, 10, 1) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 0);
+	FAKE_CHECK(wiznet_txcommit(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].len == 10);
+	ticks(DELAY);
+	FAKE_CHECK(wiznet_cork_poll() == 0);
+	FAKE_CHECK(fake_w5200_nsends == 1);
+}
+
+// wiznet_close() sends held data before DISCON
+static void test_close_drain()
+{
+	int i, send_at = -1, discon_at = -1;
+
+	setup();
+	FAKE_CHECK(wiznet_send(S, data, 10, 1) == 0);
+	FAKE_CHECK(wiznet_close(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].len == 10);
+	for (i=0; i < fake_w5200_ncmds && i < FAKE_LOG_SIZE; i++) {
+		if (fake_w5200_cmds[i].sock != S)
+			continue;
+		if (fake_w5200_cmds[i].cmd == W52_SOCK_CMD_SEND && send_at < 0)
+			send_at = i;
+		if (fake_w5200_cmds[i].cmd == W52_SOCK_CMD_DISCON && discon_at < 0)
+			discon_at = i;
+	}
+	FAKE_CHECK(send_at >= 0 && discon_at > send_at);
+	FAKE_CHECK(!w52_sockets[S].cork_held);
+}
+
+static void test_range()
+{
+	uint16_t val;
+
+	setup();
+	FAKE_CHECK(wiznet_setsockopt(S, W52_SO_CORK, 256) == -EINVAL);
+	FAKE_CHECK(wiznet_getsockopt(S, W52_SO_CORK, &val) == 0 && val == DELAY);
+	FAKE_CHECK(wiznet_setsockopt(S, W52_SO_CORK, 255) == 0);
+}
+
+int test_main()
+{
+	test_coalesce();
+	test_tick_flush();
+	test_explicit_commit();
+	test_close_drain();
+	test_range();
+
+	printf("test_cork: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
@@ -0,0 +1,166 @@
+/* test_generate.c
+ * wiznet_send_generate() against the fake W5200: a producer with nothing to give costs no bus traffic, one
+ * that runs dry early moves Sn_TX_WR by what it produced, output wraps around the TX ring, and committing
+ * sends go through the auto-cork.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#define S 1
+
+// Counts up from 'next' until 'left' runs out
+typedef struct {
+	uint8_t next;
+	uint16_t left;
+	int calls;
+} CountGen;
+
+static uint16_t count_producer(void *ctx, uint8_t *buf, uint16_t maxlen)
+{
+	CountGen *gen = (CountGen *)ctx;
+	uint16_t n = 0;
+
+	gen->calls++;
+	while (n < maxlen && gen->left) {
+		buf[n++] = gen->next++;
+		gen->left--;
+	}
+	return n;
+}
+
+static uint16_t chip_reg16(uint8_t reg)
+{
+	uint16_t a = W52_SOCK_REG_RESOLVE(S, reg);
+
+	return (fake_w5200_mem[a] << 8) | fake_w5200_mem[a+1];
+}
+
+static void chip_w_reg16(uint8_t reg, uint16_t val)
+{
+	uint16_t a = W52_SOCK_REG_RESOLVE(S, reg);
+
+	fake_w5200_mem[a] = val >> 8;
+	fake_w5200_mem[a+1] = val & 0xFF;
+}
+
+// Socket S connected with empty rings starting at 'start', SENDs completing at once
+static void setup(uint16_t start)
+{
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+	w52_sockets[S].mode = W52_SOCK_MR_PROTO_TCP;
+	fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_SR)] = W52_SOCK_SR_SOCK_ESTABLISHED;
+	chip_w_reg16(W52_SOCK_TX_READPTR, start);
+	chip_w_reg16(W52_SOCK_TX_WRITEPTR, start);
+	w52_sockets[S].tx_wr = w52_sockets[S].tx_rd = start;
+}
+
+// Nothing produced: only the register snapshot goes over the bus
+static void test_empty()
+{
+	CountGen gen = { 0, 0, 0 };
+	uint32_t frames, bytes;
+
+	setup(0);
+	FAKE_CHECK(wiznet_send_generate(S, 100, count_producer, &gen, 0) == 0);  // Snapshot only
+	frames = fake_w5200_frames;
+	bytes = fake_spi_bytes;
+	FAKE_CHECK(wiznet_generate_txbuf(S, 100, count_producer, &gen) == 0);
+	FAKE_CHECK(fake_w5200_frames == frames && fake_spi_bytes == bytes);
+	FAKE_CHECK(gen.calls == 2);
+	FAKE_CHECK(chip_reg16(W52_SOCK_TX_WRITEPTR) == 0 && w52_sockets[S].tx_wr == 0);
+	FAKE_CHECK(wiznet_send_generate(S, 100, count_producer, &gen, 1) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 0);
+}
+
+// A producer that runs dry early: TX_WR covers what it produced and the SEND goes no further
+static void test_short()
+{
+	CountGen gen = { 1, 5, 0 };
+	uint16_t base;
+
+	setup(0);
+	base = W52_SOCK_TXBASE(S);
+	FAKE_CHECK(wiznet_send_generate(S, 100, count_producer, &gen, 1) == 5);
+	FAKE_CHECK(chip_reg16(W52_SOCK_TX_WRITEPTR) == 5);
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].len == 5);
+	FAKE_CHECK(fake_w5200_mem[base] == 1 && fake_w5200_mem[base+4] == 5);
+}
+
+// Output split across the end of the TX ring
+static void test_wrap()
+{
+	CountGen gen = { 0, 0xFFFF, 0 };
+	uint16_t base, size, start;
+
+	setup(0);
+	size = W52_SOCK_TXSIZE(S);
+	start = size - 3;
+	setup(start);
+	base = W52_SOCK_TXBASE(S);
+	FAKE_CHECK(wiznet_send_generate(S, 10, count_producer, &gen, 0) == 10);
+	FAKE_CHECK(fake_w5200_mem[base+size-3] == 0 && fake_w5200_mem[base+size-1] == 2);
+	FAKE_CHECK(fake_w5200_mem[base] == 3 && fake_w5200_mem[base+6] == 9);
+	FAKE_CHECK(chip_reg16(W52_SOCK_TX_WRITEPTR) == (uint16_t)(start + 10));
+}
+
+// do_commit on a corked socket only holds the data, like wiznet_send()
+static void test_cork()
+{
+	CountGen gen = { 0, 0xFFFF, 0 };
+	int i;
+
+	setup(0);
+	FAKE_CHECK(wiznet_setsockopt(S, W52_SO_MSS, 100) == 0);
+	FAKE_CHECK(wiznet_setsockopt(S, W52_SO_CORK, 2) == 0);
+	FAKE_CHECK(wiznet_send_generate(S, 40, count_producer, &gen, 1) == 40);
+	FAKE_CHECK(wiznet_send_generate(S, 40, count_producer, &gen, 1) == 40);
+	FAKE_CHECK(fake_w5200_nsends == 0);
+	FAKE_CHECK(wiznet_send_generate(S, 40, count_producer, &gen, 1) == 40);  // Reaches the segment size
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].len == 120);
+
+	FAKE_CHECK(wiznet_send_generate(S, 10, count_producer, &gen, 1) == 10);
+	FAKE_CHECK(fake_w5200_nsends == 1);
+	for (i=0; i < 2; i++)
+		wiznet_cork_tick();
+	FAKE_CHECK(wiznet_cork_poll() == 1);
+	FAKE_CHECK(fake_w5200_nsends == 2 && fake_w5200_sends[1].len == 10);
+}
+
+int test_main()
+{
+	test_empty();
+	test_short();
+	test_wrap();
+	test_cork();
+
+	printf("test_generate: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
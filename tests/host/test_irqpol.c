@@ -0,0 +1,187 @@
+/* test_irqpol.c
+ * wiznet_irq_getsocket() under each IRQ servicing policy against the fake W5200's Sn_IR/IR2: every socket
+ * flagged in a round is handed out before the next round, round-robin and priority give busy sockets equal
+ * turns, and wiznet_irqpol_weighted() gives a busy socket its weight in turns but offers an idle one again
+ * only while it still has unhandled events.
+ *
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#define LOG_SIZE 64
+
+static int order[LOG_SIZE], norder;
+
+static void setup(WIZNETIrqPolicy policy)
+{
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_irq_count, 0, sizeof(w52_irq_count));
+	memset(w52_irq_weight, 0, sizeof(w52_irq_weight));
+	memset(w52_irq_class, 0, sizeof(w52_irq_class));
+	wiznet_irqpol_set(policy);
+}
+
+// The chip flags 'socks' (a bitmask) and asserts INTn
+static void raise(uint8_t socks)
+{
+	int s;
+
+	for (s=0; s < W52_MAX_SOCKETS; s++) {
+		if (socks & (1 << s)) {
+			fake_w5200_mem[W52_SOCK_REG_RESOLVE(s, W52_SOCK_IR)] |= W52_SOCK_IR_RECV;
+			fake_w5200_mem[W52_IR2] |= 1 << s;
+		}
+	}
+	w5200_irq = 0x01;
+}
+
+/* Up to 'calls' wiznet_irq_getsocket() calls, logged in order[]; sockets in 'busy' keep their events,
+ * the rest are handled (Sn_IR cleared) at their first turn.  Stops at -EAGAIN.
+ */
+static void serve(int calls, uint8_t busy)
+{
+	int sock;
+
+	norder = 0;
+	while (calls--) {
+		sock = wiznet_irq_getsocket();
+		if (sock < 0)
+			break;
+		if (norder < LOG_SIZE)
+			order[norder++] = sock;
+		if (!(busy & (1 << sock)))
+			wiznet_w_sockreg(sock, W52_SOCK_IR, 0xFF);
+	}
+}
+
+static int count(const int *log, int n, int sock)
+{
+	int i, c = 0;
+
+	for (i=0; i < n; i++)
+		c += (log[i] == sock);
+	return c;
+}
+
+// Handle everything and run wiznet_irq_getsocket() dry so the next case starts on a fresh round
+static void drain()
+{
+	int s;
+
+	for (s=0; s < W52_MAX_SOCKETS; s++)
+		wiznet_w_sockreg(s, W52_SOCK_IR, 0xFF);
+	serve(LOG_SIZE, 0);
+	FAKE_CHECK(wiznet_irq_getsocket() == -EAGAIN);
+}
+
+static void test_roundrobin()
+{
+	setup(wiznet_irqpol_roundrobin);
+	raise(BIT1 | BIT3 | BIT5);
+	serve(10, 0);
+	FAKE_CHECK(norder == 3 && order[0] == 1 && order[1] == 3 && order[2] == 5);
+
+	// Three sockets that never go quiet take strict turns
+	raise(BIT1 | BIT3 | BIT5);
+	serve(30, BIT1 | BIT3 | BIT5);
+	FAKE_CHECK(w52_irq_count[1] == 11 && w52_irq_count[3] == 11 && w52_irq_count[5] == 11);
+	drain();
+}
+
+static void test_weighted()
+{
+	int sock;
+
+	setup(wiznet_irqpol_weighted);
+	w52_irq_weight[1] = 3;
+
+	// Handled at its first turn, socket 1 is not offered again this round
+	raise(BIT1 | BIT3 | BIT5);
+	serve(10, 0);
+	FAKE_CHECK(norder == 3 && order[0] == 1 && order[1] == 3 && order[2] == 5);
+
+	// Alone in its round and handled: the lapsed turns end the round rather than repeat it
+	raise(BIT1);
+	serve(10, 0);
+	FAKE_CHECK(norder == 1 && order[0] == 1);
+	FAKE_CHECK(wiznet_irq_getsocket() == -EAGAIN);
+
+	// Busy, it gets three turns per round interleaved with the others' one
+	memset(w52_irq_count, 0, sizeof(w52_irq_count));
+	raise(BIT1 | BIT3 | BIT5);
+	serve(50, BIT1 | BIT3 | BIT5);
+	FAKE_CHECK(count(order, 5, 1) == 3 && count(order, 5, 3) == 1 && count(order, 5, 5) == 1);
+	FAKE_CHECK(w52_irq_count[1] == 30 && w52_irq_count[3] == 10 && w52_irq_count[5] == 10);
+
+	// Busy socket 1 goes quiet after its second turn: its third lapses and the round ends
+	drain();
+	raise(BIT1 | BIT3);
+	norder = 0;
+	while ((sock = wiznet_irq_getsocket()) >= 0 && norder < LOG_SIZE) {
+		order[norder++] = sock;
+		if (sock == 3 || count(order, norder, 1) == 2)
+			wiznet_w_sockreg(sock, W52_SOCK_IR, 0xFF);
+	}
+	FAKE_CHECK(sock == -EAGAIN && norder == 3);
+	FAKE_CHECK(count(order, norder, 1) == 2 && count(order, norder, 3) == 1);
+	drain();
+}
+
+static void test_priority()
+{
+	int i;
+
+	setup(wiznet_irqpol_priority);
+	w52_irq_class[5] = 2;
+	w52_irq_class[1] = 1;
+	raise(BIT1 | BIT3 | BIT5);
+	serve(10, 0);
+	FAKE_CHECK(norder == 3 && order[0] == 5 && order[1] == 1 && order[2] == 3);
+
+	// Busy sockets: the top class leads every round, but nobody is starved
+	memset(w52_irq_count, 0, sizeof(w52_irq_count));
+	raise(BIT1 | BIT3 | BIT5);
+	serve(30, BIT1 | BIT3 | BIT5);
+	for (i=0; i < 30 && i < norder; i += 3)
+		FAKE_CHECK(order[i] == 5 && order[i+1] == 1 && order[i+2] == 3);
+	FAKE_CHECK(w52_irq_count[1] == 10 && w52_irq_count[3] == 10 && w52_irq_count[5] == 10);
+	drain();
+}
+
+int test_main()
+{
+	test_roundrobin();
+	test_weighted();
+	test_priority();
+	wiznet_irqpol_set(NULL);
+
+	printf("test_irqpol: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
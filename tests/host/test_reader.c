@@ -0,0 +1,401 @@
+/* test_reader.c
+ * WIZNETReader against the fake W5200: window refills, skips past the window, peeks across the window
+ * edge and commits that rebase RX_RD.  Also counts the SPI frames it takes to parse a canned DNS A reply
+ * and DHCPOFFER the old way (a wiznet_recv() per field) and through the reader (dnslib/dhcplib).
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "dnslib.h"
+#include "dhcplib.h"
+#include "fake_hw.h"
+
+#define S 3
+
+static uint8_t pkt[400];
+static uint16_t pktlen;
+
+// A reply for www.example.com: the question, then one A record whose NAME is a pointer to it
+static const uint8_t dns_reply[] = {
+	0x00, 0x00, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+	3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+	0x00, 0x01, 0x00, 0x01,
+	0xC0, 0x0C, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0E, 0x10, 0x00, 0x04, 93, 184, 216, 34
+};
+
+static uint16_t chip_rx_rd()
+{
+	uint16_t a = W52_SOCK_REG_RESOLVE(S, W52_SOCK_RX_READPTR);
+
+	return (fake_w5200_mem[a] << 8) | fake_w5200_mem[a+1];
+}
+
+static int count_cmds(uint8_t cmd)
+{
+	int i, n = 0;
+
+	for (i=0; i < fake_w5200_ncmds && i < FAKE_LOG_SIZE; i++) {
+		if (fake_w5200_cmds[i].sock == S && fake_w5200_cmds[i].cmd == cmd)
+			n++;
+	}
+	return n;
+}
+
+// Socket S bound for UDP with pkt[0..len) waiting at the start of its RX buffer
+static void setup(uint16_t len)
+{
+	uint16_t a;
+
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+	w52_sockets[S].mode = W52_SOCK_MR_PROTO_UDP;
+	fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_SR)] = W52_SOCK_SR_SOCK_UDP;
+	memcpy(fake_w5200_mem + W52_SOCK_RXBASE(S), pkt, len);
+	a = W52_SOCK_REG_RESOLVE(S, W52_SOCK_RX_WRITEPTR);
+	fake_w5200_mem[a] = len >> 8;
+	fake_w5200_mem[a+1] = len & 0xFF;
+	pktlen = len;
+}
+
+static void pattern(uint16_t len)
+{
+	uint16_t i;
+
+	for (i=0; i < len; i++)
+		pkt[i] = i;
+	setup(len);
+}
+
+// Byte-at-a-time reads cost one data frame per window, not one per byte
+static void test_refill()
+{
+	WIZNETReader rd;
+	uint8_t c;
+	uint16_t i;
+	uint32_t frames;
+	int bad = 0;
+
+	pattern(100);
+	FAKE_CHECK(wiznet_reader_begin(&rd, S) == 100);
+	frames = fake_w5200_frames;
+	for (i=0; i < 100; i++) {
+		if (wiznet_reader_read(&rd, &c, 1) != 1 || c != (uint8_t)i)
+			bad++;
+	}
+	FAKE_CHECK(!bad);
+	FAKE_CHECK(fake_w5200_frames - frames == (100 + W52_READER_WINDOW - 1) / W52_READER_WINDOW);
+	FAKE_CHECK(wiznet_reader_read(&rd, &c, 1) == -EAGAIN);
+}
+
+// A skip beyond the window only moves the fetch offset
+static void test_skip()
+{
+	WIZNETReader rd;
+	uint8_t buf[4];
+	uint32_t frames;
+
+	pattern(200);
+	FAKE_CHECK(wiznet_reader_begin(&rd, S) == 200);
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, 4) == 4 && buf[0] == 0 && buf[3] == 3);
+	frames = fake_w5200_frames;
+	FAKE_CHECK(wiznet_reader_skip(&rd, 100) == 100);
+	FAKE_CHECK(fake_w5200_frames == frames);
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, 4) == 4 && buf[0] == 104 && buf[3] == 107);
+	FAKE_CHECK(wiznet_reader_skip(&rd, 500) == 200 - 108);  // Clamped to the data
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, 1) == -EAGAIN);
+}
+
+// A peek straddling the end of the window tops it up without consuming anything
+static void test_peek_edge()
+{
+	WIZNETReader rd;
+	uint8_t buf[W52_READER_WINDOW + 1];
+
+	pattern(W52_READER_WINDOW + 10);
+	FAKE_CHECK(wiznet_reader_begin(&rd, S) == W52_READER_WINDOW + 10);
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, W52_READER_WINDOW - 2) == W52_READER_WINDOW - 2);
+	FAKE_CHECK(wiznet_reader_peek(&rd, buf, 8) == 8);
+	FAKE_CHECK(buf[0] == W52_READER_WINDOW - 2 && buf[7] == W52_READER_WINDOW + 5);
+	memset(buf, 0, sizeof(buf));
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, 8) == 8);
+	FAKE_CHECK(buf[0] == W52_READER_WINDOW - 2 && buf[7] == W52_READER_WINDOW + 5);
+
+	FAKE_CHECK(wiznet_reader_peek(&rd, buf, W52_READER_WINDOW + 1) == -EINVAL);
+	FAKE_CHECK(wiznet_reader_peek(&rd, buf, 8) == 4);  // Only 4 left
+	FAKE_CHECK(buf[3] == W52_READER_WINDOW + 9);
+	FAKE_CHECK(wiznet_reader_skip(&rd, 4) == 4);
+	FAKE_CHECK(wiznet_reader_peek(&rd, buf, 1) == -EAGAIN);
+}
+
+// Commit releases what was read or skipped, not what sits unread in the window, and later reads carry on
+static void test_commit()
+{
+	WIZNETReader rd;
+	uint8_t buf[8];
+
+	pattern(100);
+	FAKE_CHECK(wiznet_reader_begin(&rd, S) == 100);
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, 10) == 10);
+	FAKE_CHECK(wiznet_reader_skip(&rd, 5) == 5);
+	FAKE_CHECK(chip_rx_rd() == 0);  // Nothing released yet
+	FAKE_CHECK(wiznet_reader_commit(&rd, 0) == 15);
+	FAKE_CHECK(chip_rx_rd() == 15 && w52_sockets[S].rx_rd == 15);
+	FAKE_CHECK(count_cmds(W52_SOCK_CMD_RECV) == 0);
+
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, 4) == 4 && buf[0] == 15 && buf[3] == 18);
+	FAKE_CHECK(wiznet_reader_skip(&rd, 50) == 50);  // Past the window
+	FAKE_CHECK(wiznet_reader_commit(&rd, 1) == 54);
+	FAKE_CHECK(chip_rx_rd() == 69);
+	FAKE_CHECK(count_cmds(W52_SOCK_CMD_RECV) == 1);
+	FAKE_CHECK(wiznet_reader_commit(&rd, 0) == 0);
+
+	FAKE_CHECK(wiznet_reader_read(&rd, buf, 8) == 8 && buf[0] == 69 && buf[7] == 76);
+	FAKE_CHECK(wiznet_reader_skip(&rd, 100) == 100 - 77);
+	FAKE_CHECK(wiznet_reader_commit(&rd, 0) == 100 - 69);
+	FAKE_CHECK(chip_rx_rd() == 100);
+	FAKE_CHECK(wiznet_reader_begin(&rd, S) == -EAGAIN);
+}
+
+/* DNS A reply parse, as dnslib_gethostbyname() did before the reader: every field is a wiznet_recv(), every
+ * label a wiznet_flush().
+ */
+static int old_flush_qname(int sockfd)
+{
+	uint8_t c;
+
+	do {
+		if (wiznet_recv(sockfd, &c, 1, 0) < 0)
+			return -EFAULT;
+		if (c >= 64)
+			return wiznet_flush(sockfd, 1, 0);
+		wiznet_flush(sockfd, c, 0);
+	} while (c);
+	return 0;
+}
+
+static int old_dns_parse(int sockfd, uint16_t *ip)
+{
+	uint8_t netbuf[12];
+
+	if (wiznet_recvsize(sockfd) < sizeof(DNSPktHeader)+10)
+		return -EFAULT;
+	if (wiznet_recv(sockfd, netbuf, sizeof(DNSPktHeader), 0) != sizeof(DNSPktHeader))
+		return -EFAULT;
+	if (wiznet_ntohs(netbuf+4) && (old_flush_qname(sockfd) < 0 ||
+	    wiznet_recv(sockfd, netbuf, 2, 0) < 0 || wiznet_recv(sockfd, netbuf, 2, 0) < 0))
+		return -EFAULT;
+	if (old_flush_qname(sockfd) < 0)
+		return -EFAULT;
+	if (wiznet_recv(sockfd, netbuf, 2, 0) < 0 || wiznet_ntohs(netbuf) != DNSLIB_TYPE_A)
+		return -EFAULT;
+	if (wiznet_recv(sockfd, netbuf, 2, 0) < 0 || wiznet_ntohs(netbuf) != DNSLIB_CLASS_IN)
+		return -EFAULT;
+	if (wiznet_recv(sockfd, netbuf, 4, 0) < 0)  // TTL
+		return -EFAULT;
+	if (wiznet_recv(sockfd, netbuf, 2, 0) < 0 || wiznet_ntohs(netbuf) != 4)
+		return -EFAULT;
+	if (wiznet_recv(sockfd, netbuf, 4, 0) < 0)
+		return -EFAULT;
+	ip[0] = wiznet_ntohs(netbuf);
+	ip[1] = wiznet_ntohs(netbuf+2);
+	return 0;
+}
+
+// The same parse as dnslib_gethostbyname() does it now
+static int new_dns_parse(int sockfd, uint16_t *ip)
+{
+	WIZNETReader rd;
+	uint8_t netbuf[12];
+
+	if (wiznet_reader_begin(&rd, sockfd) < (int)(sizeof(DNSPktHeader)+10))
+		return -EFAULT;
+	if (wiznet_reader_read(&rd, netbuf, sizeof(DNSPktHeader)) != sizeof(DNSPktHeader))
+		return -EFAULT;
+	if (wiznet_ntohs(netbuf+4) && (dnslib_flush_qname(&rd) < 0 ||
+	    wiznet_reader_read(&rd, netbuf, 2) < 0 || wiznet_reader_read(&rd, netbuf, 2) < 0))
+		return -EFAULT;
+	if (dnslib_flush_qname(&rd) < 0)
+		return -EFAULT;
+	if (wiznet_reader_read(&rd, netbuf, 2) < 0 || wiznet_ntohs(netbuf) != DNSLIB_TYPE_A)
+		return -EFAULT;
+	if (wiznet_reader_read(&rd, netbuf, 2) < 0 || wiznet_ntohs(netbuf) != DNSLIB_CLASS_IN)
+		return -EFAULT;
+	if (wiznet_reader_read(&rd, netbuf, 4) < 0)  // TTL
+		return -EFAULT;
+	if (wiznet_reader_read(&rd, netbuf, 2) < 0 || wiznet_ntohs(netbuf) != 4)
+		return -EFAULT;
+	if (wiznet_reader_read(&rd, netbuf, 4) < 0)
+		return -EFAULT;
+	ip[0] = wiznet_ntohs(netbuf);
+	ip[1] = wiznet_ntohs(netbuf+2);
+	return 0;
+}
+
+// DHCPOFFER: BOOTP header, magic cookie, a typical set of options, END and padding to the BOOTP minimum
+static void dhcp_offer()
+{
+	static const uint8_t options[] = {
+		DHCP_OPTCODE_DHCP_MSGTYPE, 1, DHCP_MSGTYPE_DHCPOFFER,
+		DHCP_OPTCODE_DHCP_SERVER_IP, 4, 192, 168, 1, 1,
+		DHCP_OPTCODE_IP_ADDRESS_LEASE_TIME, 4, 0x00, 0x01, 0x51, 0x80,
+		DHCP_OPTCODE_SUBNET_MASK, 4, 255, 255, 255, 0,
+		DHCP_OPTCODE_ROUTER, 4, 192, 168, 1, 1,
+		DHCP_OPTCODE_DOMAIN_SERVER, 8, 192, 168, 1, 1, 8, 8, 8, 8,
+		DHCP_OPTCODE_END
+	};
+
+	memset(pkt, 0, sizeof(pkt));
+	pkt[0] = 2;  // BOOTREPLY
+	pkt[1] = 1;
+	pkt[2] = 6;
+	pkt[4] = 0x12; pkt[5] = 0x34; pkt[6] = 0x56; pkt[7] = 0x78;
+	pkt[16] = 192; pkt[17] = 168; pkt[18] = 1; pkt[19] = 100;  // YIADDR
+	pkt[20] = 192; pkt[21] = 168; pkt[22] = 1; pkt[23] = 1;    // SIADDR
+	pkt[28] = 0x02; pkt[33] = 0x01;                            // CHADDR
+	pkt[236] = 0x63; pkt[237] = 0x82; pkt[238] = 0x53; pkt[239] = 0x63;
+	memcpy(pkt + 240, options, sizeof(options));
+	setup(300);
+}
+
+// DHCPOFFER parse as dhcplib did before the reader
+static int old_dhcp_option(int sockfd, uint8_t *option, uint8_t *len, void *buf)
+{
+	uint8_t opthdr[2];
+	int ret;
+
+	if ( (ret = wiznet_recv(sockfd, opthdr, 2, 0)) < 0 )
+		return ret;
+	*option = opthdr[0];
+	*len = opthdr[1];
+	return wiznet_recv(sockfd, (uint8_t *)buf, opthdr[1], 0);
+}
+
+static int old_dhcp_parse(int sockfd, uint16_t *yiaddr, uint16_t *mask)
+{
+	uint8_t scratch[12], optcode, optlen;
+	int i;
+
+	if (wiznet_recv(sockfd, scratch, 12, 0) < 0 || scratch[0] != 2)  // Preamble
+		return -EFAULT;
+	for (i=0; i < 4; i++) {  // CIADDR, YIADDR, SIADDR, GIADDR
+		if (wiznet_recv(sockfd, scratch, 4, 0) < 0)
+			return -EFAULT;
+		if (i == 1) {
+			yiaddr[0] = wiznet_ntohs(scratch);
+			yiaddr[1] = wiznet_ntohs(scratch+2);
+		}
+	}
+	if (wiznet_recv(sockfd, scratch, 6, 0) < 0)  // CHADDR
+		return -EFAULT;
+	if (wiznet_flush(sockfd, 192+10, 0) < 0)
+		return -EFAULT;
+	if (wiznet_recv(sockfd, scratch, 4, 0) < 0 || wiznet_ntohs(scratch) != DHCP_MAGIC_COOKIE_0)
+		return -EFAULT;
+	do {
+		if (old_dhcp_option(sockfd, &optcode, &optlen, scratch) < 0)
+			return -EFAULT;
+		if (optcode == DHCP_OPTCODE_SUBNET_MASK) {
+			mask[0] = wiznet_ntohs(scratch);
+			mask[1] = wiznet_ntohs(scratch+2);
+		}
+	} while (optcode != DHCP_OPTCODE_END);
+	return 0;
+}
+
+// The same parse through dhcplib as dhcp_loop_configure() does it now
+static int new_dhcp_parse(int sockfd, uint16_t *yiaddr, uint16_t *mask)
+{
+	WIZNETReader rd;
+	DHCPHeaderPreamble pamb;
+	uint16_t addr[2], chaddr[3];
+	uint8_t scratch[12], optcode, optlen;
+
+	if (wiznet_reader_begin(&rd, sockfd) < 0)
+		return -EFAULT;
+	if (dhcp_read_header(&rd, &pamb, addr, yiaddr, addr, addr, chaddr) < 0 || pamb.op != 2)
+		return -EFAULT;
+	do {
+		if (dhcp_read_option(&rd, &optcode, &optlen, scratch) < 0)
+			return -EFAULT;
+		if (optcode == DHCP_OPTCODE_SUBNET_MASK) {
+			mask[0] = wiznet_ntohs(scratch);
+			mask[1] = wiznet_ntohs(scratch+2);
+		}
+	} while (optcode != DHCP_OPTCODE_END);
+	return 0;
+}
+
+// SPI frames per packet, before and after; both parses must agree on the result
+static void test_frames()
+{
+	uint16_t ip[2], yiaddr[2], mask[2];
+	uint32_t before, after;
+
+	memcpy(pkt, dns_reply, sizeof(dns_reply));
+	setup(sizeof(dns_reply));
+	ip[0] = ip[1] = 0;
+	FAKE_CHECK(old_dns_parse(S, ip) == 0);
+	FAKE_CHECK(ip[0] == ((93 << 8) | 184) && ip[1] == ((216 << 8) | 34));
+	before = fake_w5200_frames;
+
+	setup(sizeof(dns_reply));
+	ip[0] = ip[1] = 0;
+	FAKE_CHECK(new_dns_parse(S, ip) == 0);
+	FAKE_CHECK(ip[0] == ((93 << 8) | 184) && ip[1] == ((216 << 8) | 34));
+	after = fake_w5200_frames;
+	printf("test_reader: DNS A reply (%u bytes): %lu SPI frames per wiznet_recv() field, %lu through the reader\n",
+		pktlen, (unsigned long)before, (unsigned long)after);
+	FAKE_CHECK(after * 5 <= before);
+
+	dhcp_offer();
+	yiaddr[0] = yiaddr[1] = mask[0] = mask[1] = 0;
+	FAKE_CHECK(old_dhcp_parse(S, yiaddr, mask) == 0);
+	FAKE_CHECK(yiaddr[0] == ((192 << 8) | 168) && yiaddr[1] == ((1 << 8) | 100) && mask[1] == 0xFF00);
+	before = fake_w5200_frames;
+
+	dhcp_offer();
+	yiaddr[0] = yiaddr[1] = mask[0] = mask[1] = 0;
+	FAKE_CHECK(new_dhcp_parse(S, yiaddr, mask) == 0);
+	FAKE_CHECK(yiaddr[0] == ((192 << 8) | 168) && yiaddr[1] == ((1 << 8) | 100) && mask[1] == 0xFF00);
+	after = fake_w5200_frames;
+	printf("test_reader: DHCPOFFER (%u bytes): %lu SPI frames per wiznet_recv() field, %lu through the reader\n",
+		pktlen, (unsigned long)before, (unsigned long)after);
+	FAKE_CHECK(after * 5 <= before);
+}
+
+int test_main()
+{
+	test_refill();
+	test_skip();
+	test_peek_edge();
+	test_commit();
+	test_frames();
+
+	printf("test_reader: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
@@ -0,0 +1,105 @@
+/* test_search.c
+ * wiznet_search_recv_pattern() return values against the fake W5200: the length through a match (consumed
+ * or only peeked), 0 while the match may still arrive, and -ENOBUFS once the caller's buffer is full of
+ * waiting data without it.
+ *
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#define S 3
+
+static const char eoh[] = "\r\n\r\n";
+
+// Socket S connected with 'len' bytes of 'data' waiting at the start of its RX buffer
+static void setup(const char *data, uint16_t len)
+{
+	uint16_t a;
+
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+	w52_sockets[S].mode = W52_SOCK_MR_PROTO_TCP;
+	fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_SR)] = W52_SOCK_SR_SOCK_ESTABLISHED;
+	memcpy(fake_w5200_mem + W52_SOCK_RXBASE(S), data, len);
+	a = W52_SOCK_REG_RESOLVE(S, W52_SOCK_RX_WRITEPTR);
+	fake_w5200_mem[a] = len >> 8;
+	fake_w5200_mem[a+1] = len & 0xFF;
+}
+
+static void test_found()
+{
+	static const char req[] = "GET / HTTP/1.1\r\nHost: x\r\n\r\nrest";
+	char buf[64];
+
+	setup(req, sizeof(req) - 1);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, NULL, sizeof(buf), eoh, 4, W52_SEARCH_PEEK) == 27);
+	FAKE_CHECK(w52_sockets[S].rx_rd == 0);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, buf, sizeof(buf), eoh, 4, 0) == 27);
+	FAKE_CHECK(!memcmp(buf, req, 27) && w52_sockets[S].rx_rd == 27);
+}
+
+// Room left in the buffer: the rest of the headers may still come
+static void test_not_yet()
+{
+	static const char req[] = "GET / HTTP/1.1\r\nHost: x\r\n";
+	char buf[64];
+
+	setup(req, sizeof(req) - 1);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, buf, sizeof(buf), eoh, 4, 0) == 0);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, NULL, W52_SOCK_RXSIZE(S), eoh, 4, W52_SEARCH_PEEK) == 0);
+	FAKE_CHECK(w52_sockets[S].rx_rd == 0);
+}
+
+// As much waiting as the buffer holds, or more, without the match: it can never fit
+static void test_nobufs()
+{
+	static const char req[] = "GET / HTTP/1.1\r\nHost: x\r\n\r\n";
+	char buf[16];
+
+	setup(req, sizeof(req) - 1);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, buf, sizeof(buf), eoh, 4, 0) == -ENOBUFS);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, NULL, 16, eoh, 4, W52_SEARCH_PEEK) == -ENOBUFS);
+	FAKE_CHECK(w52_sockets[S].rx_rd == 0);
+
+	setup(req, 16);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, buf, sizeof(buf), eoh, 4, 0) == -ENOBUFS);
+	FAKE_CHECK(wiznet_search_recv_pattern(S, buf, sizeof(buf) + 1, eoh, 4, 0) == 0);
+}
+
+int test_main()
+{
+	test_found();
+	test_not_yet();
+	test_nobufs();
+
+	printf("test_search: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
@@ -0,0 +1,96 @@
+/* test_sockopt.c
+ * wiznet_setsockopt() range checks, and the chip-wide RTR/RCR pair being switched to the issuing socket's
+ * values before each LISTEN, CONNECT, SEND and DISCON.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#if !W52_SOCKOPT
+#error "test_sockopt needs W52_SOCKOPT"
+#endif
+
+static uint16_t chip_rtr()
+{
+	return (fake_w5200_mem[W52_RTR0] << 8) | fake_w5200_mem[W52_RTR0 + 1];
+}
+
+static void check_range(uint8_t opt, uint16_t good)
+{
+	uint16_t val;
+
+	FAKE_CHECK(wiznet_setsockopt(1, opt, good) == 0);
+	FAKE_CHECK(wiznet_setsockopt(1, opt, 256) == -EINVAL);
+	FAKE_CHECK(wiznet_setsockopt(1, opt, 0xFFFF) == -EINVAL);
+	FAKE_CHECK(wiznet_getsockopt(1, opt, &val) == 0 && val == good);  // Unchanged by the rejected values
+}
+
+int test_main()
+{
+	uint16_t val;
+	int s;
+
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+
+	// 8-bit options
+	check_range(W52_SO_TTL, 255);
+	check_range(W52_SO_TOS, 0xB8);
+	check_range(W52_SO_RCR, 3);
+	FAKE_CHECK(wiznet_setsockopt(1, W52_SO_TTL, 0) == -EINVAL);
+	FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(1, W52_SOCK_TTL)] == 255);
+	FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(1, W52_SOCK_TOS)] == 0xB8);
+
+	// 16-bit options take the full range
+	FAKE_CHECK(wiznet_setsockopt(1, W52_SO_RTR, 60000) == 0);
+	FAKE_CHECK(wiznet_getsockopt(1, W52_SO_RTR, &val) == 0 && val == 60000);
+	FAKE_CHECK(wiznet_setsockopt(1, W52_SO_RTR, 0) == -EINVAL);
+	FAKE_CHECK(wiznet_setsockopt(1, W52_SO_MSS, 1400) == 0);
+	FAKE_CHECK(wiznet_setsockopt(1, 99, 1) == -EINVAL);
+
+	// Each timer-dependent command loads the issuing socket's RTR/RCR
+	for (s=0; s < 3; s++) {
+		w52_sockets[s].opts.rtr = 1000 * (s + 1);
+		w52_sockets[s].opts.rcr = s + 2;
+	}
+	wiznet_w_command(0, W52_SOCK_CMD_LISTEN);
+	FAKE_CHECK(chip_rtr() == 1000 && fake_w5200_mem[W52_RCR] == 2);
+	wiznet_w_command(1, W52_SOCK_CMD_CONNECT);
+	FAKE_CHECK(chip_rtr() == 2000 && fake_w5200_mem[W52_RCR] == 3);
+	wiznet_w_command(2, W52_SOCK_CMD_SEND);
+	FAKE_CHECK(chip_rtr() == 3000 && fake_w5200_mem[W52_RCR] == 4);
+	wiznet_w_command(0, W52_SOCK_CMD_LISTEN);  // Back to the listener's values for its SYN-ACKs
+	FAKE_CHECK(chip_rtr() == 1000 && fake_w5200_mem[W52_RCR] == 2);
+	wiznet_w_command(1, W52_SOCK_CMD_DISCON);
+	FAKE_CHECK(chip_rtr() == 2000 && fake_w5200_mem[W52_RCR] == 3);
+	wiznet_w_command(2, W52_SOCK_CMD_RECV);  // No retransmissions involved: left alone
+	FAKE_CHECK(chip_rtr() == 2000 && fake_w5200_mem[W52_RCR] == 3);
+
+	printf("test_sockopt: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
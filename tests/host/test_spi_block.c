@@ -0,0 +1,219 @@
+/* test_spi_block.c
+ * spi_transfer_block()/spi_fill_block() on the USCI_B0 + DMA driver at the lengths where its behaviour
+ * changes (0, 1, either side of SPI_DMA_THRESHOLD), the burst path at SMCLK/1 and /2, the
+ * interrupt-completed spi_block_start(), and W5200 ring-buffer reads and writes that wrap with pieces of
+ * those same lengths.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#define T SPI_DMA_THRESHOLD
+#define MAXLEN 300
+#define GUARD 0xEE  // Bytes beyond 'len' must keep this
+
+static uint8_t txbuf[MAXLEN+1], rxbuf[MAXLEN+1], mosi_log[MAXLEN+1];
+static uint16_t mosi_len;
+
+// Loopback-ish slave: logs MOSI and answers each byte with its complement
+static uint8_t slave_invert(uint8_t mosi)
+{
+	if (mosi_len < sizeof(mosi_log))
+		mosi_log[mosi_len] = mosi;
+	mosi_len++;
+	return ~mosi;
+}
+
+static void setup(uint16_t len)
+{
+	uint16_t i;
+
+	fake_msp430_reset();
+	fake_spi_slave = slave_invert;
+	mosi_len = 0;
+	for (i=0; i < sizeof(txbuf); i++)
+		txbuf[i] = (uint8_t)(i * 7 + len);
+	memset(rxbuf, GUARD, sizeof(rxbuf));
+}
+
+// Checks common to every raw transfer of 'len' bytes; 'tx' is what should have gone out
+static void check_raw(uint16_t len, const uint8_t *tx, int have_rx, uint16_t dma_len)
+{
+	uint16_t i;
+
+	FAKE_CHECK(mosi_len == len);
+	FAKE_CHECK(fake_spi_bytes == len);
+	FAKE_CHECK(fake_dma_bytes == dma_len);
+	FAKE_CHECK(!(UCB0STAT & UCBUSY));
+	for (i=0; i < len && i < mosi_len; i++)
+		FAKE_CHECK(mosi_log[i] == tx[i]);
+	for (i=0; i < len; i++)
+		FAKE_CHECK(rxbuf[i] == (have_rx ? (uint8_t)~tx[i] : GUARD));
+	FAKE_CHECK(rxbuf[len] == GUARD);
+}
+
+static void test_transfer_block(uint16_t len)
+{
+	static uint8_t ones[MAXLEN+1];
+
+	memset(ones, 0xFF, sizeof(ones));
+
+	setup(len);
+	spi_transfer_block(txbuf, rxbuf, len);
+	check_raw(len, txbuf, 1, len >= T ? len : 0);
+
+	setup(len);
+	spi_transfer_block(txbuf, NULL, len);
+	check_raw(len, txbuf, 0, len >= T ? len : 0);
+	FAKE_CHECK(!(UCB0IFG & UCRXIFG));  // Dummy read left nothing behind for the next spi_transfer()
+
+	setup(len);
+	spi_transfer_block(NULL, rxbuf, len);
+	check_raw(len, ones, 1, len >= T ? len : 0);
+
+	// A single byte still works right after the block
+	setup(len);
+	spi_transfer_block(txbuf, NULL, len);
+	mosi_len = 0;
+	fake_spi_bytes = fake_dma_bytes = 0;
+	FAKE_CHECK(spi_transfer(0x3C) == 0xC3);
+	FAKE_CHECK(mosi_len == 1 && mosi_log[0] == 0x3C);
+}
+
+static void test_fill_block(uint16_t len)
+{
+	static uint8_t fill[MAXLEN+1];
+
+	memset(fill, 0xA5, sizeof(fill));
+	setup(len);
+	spi_fill_block(0xA5, len);
+	check_raw(len, fill, 0, len >= T ? len : 0);
+}
+
+static void test_block_start(uint16_t len)
+{
+	int done = 0, polls = 0;
+
+	setup(len);
+	if (!spi_block_start(txbuf, rxbuf, len)) {
+		done = 1;
+	} else {
+		while (!done && polls++ < 100000)
+			done = spi_block_isr();  // What the DMA ISR does; here it is simply polled
+	}
+	FAKE_CHECK(done);
+	FAKE_CHECK(len || polls == 0);
+	check_raw(len, txbuf, 1, len);  // Always DMA-driven, whatever the length
+}
+
+/* The burst path at the fastest dividers: at SMCLK/1 a received byte must be read out before the next
+ * is loaded, while from SMCLK/2 up TXBUF is loaded behind the shifting byte.
+ */
+static void test_burst_divider()
+{
+	uint16_t div;
+
+	for (div=1; div <= 2; div++) {
+		setup(T-1);
+		spi_set_divider(div);
+		spi_transfer_block(txbuf, rxbuf, T-1);
+		check_raw(T-1, txbuf, 1, 0);
+		FAKE_CHECK(div < 2 ? fake_spi_queued == 0 : fake_spi_queued > 0);
+		FAKE_CHECK(!fake_spi_overruns);
+	}
+}
+
+/* Ring buffer: socket 1 with the default 2KB buffers, write pointer placed 'before_end' bytes short of
+ * the end of the ring so a 'len'-byte write splits into 'before_end' + 'len - before_end'.
+ */
+static void test_ring(uint16_t before_end, uint16_t len)
+{
+	static uint8_t data[MAXLEN+1], back[MAXLEN+1];
+	const int s = 1;
+	uint16_t i, start, off, base, ptr;
+
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+
+	start = 0x3000 + W52_SOCK_MEM_SIZE - before_end;  // Any 16-bit value; only the low bits pick the offset
+	for (i=0; i < len; i++)
+		data[i] = (uint8_t)(i ^ 0x5A ^ before_end);
+
+	// TX
+	base = W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * s;
+	w52_sockets[s].tx_wr = start;
+	wiznet_w_txbuf(s, len, data);
+	for (i=0; i < len; i++) {
+		off = (start + i) & (W52_SOCK_MEM_SIZE - 1);
+		FAKE_CHECK(fake_w5200_mem[base + off] == data[i]);
+	}
+	FAKE_CHECK(fake_w5200_mem[base + ((start + len) & (W52_SOCK_MEM_SIZE - 1))] == 0x00);  // Nothing past the end
+	ptr = (fake_w5200_mem[W52_SOCK_REG_RESOLVE(s, W52_SOCK_TX_WRITEPTR)] << 8) |
+	      fake_w5200_mem[W52_SOCK_REG_RESOLVE(s, W52_SOCK_TX_WRITEPTR) + 1];
+	FAKE_CHECK(ptr == (uint16_t)(start + len));
+	FAKE_CHECK(w52_sockets[s].tx_wr == (uint16_t)(start + len));
+
+	// RX: the same layout read back through the RX ring
+	base = W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * s;
+	for (i=0; i < len; i++) {
+		off = (start + i) & (W52_SOCK_MEM_SIZE - 1);
+		fake_w5200_mem[base + off] = data[i];
+	}
+	memset(back, GUARD, sizeof(back));
+	w52_sockets[s].rx_rd = start;
+	wiznet_r_rxbuf(s, len, back, 0);
+	FAKE_CHECK(!memcmp(back, data, len));
+	FAKE_CHECK(back[len] == GUARD);
+	ptr = (fake_w5200_mem[W52_SOCK_REG_RESOLVE(s, W52_SOCK_RX_READPTR)] << 8) |
+	      fake_w5200_mem[W52_SOCK_REG_RESOLVE(s, W52_SOCK_RX_READPTR) + 1];
+	FAKE_CHECK(ptr == (uint16_t)(start + len));
+}
+
+int test_main()
+{
+	static const uint16_t lens[] = { 0, 1, 2, T-1, T, T+1, 2*T, MAXLEN };
+	static const uint16_t pieces[] = { 1, T-1, T, T+1 };
+	unsigned i, j;
+
+	for (i=0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		test_transfer_block(lens[i]);
+		test_fill_block(lens[i]);
+		test_block_start(lens[i]);
+	}
+
+	test_burst_divider();
+
+	// Wrapped writes/reads: every combination of first and second piece, plus exact fits at the end
+	for (i=0; i < sizeof(pieces)/sizeof(pieces[0]); i++) {
+		for (j=0; j < sizeof(pieces)/sizeof(pieces[0]); j++)
+			test_ring(pieces[i], pieces[i] + pieces[j]);
+		test_ring(pieces[i], pieces[i]);
+	}
+	test_ring(W52_SOCK_MEM_SIZE, T+1);  // Starts at the beginning of the ring, no wrap
+
+	printf("test_spi_block: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
@@ -0,0 +1,158 @@
+/* test_spi_calibrate.c
+ * wiznet_spi_calibrate() against a W5200 whose reads are corrupted at chosen SPI dividers: the search
+ * must stop at the first failing divider, back off toward W52_SPI_SAFE_DIVIDER when the winner fails
+ * re-verification, and never clock a byte below W52_SPI_MIN_DIVIDER.  wiznet_init() must fail when
+ * calibration does.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#if W52_SPI_MIN_DIVIDER < 2 || W52_SPI_SAFE_DIVIDER - W52_SPI_MIN_DIVIDER < 4
+#error "test_spi_calibrate needs the wider divider range from tests/host/w5200_config.h"
+#endif
+
+#define S W52_SPI_SAFE_DIVIDER
+#define M W52_SPI_MIN_DIVIDER
+
+// What reads look like at a given divider
+#define GOOD 0
+#define BAD 1     // Every byte read has a bit flipped
+#define MEMBAD 2  // Only buffer memory reads are corrupted; registers read back fine
+#define FLAKY 3   // Good for the first W52_SPI_CAL_PASSES VERSIONR reads (one verification round), bad after
+
+static uint8_t mode[S+1];
+static uint16_t version_reads[S+1];
+
+static uint8_t corrupt(uint16_t addr, uint8_t val)
+{
+	uint16_t div = fake_spi_divider();
+
+	if (div > S)
+		return val;
+	switch (mode[div]) {
+		case BAD:
+			return val ^ 0x01;
+		case MEMBAD:
+			return addr >= W52_TXMEM_BASE ? val ^ 0x80 : val;
+		case FLAKY:
+			if (addr == W52_VERSIONR)
+				version_reads[div]++;
+			return version_reads[div] > W52_SPI_CAL_PASSES ? val ^ 0x01 : val;
+	}
+	return val;
+}
+
+// VERSIONR reads back once, then the chip is gone
+static uint8_t vanish(uint16_t addr, uint8_t val)
+{
+	if (addr == W52_VERSIONR && version_reads[0]++)
+		return 0x00;
+	return val;
+}
+
+// Modes for the next calibration: 'm' at dividers [lo,hi], GOOD elsewhere
+static void set_modes(uint16_t lo, uint16_t hi, uint8_t m)
+{
+	uint16_t div;
+
+	memset(mode, GOOD, sizeof(mode));
+	for (div = lo; div <= hi && div <= S; div++)
+		mode[div] = m;
+}
+
+/* Calibrate against the current mode[] table; 'expect' is the result and 'fastest_tried' the lowest
+ * divider the search should have reached before stopping.
+ */
+static void check(int expect, uint16_t fastest_tried)
+{
+	int ret;
+
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	fake_w5200_read_hook = corrupt;
+	memset(version_reads, 0, sizeof(version_reads));
+	wiznet_io_init();
+	fake_spi_min_divider = 0xFFFF;
+
+	ret = wiznet_spi_calibrate();
+	if (ret != expect)
+		printf("calibrated to %d, expected %d\n", ret, expect);
+	FAKE_CHECK(ret == expect);
+	FAKE_CHECK(fake_spi_min_divider == fastest_tried);
+	FAKE_CHECK(fake_spi_min_divider >= M);
+	FAKE_CHECK(w52_spi_divider == ret);
+	FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(W52_MAX_SOCKETS-1, W52_SOCK_MSS)] == 0x00);
+	FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(W52_MAX_SOCKETS-1, W52_SOCK_MSS) + 1] == 0x00);
+
+	// The next frame goes out at the chosen divider
+	wiznet_r_reg(W52_VERSIONR);
+	FAKE_CHECK(fake_spi_divider() == ret);
+}
+
+int test_main()
+{
+	set_modes(0, 0, GOOD);      // Clean bus: all the way down to the floor, never past it
+	check(M, M);
+	set_modes(0, M+3, BAD);     // Fails at M+3: keep M+4, never try anything faster
+	check(M+4, M+3);
+	set_modes(M+3, M+3, BAD);   // Only M+3 is bad: the search still stops there
+	check(M+4, M+3);
+	set_modes(0, M+2, MEMBAD);  // Caught by the buffer memory read-back alone
+	check(M+3, M+2);
+	set_modes(0, S-1, BAD);     // Nothing below safe works
+	check(S, S-1);
+	set_modes(0, S-1, FLAKY);   // Everything passes once, nothing twice: back off all the way to safe
+	check(S, M);
+
+	set_modes(0, M+1, BAD);     // M+2 wins the search, fails re-verification, M+3 holds
+	mode[M+2] = FLAKY;
+	check(M+3, M+1);
+	set_modes(M+1, M+3, FLAKY); // M fails; back off through all three flaky dividers
+	mode[M] = BAD;
+	check(M+4, M);
+
+	// No chip answering at all
+	fake_msp430_reset();
+	fake_w5200_reset();
+	fake_w5200_read_hook = NULL;
+	fake_w5200_mem[W52_VERSIONR] = 0x00;
+	wiznet_io_init();
+	FAKE_CHECK(wiznet_spi_calibrate() == -EFAULT);
+
+	// Chip answers the version check in wiznet_init() but not calibration: init fails at the safe divider
+	fake_msp430_reset();
+	fake_w5200_reset();
+	fake_w5200_read_hook = vanish;
+	fake_w5200_mem[W52_VERSIONR] = 0x03;
+	memset(version_reads, 0, sizeof(version_reads));
+	FAKE_CHECK(wiznet_init() == -EFAULT);
+	FAKE_CHECK(w52_spi_divider == S);
+	FAKE_CHECK(fake_w5200_mem[W52_MR] == 0x00);  // Stopped before the soft reset
+
+	printf("test_spi_calibrate: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
@@ -0,0 +1,74 @@
+/* test_spi_inline.c
+ * With SPI_DRIVER_INLINE (set in w5200_config.h), the W5200 I/O layer must expand spi_transfer() from
+ * msp430_spi_inline.h instead of calling msp430_spi.c.  The Makefile links this test with
+ * --wrap=spi_transfer, so any call that still reaches the out-of-line function is counted.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "fake_hw.h"
+
+#ifndef SPI_DRIVER_INLINE
+#error "test_spi_inline needs SPI_DRIVER_INLINE"
+#endif
+
+static uint32_t calls;
+
+uint8_t __real_spi_transfer(uint8_t);
+
+uint8_t __wrap_spi_transfer(uint8_t inb)
+{
+	calls++;
+	return __real_spi_transfer(inb);
+}
+
+int test_main()
+{
+	uint8_t buf[4];
+
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+
+	// The wrapper works: a direct call from here is counted
+	calls = 0;
+	spi_transfer(0xFF);
+	FAKE_CHECK(calls == 1);
+
+	// Header, single registers, 16-bit registers and short buffers all go through the inline transfer
+	calls = 0;
+	FAKE_CHECK(wiznet_r_reg(W52_VERSIONR) == 0x03);
+	wiznet_w_reg(W52_SOCK_REG_RESOLVE(1, W52_SOCK_TTL), 0x40);
+	FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(1, W52_SOCK_TTL)] == 0x40);
+	wiznet_w_sockreg16(1, W52_SOCK_MSS, 0x1234);
+	FAKE_CHECK(wiznet_r_sockreg16(1, W52_SOCK_MSS) == 0x1234);
+	memcpy(buf, "\x01\x02\x03\x04", 4);
+	wiznet_w_buf(W52_TXMEM_BASE, 4, buf);
+	memset(buf, 0, sizeof(buf));
+	wiznet_r_buf(W52_TXMEM_BASE, 4, buf);
+	FAKE_CHECK(!memcmp(buf, "\x01\x02\x03\x04", 4));
+	FAKE_CHECK(fake_w5200_frames > 0);
+	FAKE_CHECK(calls == 0);
+
+	printf("test_spi_inline: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
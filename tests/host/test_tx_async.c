@@ -0,0 +1,172 @@
+/* test_tx_async.c
+ * wiznet_txcommit_async()/wiznet_tx_poll() SEND chaining against the fake W5200's SEND model: a chained
+ * SEND covers committed data only, data written without a commit waits for the next commit, datagrams are
+ * never merged, and a disconnect with nothing in flight is only reported.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "msp430_spi.h"
+#include "w5200_config.h"
+#include "w5200_regs.h"
+#include "w5200_io.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "fake_hw.h"
+
+#define S 2
+
+static uint8_t data[256];
+
+static uint16_t chip_tx_wr()
+{
+	uint16_t a = W52_SOCK_REG_RESOLVE(S, W52_SOCK_TX_WRITEPTR);
+
+	return (fake_w5200_mem[a] << 8) | fake_w5200_mem[a+1];
+}
+
+static int count_cmds(uint8_t cmd)
+{
+	int i, n = 0;
+
+	for (i=0; i < fake_w5200_ncmds && i < FAKE_LOG_SIZE; i++) {
+		if (fake_w5200_cmds[i].sock == S && fake_w5200_cmds[i].cmd == cmd)
+			n++;
+	}
+	return n;
+}
+
+// Socket S connected (or bound, for UDP) with empty rings, its SENDs held until completed by hand
+static void setup(uint8_t proto)
+{
+	fake_msp430_reset();
+	fake_spi_slave = NULL;
+	fake_w5200_reset();
+	wiznet_io_init();
+	memset(w52_sockets, 0, sizeof(w52_sockets));
+	FAKE_CHECK(wiznet_set_bufsizes(NULL, NULL) == 0);
+	w52_sockets[S].mode = proto;
+	fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_SR)] =
+		(proto == W52_SOCK_MR_PROTO_TCP ? W52_SOCK_SR_SOCK_ESTABLISHED : W52_SOCK_SR_SOCK_UDP);
+	fake_w5200_send_hold = 1 << S;
+}
+
+// Uncommitted writes during a flight stay off the wire until committed
+static void test_uncommitted_tail()
+{
+	setup(W52_SOCK_MR_PROTO_TCP);
+	FAKE_CHECK(wiznet_send_partial(S, data, 100, 1) == 100);
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].len == 100);
+
+	FAKE_CHECK(wiznet_send(S, data, 50, 0) == 0);
+	FAKE_CHECK(chip_tx_wr() == 100);  // Held back from a chained SEND
+
+	fake_w5200_send_complete(S);
+	FAKE_CHECK(wiznet_tx_poll(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 1);  // Nothing committed, nothing chained
+	FAKE_CHECK(chip_tx_wr() == 150);     // Published once the chain is idle
+
+	FAKE_CHECK(wiznet_txcommit_async(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 2 && fake_w5200_sends[1].start == 100 && fake_w5200_sends[1].len == 50);
+	fake_w5200_send_complete(S);
+	FAKE_CHECK(wiznet_tx_poll(S) == 0);
+	FAKE_CHECK(fake_w5200_send_overlaps == 0);
+}
+
+// A chained SEND stops at the last commit, not at whatever was written after it
+static void test_chain_stops_at_commit()
+{
+	setup(W52_SOCK_MR_PROTO_TCP);
+	FAKE_CHECK(wiznet_send_partial(S, data, 100, 1) == 100);
+	FAKE_CHECK(wiznet_send_partial(S, data, 60, 1) == 60);  // Committed during the flight
+	FAKE_CHECK(wiznet_send(S, data, 40, 0) == 0);           // Not committed
+	FAKE_CHECK(wiznet_tx_poll(S) == 160);  // No SEND_OK yet: 100 in flight + 60 queued
+
+	fake_w5200_send_complete(S);
+	FAKE_CHECK(wiznet_tx_poll(S) == 60);
+	FAKE_CHECK(fake_w5200_nsends == 2 && fake_w5200_sends[1].start == 100 && fake_w5200_sends[1].len == 60);
+	fake_w5200_send_complete(S);
+	FAKE_CHECK(wiznet_tx_poll(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 2);
+	FAKE_CHECK(chip_tx_wr() == 200);
+
+	// A blocking commit picks up the tail
+	fake_w5200_send_hold = 0;
+	FAKE_CHECK(wiznet_txcommit(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 3 && fake_w5200_sends[2].start == 160 && fake_w5200_sends[2].len == 40);
+	FAKE_CHECK(fake_w5200_send_overlaps == 0);
+}
+
+// wiznet_txcommit() during a flight waits for it, then sends the uncommitted tail too
+static void test_blocking_commit_in_flight()
+{
+	setup(W52_SOCK_MR_PROTO_TCP);
+	FAKE_CHECK(wiznet_send_partial(S, data, 100, 1) == 100);
+	FAKE_CHECK(wiznet_send(S, data, 50, 0) == 0);
+	fake_w5200_send_complete(S);
+	fake_w5200_send_hold = 0;
+	FAKE_CHECK(wiznet_txcommit(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 2 && fake_w5200_sends[1].start == 100 && fake_w5200_sends[1].len == 50);
+	FAKE_CHECK(!(w52_sockets[S].tx_state & W52_TX_INFLIGHT));
+	FAKE_CHECK(fake_w5200_send_overlaps == 0);
+}
+
+// One SEND per datagram: a second async commit during a flight is refused, not merged
+static void test_udp_no_merge()
+{
+	setup(W52_SOCK_MR_PROTO_UDP);
+	wiznet_w_txbuf(S, 30, data);
+	FAKE_CHECK(wiznet_txcommit_async(S) == 0);
+	wiznet_w_txbuf(S, 20, data);
+	FAKE_CHECK(wiznet_txcommit_async(S) == -EBUSY);
+	fake_w5200_send_complete(S);
+	FAKE_CHECK(wiznet_tx_poll(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 1 && fake_w5200_sends[0].len == 30);
+	FAKE_CHECK(wiznet_txcommit_async(S) == 0);
+	FAKE_CHECK(fake_w5200_nsends == 2 && fake_w5200_sends[1].len == 20);
+}
+
+// DISCON/TIMEOUT: torn down only when a SEND was in flight
+static void test_disconnect()
+{
+	setup(W52_SOCK_MR_PROTO_TCP);
+	fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_IR)] = W52_SOCK_IR_DISCON;
+	FAKE_CHECK(wiznet_tx_poll(S) == -ECONNABORTED);
+	FAKE_CHECK(count_cmds(W52_SOCK_CMD_DISCON) == 0);
+	FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_IR)] == W52_SOCK_IR_DISCON);  // Left for recv()
+	FAKE_CHECK(fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_SR)] == W52_SOCK_SR_SOCK_ESTABLISHED);
+
+	setup(W52_SOCK_MR_PROTO_TCP);
+	FAKE_CHECK(wiznet_send_partial(S, data, 100, 1) == 100);
+	fake_w5200_mem[W52_SOCK_REG_RESOLVE(S, W52_SOCK_IR)] = W52_SOCK_IR_TIMEOUT;
+	FAKE_CHECK(wiznet_tx_poll(S) == -ETIMEDOUT);
+	FAKE_CHECK(count_cmds(W52_SOCK_CMD_DISCON) == 1);
+	FAKE_CHECK(!w52_sockets[S].tx_state);
+}
+
+int test_main()
+{
+	test_uncommitted_tail();
+	test_chain_stops_at_commit();
+	test_blocking_commit_in_flight();
+	test_udp_no_merge();
+	test_disconnect();
+
+	printf("test_tx_async: %s (%d failed checks)\n", fake_failures ? "FAIL" : "ok", fake_failures);
+	return fake_failures != 0;
+}
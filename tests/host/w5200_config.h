@@ -0,0 +1,36 @@
+/* w5200_config.h
+ * Host test configuration: the library's own w5200_config.h with the knobs the tests exercise changed.
+ * The Makefile compiles the library from symlinks in build/, so its #include "w5200_config.h" finds
+ * this file rather than the one beside the sources.
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef HOST_W5200_CONFIG_H
+#define HOST_W5200_CONFIG_H
+
+#include "../../w5200_config.h"
+
+// Wide enough a calibration range that W52_SPI_MIN_DIVIDER is a real floor (test_spi_calibrate)
+#undef W52_SPI_SAFE_DIVIDER
+#define W52_SPI_SAFE_DIVIDER 8
+#undef W52_SPI_MIN_DIVIDER
+#define W52_SPI_MIN_DIVIDER 2
+
+// Traffic-adaptive buffer allocation (test_bufpolicy)
+#undef W52_BUF_POLICY
+#define W52_BUF_POLICY 1
+
+
+#endif
@@ -22,56 +22,187 @@
 #include "w5200_config.h"
 #include "w5200_io.h"
 #include "w5200_buf.h"
-
+#include "w5200_sock.h"
+#include "w5200_bufpolicy.h"
+
+/* Auto-cork's delay (see wiznet_cork_poll()) runs from the first byte written after a commit */
+#if W52_SOCKOPT
+#define W52_CORK_HOLD(sock) do { \
+	if (!w52_sockets[sock].cork_held) { \
+		w52_sockets[sock].cork_age = 0; \
+		w52_sockets[sock].cork_held = 1; \
+	} \
+} while (0)
+#else
+#define W52_CORK_HOLD(sock)
+#endif
+
+/* Sn_TX_WR bounds what the next SEND transmits, so while an asynchronous SEND is in flight it is left at the
+ * committed end (WIZNETSocketState.tx_commit) and the SEND chain or the next commit moves it up.
+ */
+static void wiznet_txbuf_advance(int sockfd, uint16_t tx_wr)
+{
+	W52_CORK_HOLD(sockfd);
+	w52_sockets[sockfd].tx_wr = tx_wr;
+	if (!(w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT))
+		wiznet_w_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR, tx_wr);
+}
 
 void wiznet_w_txbuf(int sockfd, uint16_t sz, void *buf)
 {
 	uint16_t tx_wr, real_ptr, i, j;
 	uint8_t *bufptr = (uint8_t *)buf;
 
-	if (sz > W52_SOCK_MEM_SIZE)
+	if (sz > W52_SOCK_TXSIZE(sockfd))
 		return;
 
 	tx_wr = w52_sockets[sockfd].tx_wr;
-	i = tx_wr & W52_SOCK_MEM_MASK;
-	j = W52_SOCK_MEM_SIZE - i;
+	i = tx_wr & W52_SOCK_TXMASK(sockfd);
+	j = W52_SOCK_TXSIZE(sockfd) - i;
 	if (j < sz) {  // Writing would overflow the buffer
-		real_ptr = W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+		real_ptr = W52_SOCK_TXBASE(sockfd) + i;
 		wiznet_w_buf(real_ptr, j, bufptr);
 		tx_wr += j;
 		sz -= j;
 		bufptr += j;
 		i = 0;
 	}
-	real_ptr = W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+	real_ptr = W52_SOCK_TXBASE(sockfd) + i;
 	wiznet_w_buf(real_ptr, sz, bufptr);
 	tx_wr += sz;
-	w52_sockets[sockfd].tx_wr = tx_wr;
-	wiznet_w_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR, tx_wr);
+	W52_BUFPOL_TX(sockfd, tx_wr - w52_sockets[sockfd].tx_wr);
+	wiznet_txbuf_advance(sockfd, tx_wr);
 }
 
 void wiznet_fill_txbuf(int sockfd, uint16_t sz, uint8_t val)
 {
 	uint16_t tx_wr, real_ptr, i, j;
 
-	if (sz > W52_SOCK_MEM_SIZE)
+	if (sz > W52_SOCK_TXSIZE(sockfd))
 		return;
 
 	tx_wr = w52_sockets[sockfd].tx_wr;
-	i = tx_wr & W52_SOCK_MEM_MASK;
-	j = W52_SOCK_MEM_SIZE - i;
+	i = tx_wr & W52_SOCK_TXMASK(sockfd);
+	j = W52_SOCK_TXSIZE(sockfd) - i;
 	if (j < sz) {  // Writing would overflow the buffer
-		real_ptr = W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+		real_ptr = W52_SOCK_TXBASE(sockfd) + i;
 		wiznet_w_set(real_ptr, j, val);
 		tx_wr += j;
 		sz -= j;
 		i = 0;
 	}
-	real_ptr = W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+	real_ptr = W52_SOCK_TXBASE(sockfd) + i;
 	wiznet_w_set(real_ptr, sz, val);
 	tx_wr += sz;
-	w52_sockets[sockfd].tx_wr = tx_wr;
-	wiznet_w_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR, tx_wr);
+	W52_BUFPOL_TX(sockfd, tx_wr - w52_sockets[sockfd].tx_wr);
+	wiznet_txbuf_advance(sockfd, tx_wr);
+}
+
+uint16_t wiznet_iov_len(const WIZNETIOVec *iov, uint8_t iovcnt)
+{
+	uint16_t sz = 0;
+
+	while (iovcnt--)
+		sz += (iov++)->len;
+	return sz;
+}
+
+/* Scatter-gather TX write
+ * All segments are streamed under one frame header (two if the ring wraps part-way through) and
+ * Sn_TX_WR is written once at the end.  A segment with base=NULL is written as zeroes.
+ */
+uint16_t wiznet_w_txbufv(int sockfd, const WIZNETIOVec *iov, uint8_t iovcnt)
+{
+	uint16_t sz, tx_wr, i, frame_left, seglen, chunk;
+	const uint8_t *segptr;
+
+	sz = wiznet_iov_len(iov, iovcnt);
+	if (!sz || sz > W52_SOCK_TXSIZE(sockfd))
+		return 0;
+
+	tx_wr = w52_sockets[sockfd].tx_wr;
+	i = tx_wr & W52_SOCK_TXMASK(sockfd);
+	frame_left = W52_SOCK_TXSIZE(sockfd) - i;
+	if (frame_left > sz)
+		frame_left = sz;
+	wiznet_frame_begin(W52_SOCK_TXBASE(sockfd) + i, frame_left, W52_SPI_OPCODE_WRITE);
+	for (; iovcnt; iovcnt--, iov++) {
+		segptr = (const uint8_t *)iov->base;
+		seglen = iov->len;
+		while (seglen) {
+			if (!frame_left) {  // Ring wrap-around; continue at the start of the socket's TX memory
+				wiznet_frame_end();
+				frame_left = sz - (W52_SOCK_TXSIZE(sockfd) - i);
+				wiznet_frame_begin(W52_SOCK_TXBASE(sockfd), frame_left, W52_SPI_OPCODE_WRITE);
+			}
+			chunk = (seglen < frame_left ? seglen : frame_left);
+			wiznet_frame_w(segptr, chunk);
+			if (segptr != NULL)
+				segptr += chunk;
+			seglen -= chunk;
+			frame_left -= chunk;
+		}
+	}
+	wiznet_frame_end();
+
+	tx_wr += sz;
+	W52_BUFPOL_TX(sockfd, sz);
+	wiznet_txbuf_advance(sockfd, tx_wr);
+	return sz;
+}
+
+/* Generated TX write
+ * producer() fills W52_SEND_GENERATE_CHUNK-byte pieces that are streamed under one frame header (two if the
+ * ring wraps), for up to 'sz' bytes.  If it runs dry early the open frame is padded with zeroes past the new
+ * Sn_TX_WR, which is written once for the bytes actually produced.  The first piece is asked for before the
+ * frame is opened, so a producer with nothing to give costs no bus traffic.  Later calls happen with the
+ * chip selected: the producer must not do W5200 or other SPI I/O.
+ */
+uint16_t wiznet_generate_txbuf(int sockfd, uint16_t sz, WIZNETProducer producer, void *ctx)
+{
+	uint8_t chunk[W52_SEND_GENERATE_CHUNK];
+	const uint8_t *ptr;
+	uint16_t tx_wr, i, frame_left, n, piece, total = 0;
+
+	if (!sz || sz > W52_SOCK_TXSIZE(sockfd))
+		return 0;
+
+	n = producer(ctx, chunk, (sz < W52_SEND_GENERATE_CHUNK ? sz : W52_SEND_GENERATE_CHUNK));
+	if (!n)
+		return 0;
+
+	tx_wr = w52_sockets[sockfd].tx_wr;
+	i = tx_wr & W52_SOCK_TXMASK(sockfd);
+	frame_left = W52_SOCK_TXSIZE(sockfd) - i;
+	if (frame_left > sz)
+		frame_left = sz;
+	wiznet_frame_begin(W52_SOCK_TXBASE(sockfd) + i, frame_left, W52_SPI_OPCODE_WRITE);
+	while (n) {
+		total += n;
+		ptr = chunk;
+		while (n) {
+			if (!frame_left) {  // Ring wrap-around; continue at the start of the socket's TX memory
+				wiznet_frame_end();
+				frame_left = sz - (W52_SOCK_TXSIZE(sockfd) - i);
+				wiznet_frame_begin(W52_SOCK_TXBASE(sockfd), frame_left, W52_SPI_OPCODE_WRITE);
+			}
+			piece = (n < frame_left ? n : frame_left);
+			wiznet_frame_w(ptr, piece);
+			ptr += piece;
+			n -= piece;
+			frame_left -= piece;
+		}
+		if (total < sz)
+			n = producer(ctx, chunk, (sz - total < W52_SEND_GENERATE_CHUNK ? sz - total : W52_SEND_GENERATE_CHUNK));
+	}
+	if (frame_left)
+		wiznet_frame_w(NULL, frame_left);
+	wiznet_frame_end();
+
+	tx_wr += total;
+	W52_BUFPOL_TX(sockfd, total);
+	wiznet_txbuf_advance(sockfd, tx_wr);
+	return total;
 }
 
 void wiznet_r_rxbuf(int sockfd, uint16_t sz, void *buf, uint8_t do_recv_cmd)
@@ -79,23 +210,24 @@ void wiznet_r_rxbuf(int sockfd, uint16_t sz, void *buf, uint8_t do_recv_cmd)
 	uint16_t rx_rd, real_ptr, i, j;
 	uint8_t *bufptr = (uint8_t *)buf;
 
-	if (sz > W52_SOCK_MEM_SIZE)
+	if (sz > W52_SOCK_RXSIZE(sockfd))
 		return;
 
 	rx_rd = w52_sockets[sockfd].rx_rd;
-	i = rx_rd & W52_SOCK_MEM_MASK;
-	j = W52_SOCK_MEM_SIZE - i;
+	i = rx_rd & W52_SOCK_RXMASK(sockfd);
+	j = W52_SOCK_RXSIZE(sockfd) - i;
 	if (j < sz) {  // Reading requires wrap-around
-		real_ptr = W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+		real_ptr = W52_SOCK_RXBASE(sockfd) + i;
 		wiznet_r_buf(real_ptr, j, bufptr);
 		rx_rd += j;
 		sz -= j;
 		bufptr += j;
 		i = 0;
 	}
-	real_ptr = W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+	real_ptr = W52_SOCK_RXBASE(sockfd) + i;
 	wiznet_r_buf(real_ptr, sz, bufptr);
 	rx_rd += sz;
+	W52_BUFPOL_RX(sockfd, rx_rd - w52_sockets[sockfd].rx_rd);
 	wiznet_w_sockreg16(sockfd, W52_SOCK_RX_READPTR, rx_rd);
 
 	if (do_recv_cmd) {
@@ -107,38 +239,108 @@ void wiznet_r_rxbuf(int sockfd, uint16_t sz, void *buf, uint8_t do_recv_cmd)
 	}
 }
 
+#if W52_ASYNC_IO
+/* Asynchronous ring-buffer I/O
+ * The caller owns 'req' (and 'buf') until wiznet_io_done(req); req->callback and req->userdata are left
+ * as the caller set them.  Socket pointers are advanced at submission time, since anything issued
+ * afterwards is queued behind this request.
+ */
+static void wiznet_ring_ioreq(WIZNETIOReq *req, uint16_t membase, uint16_t memsize, uint16_t ptr, uint16_t sz)
+{
+	uint16_t i, j;
+
+	i = ptr & (memsize - 1);
+	j = memsize - i;
+	req->addr = membase + i;
+	if (j < sz) {  // Transfer requires wrap-around
+		req->len = j;
+		req->wrap_addr = membase;
+		req->wrap_len = sz - j;
+	} else {
+		req->len = sz;
+		req->wrap_len = 0;
+	}
+}
+
+int wiznet_w_txbuf_async(int sockfd, uint16_t sz, void *buf, WIZNETIOReq *req)
+{
+	if (!sz || sz > W52_SOCK_TXSIZE(sockfd))
+		return -EFAULT;
+
+	wiznet_ring_ioreq(req, W52_SOCK_TXBASE(sockfd), W52_SOCK_TXSIZE(sockfd), w52_sockets[sockfd].tx_wr, sz);
+	req->opcode = W52_SPI_OPCODE_WRITE;
+	req->buf = (uint8_t *)buf;
+	req->sockfd = sockfd;
+	req->flags = 0;
+	W52_CORK_HOLD(sockfd);
+	w52_sockets[sockfd].tx_wr += sz;
+	W52_BUFPOL_TX(sockfd, sz);
+	req->ptr_reg = (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT ? 0 : W52_SOCK_REG_RESOLVE(sockfd, W52_SOCK_TX_WRITEPTR));
+	req->ptr_val = w52_sockets[sockfd].tx_wr;
+	wiznet_io_submit(req);
+	return sz;
+}
+
+int wiznet_r_rxbuf_async(int sockfd, uint16_t sz, void *buf, uint8_t do_recv_cmd, WIZNETIOReq *req)
+{
+	if (!sz || sz > W52_SOCK_RXSIZE(sockfd))
+		return -EFAULT;
+
+	wiznet_ring_ioreq(req, W52_SOCK_RXBASE(sockfd), W52_SOCK_RXSIZE(sockfd), w52_sockets[sockfd].rx_rd, sz);
+	req->opcode = W52_SPI_OPCODE_READ;
+	req->buf = (uint8_t *)buf;
+	req->sockfd = sockfd;
+	req->flags = (do_recv_cmd ? W52_IOREQ_FLAG_RECV : 0);
+	w52_sockets[sockfd].rx_rd += sz;
+	W52_BUFPOL_RX(sockfd, sz);
+	req->ptr_reg = W52_SOCK_REG_RESOLVE(sockfd, W52_SOCK_RX_READPTR);
+	req->ptr_val = w52_sockets[sockfd].rx_rd;
+	wiznet_io_submit(req);
+	return sz;
+}
+#endif
+
 void wiznet_peek_rxbuf(int sockfd, uint16_t offset, uint16_t sz, void *buf)
 {
 	uint16_t rx_rd, real_ptr, i, j;
 	uint8_t *bufptr = (uint8_t *)buf;
 
-	if ((offset+sz) > W52_SOCK_MEM_SIZE)
+	if ((offset+sz) > W52_SOCK_RXSIZE(sockfd))
 		return;
 
 	rx_rd = w52_sockets[sockfd].rx_rd + offset;  // Adjusted readptr
-	i = rx_rd & W52_SOCK_MEM_MASK;
-	j = W52_SOCK_MEM_SIZE - i;
+	i = rx_rd & W52_SOCK_RXMASK(sockfd);
+	j = W52_SOCK_RXSIZE(sockfd) - i;
 	if (j < sz) {  // Reading requires wrap-around
-		real_ptr = W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+		real_ptr = W52_SOCK_RXBASE(sockfd) + i;
 		wiznet_r_buf(real_ptr, j, bufptr);
 		rx_rd += j;
 		sz -= j;
 		bufptr += j;
 		i = 0;
 	}
-	real_ptr = W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+	real_ptr = W52_SOCK_RXBASE(sockfd) + i;
 	wiznet_r_buf(real_ptr, sz, bufptr);
 }
 
 void wiznet_flush_rxbuf(int sockfd, uint16_t fsz, uint8_t do_recv_cmd)
 {
-	uint16_t rx_rd, rsz;
+	uint16_t rsz;
 
 	rsz = wiznet_recvsize(sockfd);
 	if (fsz > rsz || fsz < 1)
 		return;
 
-	rx_rd = w52_sockets[sockfd].rx_rd + fsz;  // Advance read pointer to ignore its contents
+	wiznet_commit_rxbuf(sockfd, fsz, do_recv_cmd);
+}
+
+// Release 'sz' bytes from the RX buffer without reading them; the caller has checked they are there
+void wiznet_commit_rxbuf(int sockfd, uint16_t sz, uint8_t do_recv_cmd)
+{
+	uint16_t rx_rd;
+
+	rx_rd = w52_sockets[sockfd].rx_rd + sz;  // Advance read pointer to ignore its contents
+	W52_BUFPOL_RX(sockfd, sz);
 
 	wiznet_w_sockreg16(sockfd, W52_SOCK_RX_READPTR, rx_rd);
 
@@ -156,14 +358,14 @@ uint16_t wiznet_search_r_rxbuf(int sockfd, uint16_t sz, void *buf, uint8_t searc
 	uint16_t rx_rd, real_ptr, i, j, retlen, total=0;
 	uint8_t *bufptr = (uint8_t *)buf;
 
-	if (sz > W52_SOCK_MEM_SIZE)
+	if (sz > W52_SOCK_RXSIZE(sockfd))
 		return 0;
 
 	rx_rd = w52_sockets[sockfd].rx_rd;
-	i = rx_rd & W52_SOCK_MEM_MASK;
-	retlen = j = W52_SOCK_MEM_SIZE - i;
+	i = rx_rd & W52_SOCK_RXMASK(sockfd);
+	retlen = j = W52_SOCK_RXSIZE(sockfd) - i;
 	if (j < sz) {  // Reading requires wrap-around
-		real_ptr = W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+		real_ptr = W52_SOCK_RXBASE(sockfd) + i;
 		retlen = wiznet_search_r_buf(real_ptr, j, bufptr, searchchar);
 		rx_rd += retlen;
 		sz -= retlen;
@@ -172,11 +374,12 @@ uint16_t wiznet_search_r_rxbuf(int sockfd, uint16_t sz, void *buf, uint8_t searc
 		i = 0;
 	}
 	if (retlen == j) {  // searchchar wasn't found during initial pre-wraparound read
-		real_ptr = W52_RXMEM_BASE + W52_SOCK_MEM_SIZE * sockfd + i;
+		real_ptr = W52_SOCK_RXBASE(sockfd) + i;
 		retlen = wiznet_search_r_buf(real_ptr, sz, bufptr, searchchar);
 		rx_rd += retlen;
 		total += retlen;
 	}
+	W52_BUFPOL_RX(sockfd, total);
 	wiznet_w_sockreg16(sockfd, W52_SOCK_RX_READPTR, rx_rd);
 
 	if (do_recv_cmd) {
@@ -190,14 +393,103 @@ uint16_t wiznet_search_r_rxbuf(int sockfd, uint16_t sz, void *buf, uint8_t searc
     return total;
 }
 
+/* Pattern search of the RX buffer
+ * The first 'sz' bytes past RX_RD are read W52_SEARCH_CHUNK bytes per frame (via wiznet_peek_rxbuf(), which
+ * handles the ring wrap), stopping after the frame that completes the match.  The needle is matched with KMP,
+ * so a partial match simply carries over into the next frame; with W52_SEARCH_CLASS any one byte of the
+ * needle matches.  Searched bytes land in buf if it isn't NULL.  The RX pointers are left alone.
+ * Returns the offset just past the match, or 0 if there is none.
+ */
+uint16_t wiznet_search_rxbuf_pattern(int sockfd, uint16_t sz, void *buf, const uint8_t *needle, uint8_t nlen, uint8_t flags)
+{
+	uint8_t chunk[W52_SEARCH_CHUNK], fail[W52_SEARCH_MAX_NEEDLE], *p;
+	uint8_t i, q;
+	uint16_t off, k, n;
+
+	if (!nlen || nlen > W52_SEARCH_MAX_NEEDLE || sz > W52_SOCK_RXSIZE(sockfd))
+		return 0;
+
+	// fail[i] = length of the longest proper prefix of needle[0..i] that is also a suffix of it
+	fail[0] = q = 0;
+	if (!(flags & W52_SEARCH_CLASS)) {
+		for (i=1; i < nlen; i++) {
+			while (q && needle[i] != needle[q])
+				q = fail[q-1];
+			if (needle[i] == needle[q])
+				q++;
+			fail[i] = q;
+		}
+		q = 0;
+	}
+
+	for (off=0; off < sz; off += n) {
+		n = sz - off;
+		if (n > W52_SEARCH_CHUNK)
+			n = W52_SEARCH_CHUNK;
+		p = (buf != NULL ? (uint8_t *)buf + off : chunk);
+		wiznet_peek_rxbuf(sockfd, off, n, p);
+
+		for (k=0; k < n; k++) {
+			if (flags & W52_SEARCH_CLASS) {
+				if (memchr(needle, p[k], nlen) != NULL)
+					return off + k + 1;
+				continue;
+			}
+			while (q && p[k] != needle[q])
+				q = fail[q-1];
+			if (p[k] == needle[q])
+				q++;
+			if (q == nlen)
+				return off + k + 1;
+		}
+	}
+	return 0;
+}
+
+// Streamed RX read; RX_RD (and RECV, if requested) only account for what the visitor consumed
+uint16_t wiznet_visit_rxbuf(int sockfd, uint16_t sz, WIZNETVisitor visitor, void *ctx, uint8_t do_recv_cmd)
+{
+	uint16_t rx_rd, i, j, total;
+
+	if (!sz || sz > W52_SOCK_RXSIZE(sockfd))
+		return 0;
+
+	rx_rd = w52_sockets[sockfd].rx_rd;
+	i = rx_rd & W52_SOCK_RXMASK(sockfd);
+	j = W52_SOCK_RXSIZE(sockfd) - i;
+	if (j < sz) {  // Reading requires wrap-around
+		total = wiznet_visit_r_buf(W52_SOCK_RXBASE(sockfd) + i, j, visitor, ctx);
+		if (total == j)
+			total += wiznet_visit_r_buf(W52_SOCK_RXBASE(sockfd), sz - j, visitor, ctx);
+	} else {
+		total = wiznet_visit_r_buf(W52_SOCK_RXBASE(sockfd) + i, sz, visitor, ctx);
+	}
+	if (!total)
+		return 0;
+
+	rx_rd += total;
+	W52_BUFPOL_RX(sockfd, total);
+	wiznet_w_sockreg16(sockfd, W52_SOCK_RX_READPTR, rx_rd);
+
+	if (do_recv_cmd) {
+		wiznet_w_sockreg(sockfd, W52_SOCK_IR, W52_SOCK_IR_RECV);  // Clear RECV IRQ
+		wiznet_w_sockreg(sockfd, W52_SOCK_CR, W52_SOCK_CMD_RECV); // Let more data in!
+		w52_sockets[sockfd].rx_rd = wiznet_r_sockreg16(sockfd, W52_SOCK_RX_READPTR);
+	} else {
+		w52_sockets[sockfd].rx_rd = rx_rd;
+	}
+	return total;
+}
+
 uint16_t wiznet_recvsize(int sockfd)
 {
 	uint16_t rx_wr, rx_rd;
 
-	rx_wr = wiznet_r_sockreg16(sockfd, W52_SOCK_RX_WRITEPTR) & W52_SOCK_MEM_MASK;
-	rx_rd = w52_sockets[sockfd].rx_rd & W52_SOCK_MEM_MASK;
+	rx_wr = wiznet_r_sockreg16(sockfd, W52_SOCK_RX_WRITEPTR) & W52_SOCK_RXMASK(sockfd);
+	rx_rd = w52_sockets[sockfd].rx_rd & W52_SOCK_RXMASK(sockfd);
 	if (rx_rd > rx_wr)
-		rx_wr += W52_SOCK_MEM_SIZE;
+		rx_wr += W52_SOCK_RXSIZE(sockfd);
+	W52_BUFPOL_RXLEVEL(sockfd, rx_wr - rx_rd);
 	return (rx_wr - rx_rd);
 }
 
@@ -205,10 +497,11 @@ uint16_t wiznet_read_virtual_fsr(int sockfd)
 {
 	uint16_t tx_rd, tx_wr;
 
-	tx_rd = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_READPTR) & W52_SOCK_MEM_MASK;
-	tx_wr = w52_sockets[sockfd].tx_wr & W52_SOCK_MEM_MASK;
+	tx_rd = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_READPTR) & W52_SOCK_TXMASK(sockfd);
+	tx_wr = w52_sockets[sockfd].tx_wr & W52_SOCK_TXMASK(sockfd);
 	if (tx_wr >= tx_rd)
-		tx_rd += W52_SOCK_MEM_SIZE;
+		tx_rd += W52_SOCK_TXSIZE(sockfd);
+	W52_BUFPOL_TXLEVEL(sockfd, W52_SOCK_TXSIZE(sockfd) - (tx_rd - tx_wr));
 	return tx_rd - tx_wr;
 }
 
@@ -19,16 +19,37 @@
 #define W5200_BUF_H
 
 /* High-level Buffer I/O */
+typedef struct {
+	const void *base;  // NULL = fill with zeroes
+	uint16_t len;
+} WIZNETIOVec;
+
+/* wiznet_search_rxbuf_pattern() / wiznet_search_recv_pattern() flags */
+#define W52_SEARCH_CLASS 0x01  // Needle is a set of bytes; any one of them matches
+#define W52_SEARCH_PEEK 0x02   // Report the match offset only; nothing is consumed
+#define W52_SEARCH_RECV 0x04   // Issue RECV after consuming through the match
+#define W52_SEARCH_MAX_NEEDLE 16
+
 void wiznet_w_txbuf(int, uint16_t, void *);
 void wiznet_fill_txbuf(int, uint16_t, uint8_t);
+uint16_t wiznet_iov_len(const WIZNETIOVec *, uint8_t);
+uint16_t wiznet_w_txbufv(int, const WIZNETIOVec *, uint8_t);  // Scatter-gather write, single TX_WR update
+uint16_t wiznet_generate_txbuf(int, uint16_t, WIZNETProducer, void *);  // Producer-filled write, single TX_WR update
 
 uint16_t wiznet_recvsize(int);
 void wiznet_r_rxbuf(int, uint16_t, void *, uint8_t);
 void wiznet_peek_rxbuf(int, uint16_t, uint16_t, void *);
 void wiznet_flush_rxbuf(int, uint16_t, uint8_t);
+void wiznet_commit_rxbuf(int, uint16_t, uint8_t);
 uint16_t wiznet_search_r_rxbuf(int, uint16_t, void *, uint8_t, uint8_t);
+uint16_t wiznet_search_rxbuf_pattern(int, uint16_t, void *, const uint8_t *, uint8_t, uint8_t);  // Chunked KMP; no pointer movement
+uint16_t wiznet_visit_rxbuf(int, uint16_t, WIZNETVisitor, void *, uint8_t);
 uint16_t wiznet_read_virtual_fsr(int);
-#define wiznet_read_virtual_tsz(sock) (W52_SOCK_MEM_SIZE - wiznet_read_virtual_fsr(sock))
+#define wiznet_read_virtual_tsz(sock) (W52_SOCK_TXSIZE(sock) - wiznet_read_virtual_fsr(sock))
+#if W52_ASYNC_IO
+int wiznet_w_txbuf_async(int, uint16_t, void *, WIZNETIOReq *);
+int wiznet_r_rxbuf_async(int, uint16_t, void *, uint8_t, WIZNETIOReq *);
+#endif
 
 /* IP address binary/string conversion and I/O */
 int wiznet_ip2binary(const void *, uint16_t *);
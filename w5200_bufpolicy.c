@@ -0,0 +1,267 @@
+/* w5200_bufpolicy.c
+ * WizNet W5200 Ethernet Controller Driver for MSP430
+ * Traffic-adaptive socket buffer allocation
+ *
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "w5200_config.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "w5200_bufpolicy.h"
+#include "w5200_debug.h"
+
+#if W52_BUF_POLICY
+
+/* Buffer memory is laid out back to back in socket order, so it can only be redistributed while every
+ * socket is closed; wiznet_close() tries each time a socket goes down.  A socket's number, and so its
+ * memory, is chosen by wiznet_socket() before its port is known, so each socket number is sized by the
+ * type it served last; a type that moves to another socket number takes its history along with it.
+ */
+WIZNETBufStats w52_bufstats[W52_MAX_SOCKETS];
+WIZNETBufType w52_buftypes[W52_BUFPOL_TYPES];
+uint16_t w52_bufpol_port[W52_MAX_SOCKETS];
+uint8_t w52_bufpol_type[W52_MAX_SOCKETS];
+uint8_t w52_bufpol_prio[W52_MAX_SOCKETS];
+
+static uint8_t w52_bufpol_epoch;
+
+static WIZNETBufPolicy w52_bufpol = wiznet_bufpol_proportional;
+
+#define W52_BUFPOL_TOTAL_KB 16  // Per side (RX, TX)
+#define W52_BUFPOL_MAX_KB 16
+
+/* Give every socket 1KB, then keep doubling the socket with the most weight per KB until the memory is
+ * used up; equal weights go to the smaller buffer, so no traffic at all spreads memory evenly.
+ */
+static void _wiznet_bufpol_fill(const uint32_t *weight, uint8_t *kb)
+{
+	uint8_t i, best, total = W52_MAX_SOCKETS;
+	uint32_t score, best_score = 0;
+
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		kb[i] = 1;
+
+	do {
+		best = W52_MAX_SOCKETS;
+		for (i=0; i < W52_MAX_SOCKETS; i++) {
+			if (kb[i] >= W52_BUFPOL_MAX_KB || total + kb[i] > W52_BUFPOL_TOTAL_KB)
+				continue;
+			score = weight[i] / kb[i];
+			if (best == W52_MAX_SOCKETS || score > best_score || (score == best_score && kb[i] < kb[best])) {
+				best = i;
+				best_score = score;
+			}
+		}
+		if (best < W52_MAX_SOCKETS) {
+			total += kb[best];
+			kb[best] <<= 1;
+		}
+	} while (best < W52_MAX_SOCKETS);
+}
+
+// Bytes moved, doubled if the ring was seen full (the socket was window-limited)
+static uint32_t _wiznet_bufpol_demand(uint32_t bytes, uint16_t peak, uint16_t size)
+{
+	if (size && peak >= size && bytes < 0x80000000UL)
+		bytes <<= 1;
+	return bytes;
+}
+
+void wiznet_bufpol_static(const WIZNETBufStats *stats, uint8_t *rxkb, uint8_t *txkb)
+{
+	int i;
+
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		rxkb[i] = txkb[i] = W52_SOCK_MEM_SIZE / 1024;
+}
+
+void wiznet_bufpol_proportional(const WIZNETBufStats *stats, uint8_t *rxkb, uint8_t *txkb)
+{
+	int i;
+	uint32_t weight[W52_MAX_SOCKETS];
+
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		weight[i] = _wiznet_bufpol_demand(stats[i].rx_bytes, stats[i].rx_peak, W52_SOCK_RXSIZE(i));
+	_wiznet_bufpol_fill(weight, rxkb);
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		weight[i] = _wiznet_bufpol_demand(stats[i].tx_bytes, stats[i].tx_peak, W52_SOCK_TXSIZE(i));
+	_wiznet_bufpol_fill(weight, txkb);
+}
+
+void wiznet_bufpol_priority(const WIZNETBufStats *stats, uint8_t *rxkb, uint8_t *txkb)
+{
+	int i;
+	uint32_t weight[W52_MAX_SOCKETS];
+
+	// Priority in the top byte, demand (in 256-byte units, saturated) below it
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		weight[i] = _wiznet_bufpol_demand(stats[i].rx_bytes, stats[i].rx_peak, W52_SOCK_RXSIZE(i)) >> 8;
+		if (weight[i] > 0x00FFFFFFUL)
+			weight[i] = 0x00FFFFFFUL;
+		weight[i] |= (uint32_t)w52_bufpol_prio[i] << 24;
+	}
+	_wiznet_bufpol_fill(weight, rxkb);
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		weight[i] = _wiznet_bufpol_demand(stats[i].tx_bytes, stats[i].tx_peak, W52_SOCK_TXSIZE(i)) >> 8;
+		if (weight[i] > 0x00FFFFFFUL)
+			weight[i] = 0x00FFFFFFUL;
+		weight[i] |= (uint32_t)w52_bufpol_prio[i] << 24;
+	}
+	_wiznet_bufpol_fill(weight, txkb);
+}
+
+void wiznet_bufpol_set(WIZNETBufPolicy policy)
+{
+	w52_bufpol = (policy != NULL ? policy : wiznet_bufpol_static);
+}
+
+void wiznet_bufpol_open(int sockfd)
+{
+	memset(&w52_bufstats[sockfd], 0, sizeof(WIZNETBufStats));
+	w52_bufpol_port[sockfd] = 0;
+}
+
+// Drop every socket's link to type entry t
+static void _wiznet_bufpol_unlink(uint8_t t)
+{
+	int i;
+
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		if (w52_bufpol_type[i] == t + 1)
+			w52_bufpol_type[i] = W52_BUFPOL_NOTYPE;
+	}
+}
+
+// Find the entry for (mode, port), taking a free one or the one with the least traffic if it is new
+static uint8_t _wiznet_bufpol_type(uint8_t mode, uint16_t port)
+{
+	uint8_t i, t = W52_BUFPOL_TYPES;
+	uint32_t bytes, least = 0;
+
+	for (i=0; i < W52_BUFPOL_TYPES; i++) {
+		if (w52_buftypes[i].mode == mode && w52_buftypes[i].port == port)
+			return i;
+	}
+	for (i=0; i < W52_BUFPOL_TYPES; i++) {
+		bytes = w52_buftypes[i].stats.rx_bytes + w52_buftypes[i].stats.tx_bytes;
+		if (!w52_buftypes[i].mode) {
+			t = i;
+			break;
+		}
+		if (t == W52_BUFPOL_TYPES || bytes < least) {
+			t = i;
+			least = bytes;
+		}
+	}
+	_wiznet_bufpol_unlink(t);
+	memset(&w52_buftypes[t], 0, sizeof(WIZNETBufType));
+	w52_buftypes[t].mode = mode;
+	w52_buftypes[t].port = port;
+	w52_buftypes[t].epoch = w52_bufpol_epoch;
+	return t;
+}
+
+static uint32_t _wiznet_bufpol_add(uint32_t a, uint32_t b)
+{
+	return (a + b < a) ? 0xFFFFFFFFUL : a + b;
+}
+
+void wiznet_bufpol_account(int sockfd)
+{
+	uint8_t t;
+	WIZNETBufStats *st = &w52_bufstats[sockfd];
+	WIZNETBufType *ty;
+
+	if (!w52_sockets[sockfd].mode)
+		return;
+	t = _wiznet_bufpol_type(w52_sockets[sockfd].mode, w52_bufpol_port[sockfd]);
+	ty = &w52_buftypes[t];
+
+	/* The first socket of this type to close since the last rebalance decides where the type lives now;
+	 * more closing in the same period (a listen pool) join it.
+	 */
+	if (ty->epoch != w52_bufpol_epoch) {
+		_wiznet_bufpol_unlink(t);
+		ty->epoch = w52_bufpol_epoch;
+	}
+	w52_bufpol_type[sockfd] = t + 1;
+
+	ty->stats.rx_bytes = _wiznet_bufpol_add(ty->stats.rx_bytes, st->rx_bytes);
+	ty->stats.tx_bytes = _wiznet_bufpol_add(ty->stats.tx_bytes, st->tx_bytes);
+	if (st->rx_peak > ty->stats.rx_peak)
+		ty->stats.rx_peak = st->rx_peak;
+	if (st->tx_peak > ty->stats.tx_peak)
+		ty->stats.tx_peak = st->tx_peak;
+	memset(st, 0, sizeof(WIZNETBufStats));
+}
+
+int wiznet_bufpol_rebalance()
+{
+	int i, j, ret = 0;
+	uint8_t rxkb[W52_MAX_SOCKETS], txkb[W52_MAX_SOCKETS], changed = 0, t, n;
+	WIZNETBufStats stats[W52_MAX_SOCKETS];
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_bufpol_rebalance()";
+	#endif
+
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		if (w52_sockets[i].mode)
+			return -EBUSY;
+	}
+
+	// Each socket number gets the statistics of the type it served last, shared among its sockets
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		t = w52_bufpol_type[i];
+		if (t == W52_BUFPOL_NOTYPE) {
+			memset(&stats[i], 0, sizeof(WIZNETBufStats));
+			continue;
+		}
+		for (j=0, n=0; j < W52_MAX_SOCKETS; j++) {
+			if (w52_bufpol_type[j] == t)
+				n++;
+		}
+		stats[i] = w52_buftypes[t-1].stats;
+		stats[i].rx_bytes /= n;
+		stats[i].tx_bytes /= n;
+	}
+
+	w52_bufpol(stats, rxkb, txkb);
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		if (rxkb[i] * 1024 != W52_SOCK_RXSIZE(i) || txkb[i] * 1024 != W52_SOCK_TXSIZE(i))
+			changed = 1;
+	}
+	if (changed) {
+		ret = wiznet_set_bufsizes(rxkb, txkb);
+		wiznet_debug4_printf("%s: buffer memory reassigned (%d)\n", funcname, ret);
+	}
+
+	// Age the statistics so the allocation follows changes in the traffic mix
+	for (i=0; i < W52_BUFPOL_TYPES; i++) {
+		w52_buftypes[i].stats.rx_bytes >>= 1;
+		w52_buftypes[i].stats.tx_bytes >>= 1;
+		w52_buftypes[i].stats.rx_peak = 0;
+		w52_buftypes[i].stats.tx_peak = 0;
+	}
+	w52_bufpol_epoch++;
+	return ret;
+}
+
+#endif
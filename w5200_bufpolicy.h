@@ -0,0 +1,88 @@
+/* w5200_bufpolicy.h
+ * WizNet W5200 Ethernet Controller Driver for MSP430
+ * Traffic-adaptive socket buffer allocation
+ *
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef W5200_BUFPOLICY_H
+#define W5200_BUFPOLICY_H
+
+#include <msp430.h>
+#include <stdint.h>
+#include "w5200_config.h"
+
+#if W52_BUF_POLICY
+
+/* Traffic statistics, kept per open socket by the ring-buffer layer */
+typedef struct {
+	uint32_t rx_bytes;  // Bytes consumed from the RX ring
+	uint32_t tx_bytes;  // Bytes written to the TX ring
+	uint16_t rx_peak;   // Highest RX ring occupancy seen
+	uint16_t tx_peak;   // Highest TX ring occupancy seen
+} WIZNETBufStats;
+
+/* Statistics are remembered per socket type, the protocol plus the bound port (0 if never bound), so a
+ * service keeps its history whichever socket number it opens on next and the sockets of a listen pool
+ * are judged together.  wiznet_close() folds the socket's statistics into its type.
+ */
+typedef struct {
+	uint8_t mode;          // Protocol (W52_SOCK_MR_PROTO_*); 0 = free entry
+	uint8_t epoch;         // Rebalance period this type last closed a socket in
+	uint16_t port;
+	WIZNETBufStats stats;  // Halved at each rebalance
+} WIZNETBufType;
+
+#define W52_BUFPOL_TYPES W52_MAX_SOCKETS
+#define W52_BUFPOL_NOTYPE 0
+
+/* A policy fills in rxkb[]/txkb[] (W52_MAX_SOCKETS entries, in KB) for wiznet_set_bufsizes() */
+typedef void (*WIZNETBufPolicy)(const WIZNETBufStats *, uint8_t *, uint8_t *);
+
+extern WIZNETBufStats w52_bufstats[W52_MAX_SOCKETS];  // Since each socket was opened
+extern WIZNETBufType w52_buftypes[W52_BUFPOL_TYPES];
+extern uint16_t w52_bufpol_port[W52_MAX_SOCKETS];     // Bound port of each open socket
+extern uint8_t w52_bufpol_type[W52_MAX_SOCKETS];      // w52_buftypes[] entry + 1 each socket last served
+extern uint8_t w52_bufpol_prio[W52_MAX_SOCKETS];  // Used by wiznet_bufpol_priority(); higher wins
+
+#define W52_BUFPOL_RX(sock, n) (w52_bufstats[sock].rx_bytes += (n))
+#define W52_BUFPOL_TX(sock, n) (w52_bufstats[sock].tx_bytes += (n))
+#define W52_BUFPOL_RXLEVEL(sock, lvl) do { if ((lvl) > w52_bufstats[sock].rx_peak) w52_bufstats[sock].rx_peak = (lvl); } while (0)
+#define W52_BUFPOL_TXLEVEL(sock, lvl) do { if ((lvl) > w52_bufstats[sock].tx_peak) w52_bufstats[sock].tx_peak = (lvl); } while (0)
+#define W52_BUFPOL_BIND(sock, port) (w52_bufpol_port[sock] = (port))
+
+/* Functions */
+void wiznet_bufpol_set(WIZNETBufPolicy);
+void wiznet_bufpol_open(int);     // Start a socket's statistics afresh
+void wiznet_bufpol_account(int);  // Fold a closing socket's statistics into its type
+int wiznet_bufpol_rebalance();  // Apply the policy; -EBUSY unless every socket is closed
+
+/* Provided policies */
+void wiznet_bufpol_static(const WIZNETBufStats *, uint8_t *, uint8_t *);        // W52_SOCK_MEM_SIZE for everyone
+void wiznet_bufpol_proportional(const WIZNETBufStats *, uint8_t *, uint8_t *);  // By bytes moved (default)
+void wiznet_bufpol_priority(const WIZNETBufStats *, uint8_t *, uint8_t *);      // By w52_bufpol_prio[], then bytes
+
+#else
+
+#define W52_BUFPOL_RX(sock, n)
+#define W52_BUFPOL_TX(sock, n)
+#define W52_BUFPOL_RXLEVEL(sock, lvl)
+#define W52_BUFPOL_TXLEVEL(sock, lvl)
+#define W52_BUFPOL_BIND(sock, port)
+
+#endif
+
+
+#endif
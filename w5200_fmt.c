@@ -0,0 +1,132 @@
+/* w5200_fmt.c
+ * WizNet W5200 Ethernet Controller Driver for MSP430
+ * printf-lite formatter shared by wiznet_debug_printf() and wiznet_writer_printf()
+ *
+ *
+ * Parts derived from Kevin Timmerman's tiny printf from 43oh.com
+ * Link: http://forum.43oh.com/topic/1289-tiny-printf-c-version/
+ *
+ * Copyright (c) 2014, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdarg.h>
+#include "w5200_fmt.h"
+
+static const unsigned long dv[] = {
+//  4294967296      // 32 bit unsigned max
+    1000000000,     // +0
+     100000000,     // +1
+      10000000,     // +2
+       1000000,     // +3
+        100000,     // +4
+//       65535      // 16 bit unsigned max
+         10000,     // +5
+          1000,     // +6
+           100,     // +7
+            10,     // +8
+             1,     // +9
+};
+
+// Decimal conversion by repeated subtraction; the MSP430 has no divide instruction
+static int xtoa(WIZNETPutc out, void *ctx, unsigned long x, const unsigned long *dp)
+{
+	uint8_t c;
+	unsigned long d;
+	int ret;
+
+	if (!x)
+		return out(ctx, '0');
+	while (x < *dp)
+		dp++;
+	do {
+		d = *dp++;
+		c = '0';
+		while (x >= d)
+			c++, x -= d;
+		if ( (ret = out(ctx, c)) < 0 )
+			return ret;
+	} while (!(d & 1));
+	return 0;
+}
+
+static int puth(WIZNETPutc out, void *ctx, unsigned int n, uint8_t digits)
+{
+	static const char hex[16] = { '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' };
+	int ret;
+
+	while (digits--) {
+		if ( (ret = out(ctx, hex[(n >> (digits * 4)) & 15])) < 0 )
+			return ret;
+	}
+	return 0;
+}
+
+int wiznet_vformat(WIZNETPutc out, void *ctx, const char *format, va_list a)
+{
+	char c;
+	const char *s;
+	int i, ret = 0;
+	long n;
+
+	while ( ret >= 0 && (c = *format++) ) {
+		if (c != '%') {
+			ret = out(ctx, c);
+			continue;
+		}
+		switch (c = *format++) {
+			case 's':  // String
+				s = va_arg(a, const char *);
+				while (ret >= 0 && *s)
+					ret = out(ctx, *s++);
+				break;
+			case 'c':  // Char (promoted to int in the argument list)
+				ret = out(ctx, va_arg(a, int));
+				break;
+			case 'i':  // 16 bit Integer
+			case 'd':  // 16 bit Integer
+			case 'u':  // 16 bit Unsigned
+				i = va_arg(a, int);
+				if ( (c == 'i' || c == 'd') && i < 0 ) {
+					i = -i;
+					if ( (ret = out(ctx, '-')) < 0 )
+						break;
+				}
+				ret = xtoa(out, ctx, (unsigned)i, dv + 5);
+				break;
+			case 'l':  // 32 bit Long
+			case 'n':  // 32 bit uNsigned loNg
+				n = va_arg(a, long);
+				if (c == 'l' && n < 0) {
+					n = -n;
+					if ( (ret = out(ctx, '-')) < 0 )
+						break;
+				}
+				ret = xtoa(out, ctx, (unsigned long)n, dv);
+				break;
+			case 'x':  // 16 bit heXadecimal
+				ret = puth(out, ctx, va_arg(a, int), 4);
+				break;
+			case 'h':  // 8 bit Hexadecimal
+				ret = puth(out, ctx, va_arg(a, int) & 0xFF, 2);
+				break;
+			case 0:  // Trailing '%'
+				format--;
+				break;
+			default:
+				ret = out(ctx, c);
+		}
+	}
+	return (ret < 0 ? ret : 0);
+}
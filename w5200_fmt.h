@@ -0,0 +1,38 @@
+/* w5200_fmt.h
+ * WizNet W5200 Ethernet Controller Driver for MSP430
+ * printf-lite formatter shared by wiznet_debug_printf() and wiznet_writer_printf()
+ *
+ *
+ * Parts derived from Kevin Timmerman's tiny printf from 43oh.com
+ * Link: http://forum.43oh.com/topic/1289-tiny-printf-c-version/
+ *
+ * Copyright (c) 2014, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef W5200_FMT_H
+#define W5200_FMT_H
+
+#include <stdint.h>
+#include <stdarg.h>
+
+/* Output sink; a negative return aborts formatting and is handed back to the caller */
+typedef int (*WIZNETPutc)(void *, uint8_t);
+
+/* Conversions: %s %c, %d %i %u (16-bit), %l %n (32-bit signed/unsigned), %x (16-bit hex), %h (8-bit hex)
+ * Returns 0, or the first negative value returned by the sink.
+ */
+int wiznet_vformat(WIZNETPutc, void *, const char *, va_list);
+
+
+#endif
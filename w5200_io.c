@@ -19,10 +19,31 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
-#include "msp430_spi.h"
 #include "w5200_config.h"
+#include "msp430_spi.h"
+#ifdef SPI_DRIVER_INLINE
+#include "msp430_spi_inline.h"
+#endif
+#include "w5200_io.h"
 #include "w5200_debug.h"
 
+/* Synchronous I/O takes the bus away from the asynchronous queue for the duration of each frame */
+#if W52_ASYNC_IO
+#define W52_IO_ACQUIRE wiznet_io_acquire()
+#define W52_IO_RELEASE wiznet_io_release()
+#else
+#define W52_IO_ACQUIRE
+#define W52_IO_RELEASE
+#endif
+
+// 4-byte frame header (address, opcode | length); straight-line code when SPI_DRIVER_INLINE is set
+static inline void wiznet_io_header(uint16_t addr, uint16_t opcode, uint16_t len)
+{
+	spi_transfer(addr >> 8);
+	spi_transfer(addr & 0xFF);
+	spi_transfer( (opcode >> 8) | (len >> 8) );
+	spi_transfer(len & 0xFF);
+}
 
 /* Register I/O primitives */
 
@@ -40,24 +61,243 @@ void wiznet_io_init()
 	W52_RESET_PORTDIR |= W52_RESET_PORTBIT;
 
 	spi_init();
+	#if W52_SPI_AUTOCAL
+	spi_set_divider(W52_SPI_SAFE_DIVIDER);
+	#endif
 	_EINT();
 }
 
-void wiznet_w_reg(uint16_t addr, uint8_t val)
+/* Register shadow
+ * GAR/SUBR/SHAR/SIPR, IMR and each socket's MR, PORT, DIPR and DPORT only ever change when the driver
+ * writes them, so reads are served from RAM and writes of an unchanged value are dropped.
+ * Sn_DIPR/Sn_DPORT are overwritten by the chip when a LISTENing socket accepts a connection, so reads
+ * never populate them and the LISTEN command invalidates them.  A MR soft reset invalidates everything.
+ */
+#if W52_REG_SHADOW
+#define W52_SHADOW_COMMON_LEN 19  // GAR..SIPR (0x0001-0x0012) + IMR
+#define W52_SHADOW_SOCK_LEN 9     // Sn_MR, Sn_PORT(2), Sn_DIPR(4), Sn_DPORT(2)
+#define W52_SHADOW_SIZE (W52_SHADOW_COMMON_LEN + W52_SHADOW_SOCK_LEN * W52_MAX_SOCKETS)
+#define W52_SHADOW_NOFILL 0x4000  // OR'd into the index for write-populated-only registers
+
+static uint8_t w52_shadow[W52_SHADOW_SIZE];
+static uint8_t w52_shadow_valid[(W52_SHADOW_SIZE+7)/8];
+
+// Shadow index for 'addr' (possibly OR'd with W52_SHADOW_NOFILL), or -1 if it isn't shadowed
+static int wiznet_shadow_index(uint16_t addr)
+{
+	uint16_t reg;
+	int base;
+
+	if (addr >= W52_GAR0 && addr <= W52_SIPR3)
+		return addr - W52_GAR0;
+	if (addr == W52_IMR)
+		return W52_SHADOW_COMMON_LEN - 1;
+	if (addr < W52_SOCK_BASE || addr >= W52_SOCK_BASE + W52_SOCK_OFFSET * W52_MAX_SOCKETS)
+		return -1;
+
+	base = W52_SHADOW_COMMON_LEN + W52_SHADOW_SOCK_LEN * ((addr - W52_SOCK_BASE) / W52_SOCK_OFFSET);
+	reg = (addr - W52_SOCK_BASE) % W52_SOCK_OFFSET;
+	switch (reg) {
+		case W52_SOCK_MR:
+			return base;
+		case W52_SOCK_PORT0:
+		case W52_SOCK_PORT1:
+			return base + 1 + (reg - W52_SOCK_PORT0);
+		case W52_SOCK_DIPR0:
+		case W52_SOCK_DIPR1:
+		case W52_SOCK_DIPR2:
+		case W52_SOCK_DIPR3:
+			return (base + 3 + (reg - W52_SOCK_DIPR0)) | W52_SHADOW_NOFILL;
+		case W52_SOCK_DPORT0:
+		case W52_SOCK_DPORT1:
+			return (base + 7 + (reg - W52_SOCK_DPORT0)) | W52_SHADOW_NOFILL;
+	}
+	return -1;
+}
+
+// Returns 1 and stores the shadowed value in *val if there is a valid one
+static uint8_t wiznet_shadow_get(uint16_t addr, uint8_t *val)
+{
+	int i = wiznet_shadow_index(addr);
+
+	if (i < 0)
+		return 0;
+	i &= ~W52_SHADOW_NOFILL;
+	if ( !(w52_shadow_valid[i >> 3] & (1 << (i & 0x07))) )
+		return 0;
+	*val = w52_shadow[i];
+	return 1;
+}
+
+static void wiznet_shadow_put(uint16_t addr, uint8_t val, uint8_t is_write)
+{
+	int i = wiznet_shadow_index(addr);
+
+	if (i < 0 || (!is_write && (i & W52_SHADOW_NOFILL)))
+		return;
+	i &= ~W52_SHADOW_NOFILL;
+	w52_shadow[i] = val;
+	w52_shadow_valid[i >> 3] |= 1 << (i & 0x07);
+}
+
+static void wiznet_shadow_drop(uint16_t addr, uint16_t len)
+{
+	int i;
+
+	if (addr >= W52_TXMEM_BASE)  // Buffer memory is never shadowed
+		return;
+	for (; len; len--, addr++) {
+		if ( (i = wiznet_shadow_index(addr)) >= 0 ) {
+			i &= ~W52_SHADOW_NOFILL;
+			w52_shadow_valid[i >> 3] &= ~(1 << (i & 0x07));
+		}
+	}
+}
+
+// Record a register write, including the side effects of MR soft reset and Sn_CR LISTEN
+static void wiznet_shadow_written(uint16_t addr, uint8_t val)
+{
+	if (addr == W52_MR && (val & 0x80)) {
+		wiznet_shadow_invalidate();
+		return;
+	}
+	if (addr >= W52_SOCK_BASE && addr < W52_SOCK_BASE + W52_SOCK_OFFSET * W52_MAX_SOCKETS &&
+	    (addr - W52_SOCK_BASE) % W52_SOCK_OFFSET == W52_SOCK_CR) {
+		if (val == W52_SOCK_CMD_LISTEN)
+			wiznet_shadow_drop(addr - W52_SOCK_CR + W52_SOCK_DESTIP, 6);  // Sn_DIPR + Sn_DPORT
+		return;
+	}
+	wiznet_shadow_put(addr, val, 1);
+}
+
+void wiznet_shadow_invalidate()
+{
+	memset(w52_shadow_valid, 0, sizeof(w52_shadow_valid));
+}
+#endif
+
+/* Write combining
+ * Between wiznet_wc_begin() and wiznet_wc_end(), writes to side-effect-free configuration registers
+ * (GAR..SIPR, Sn_PORT..Sn_TTL) are held in RAM and merged with later writes to the following addresses,
+ * then sent as one frame.  Any other write (including Sn_CR commands), any frame and any read overlapping
+ * the pending range flushes them first, so the chip sees the same register contents in the same order.
+ */
+#if W52_WRITE_COMBINE
+#define W52_WC_MAX (W52_SOCK_TTL - W52_SOCK_SRCPORT + 1)  // Longest combinable run (Sn_PORT..Sn_TTL)
+
+static uint8_t w52_wc_depth;
+static uint16_t w52_wc_addr;
+static uint8_t w52_wc_len;
+static uint8_t w52_wc_data[W52_WC_MAX];
+
+static uint8_t wiznet_wc_combinable(uint16_t addr, uint16_t len)
+{
+	uint16_t off;
+
+	if (addr >= W52_GATEWAY && addr + len <= W52_SOURCEIP + 4)
+		return 1;
+	if (addr < W52_SOCK_BASE || addr >= W52_SOCK_BASE + W52_SOCK_OFFSET * W52_MAX_SOCKETS)
+		return 0;
+	off = (addr - W52_SOCK_BASE) % W52_SOCK_OFFSET;
+	return (off >= W52_SOCK_SRCPORT && off + len <= W52_SOCK_TTL + 1);
+}
+
+// Hold a register write back; returns 0 if it can't be combined and must go out now (pending data flushed)
+static uint8_t wiznet_wc_add(uint16_t addr, const void *buf, uint16_t len)
+{
+	if (!w52_wc_depth || !wiznet_wc_combinable(addr, len)) {
+		wiznet_wc_flush();
+		return 0;
+	}
+	if (w52_wc_len && addr >= w52_wc_addr && addr <= w52_wc_addr + w52_wc_len &&
+	    addr + len <= w52_wc_addr + W52_WC_MAX) {
+		memcpy(w52_wc_data + (addr - w52_wc_addr), buf, len);
+		if (addr + len > w52_wc_addr + w52_wc_len)
+			w52_wc_len = addr + len - w52_wc_addr;
+		return 1;
+	}
+	wiznet_wc_flush();
+	w52_wc_addr = addr;
+	w52_wc_len = len;
+	memcpy(w52_wc_data, buf, len);
+	return 1;
+}
+
+// Flush pending writes if a read of addr..addr+len-1 would see stale data
+static void wiznet_wc_sync(uint16_t addr, uint16_t len)
+{
+	if (w52_wc_len && addr < w52_wc_addr + w52_wc_len && addr + len > w52_wc_addr)
+		wiznet_wc_flush();
+}
+
+void wiznet_wc_flush()
 {
 	#if WIZNET_DEBUG > 5
-	const char *funcname = "wiznet_w_reg()";
+	const char *funcname = "wiznet_wc_flush()";
 	#endif
 
+	if (!w52_wc_len)
+		return;
+	W52_IO_ACQUIRE;
 	W52_SPI_SET;
 	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer(W52_SPI_OPCODE_WRITE >> 8);
-	spi_transfer(0x01);
-	spi_transfer(val);
+	wiznet_io_header(w52_wc_addr, W52_SPI_OPCODE_WRITE, w52_wc_len);
+	spi_transfer_block(w52_wc_data, NULL, w52_wc_len);
 	W52_CS_HIGH;
 	W52_SPI_UNSET;
+	W52_IO_RELEASE;
+	wiznet_debug6_printf("%s: SPI combined write of %u bytes @%x\n", funcname, w52_wc_len, w52_wc_addr);
+	w52_wc_len = 0;
+}
+
+void wiznet_wc_begin()
+{
+	w52_wc_depth++;
+}
+
+void wiznet_wc_end()
+{
+	if (w52_wc_depth && !--w52_wc_depth)
+		wiznet_wc_flush();
+}
+#define W52_WC_ADD(addr, buf, len) wiznet_wc_add(addr, buf, len)
+#define W52_WC_SYNC(addr, len) wiznet_wc_sync(addr, len)
+#define W52_WC_FLUSH wiznet_wc_flush()
+#else
+#define W52_WC_ADD(addr, buf, len) 0
+#define W52_WC_SYNC(addr, len)
+#define W52_WC_FLUSH
+#endif
+
+void wiznet_w_reg(uint16_t addr, uint8_t val)
+{
+	#if W52_REG_SHADOW
+	uint8_t cur;
+	#endif
+
+	#if WIZNET_DEBUG > 5
+	const char *funcname = "wiznet_w_reg()";
+	#endif
+
+	#if W52_REG_SHADOW
+	if (wiznet_shadow_get(addr, &cur) && cur == val) {
+		wiznet_debug6_printf("%s: SPI reg write @%x [%h] unchanged (shadow)\n", funcname, addr, val);
+		return;
+	}
+	#endif
+	if (!W52_WC_ADD(addr, &val, 1)) {
+		W52_IO_ACQUIRE;
+		W52_SPI_SET;
+		W52_CS_LOW;
+		wiznet_io_header(addr, W52_SPI_OPCODE_WRITE, 1);
+		spi_transfer(val);
+		W52_CS_HIGH;
+		W52_SPI_UNSET;
+		W52_IO_RELEASE;
+	}
+	#if W52_REG_SHADOW
+	wiznet_shadow_written(addr, val);
+	#endif
 	wiznet_debug6_printf("%s: SPI reg write @%x [%h]\n", funcname, addr, val);
 }
 
@@ -69,64 +309,103 @@ uint8_t wiznet_r_reg(uint16_t addr)
 	const char *funcname = "wiznet_r_reg()";
 	#endif
 
+	#if W52_REG_SHADOW
+	if (wiznet_shadow_get(addr, &val))
+		return val;
+	#endif
+	W52_WC_SYNC(addr, 1);
+	W52_IO_ACQUIRE;
 	W52_SPI_SET;
 	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer(W52_SPI_OPCODE_READ >> 8);
-	spi_transfer(0x01);
+	wiznet_io_header(addr, W52_SPI_OPCODE_READ, 1);
 	val = spi_transfer(0xFF);
 	W52_CS_HIGH;
 	W52_SPI_UNSET;
+	W52_IO_RELEASE;
+	#if W52_REG_SHADOW
+	wiznet_shadow_put(addr, val, 0);
+	#endif
 	wiznet_debug6_printf("%s: SPI reg read @%x [%h]\n", funcname, addr, val);
 	return val;
 }
 
 void wiznet_w_reg16(uint16_t addr, uint16_t val)
 {
+	#if W52_REG_SHADOW
+	uint8_t cur_hi, cur_lo;
+	#endif
+	#if W52_WRITE_COMBINE
+	uint8_t wbuf[2];
+	#endif
+
 	#if WIZNET_DEBUG > 5
 	const char *funcname = "wiznet_w_reg16()";
 	#endif
 
-	W52_SPI_SET;
-	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer(W52_SPI_OPCODE_WRITE >> 8);
-	spi_transfer(0x02);
-	spi_transfer(val >> 8);
-	spi_transfer(val & 0xFF);
-	W52_CS_HIGH;
-	W52_SPI_UNSET;
+	#if W52_REG_SHADOW
+	if (wiznet_shadow_get(addr, &cur_hi) && wiznet_shadow_get(addr+1, &cur_lo) &&
+	    ((cur_hi << 8) | cur_lo) == val) {
+		wiznet_debug6_printf("%s: SPI reg16 write @%x [%x] unchanged (shadow)\n", funcname, addr, val);
+		return;
+	}
+	#endif
+	#if W52_WRITE_COMBINE
+	wbuf[0] = val >> 8;
+	wbuf[1] = val & 0xFF;
+	#endif
+	if (!W52_WC_ADD(addr, wbuf, 2)) {
+		W52_IO_ACQUIRE;
+		W52_SPI_SET;
+		W52_CS_LOW;
+		wiznet_io_header(addr, W52_SPI_OPCODE_WRITE, 2);
+		spi_transfer(val >> 8);
+		spi_transfer(val & 0xFF);
+		W52_CS_HIGH;
+		W52_SPI_UNSET;
+		W52_IO_RELEASE;
+	}
+	#if W52_REG_SHADOW
+	wiznet_shadow_written(addr, val >> 8);
+	wiznet_shadow_written(addr+1, val & 0xFF);
+	#endif
 	wiznet_debug6_printf("%s: SPI reg16 write @%x [%x]", funcname, addr, val);
 }
 
 uint16_t wiznet_r_reg16(uint16_t addr)
 {
 	uint16_t val;
+	#if W52_REG_SHADOW
+	uint8_t cur_hi, cur_lo;
+	#endif
 
 	#if WIZNET_DEBUG > 5
 	const char *funcname = "wiznet_r_reg16()";
 	#endif
 
+	#if W52_REG_SHADOW
+	if (wiznet_shadow_get(addr, &cur_hi) && wiznet_shadow_get(addr+1, &cur_lo))
+		return (cur_hi << 8) | cur_lo;
+	#endif
+	W52_WC_SYNC(addr, 2);
+	W52_IO_ACQUIRE;
 	W52_SPI_SET;
 	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer(W52_SPI_OPCODE_READ >> 8);
-	spi_transfer(0x02);
+	wiznet_io_header(addr, W52_SPI_OPCODE_READ, 2);
 	val = spi_transfer(0xFF) << 8;
 	val |= spi_transfer(0xFF);
 	W52_CS_HIGH;
 	W52_SPI_UNSET;
+	W52_IO_RELEASE;
+	#if W52_REG_SHADOW
+	wiznet_shadow_put(addr, val >> 8, 0);
+	wiznet_shadow_put(addr+1, val & 0xFF, 0);
+	#endif
 	wiznet_debug6_printf("%s: SPI reg16 read @%x [%x]", funcname, addr, val);
 	return val;
 }
 
 void wiznet_w_set(uint16_t addr, uint16_t len, uint8_t val)
 {
-	uint16_t i;
-
 	#if WIZNET_DEBUG > 5
 	const char *funcname = "wiznet_w_set()";
 	#endif
@@ -135,24 +414,23 @@ void wiznet_w_set(uint16_t addr, uint16_t len, uint8_t val)
 		wiznet_debug6_printf("%s: called with len=0!\n", funcname);
 		return;
 	}
+	#if W52_REG_SHADOW
+	wiznet_shadow_drop(addr, len);
+	#endif
+	W52_WC_FLUSH;
+	W52_IO_ACQUIRE;
 	W52_SPI_SET;
 	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer( (W52_SPI_OPCODE_WRITE >> 8) | (len >> 8) );
-	spi_transfer(len & 0xFF);
-	for (i=0; i < len; i++) {
-		spi_transfer(val);
-	}
+	wiznet_io_header(addr, W52_SPI_OPCODE_WRITE, len);
+	spi_fill_block(val, len);
 	W52_CS_HIGH;
 	W52_SPI_UNSET;
+	W52_IO_RELEASE;
 	wiznet_debug6_printf("%s: SPI set write [%h] %u times starting @%x\n", funcname, val, len, addr);
 }
 
 void wiznet_w_buf(uint16_t addr, uint16_t len, void *buf)
 {
-	uint8_t *bufptr = (uint8_t *)buf;
-	uint16_t i;
 
 	#if WIZNET_DEBUG > 5
 	const char *funcname = "wiznet_w_buf()";
@@ -162,23 +440,23 @@ void wiznet_w_buf(uint16_t addr, uint16_t len, void *buf)
 		wiznet_debug6_printf("%s: called with len=0!\n", funcname);
 		return;
 	}
+	#if W52_REG_SHADOW
+	wiznet_shadow_drop(addr, len);
+	#endif
+	if (W52_WC_ADD(addr, buf, len))
+		return;
+	W52_IO_ACQUIRE;
 	W52_SPI_SET;
 	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer( (W52_SPI_OPCODE_WRITE >> 8) | (len >> 8) );
-	spi_transfer(len & 0xFF);
-	for (i=0; i < len; i++) {
-		spi_transfer(bufptr[i]);
-	}
+	wiznet_io_header(addr, W52_SPI_OPCODE_WRITE, len);
+	spi_transfer_block(buf, NULL, len);
 	W52_CS_HIGH;
 	W52_SPI_UNSET;
+	W52_IO_RELEASE;
 }
 
 void wiznet_r_buf(uint16_t addr, uint16_t len, void *buf)
 {
-	uint8_t *bufptr = (uint8_t *)buf;
-	uint16_t i;
 
 	#if WIZNET_DEBUG > 5
 	const char *funcname = "wiznet_r_buf()";
@@ -188,23 +466,21 @@ void wiznet_r_buf(uint16_t addr, uint16_t len, void *buf)
 		wiznet_debug6_printf("%s: called with len=0!\n", funcname);
 		return;
 	}
+	W52_WC_SYNC(addr, len);
+	W52_IO_ACQUIRE;
 	W52_SPI_SET;
 	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer( (W52_SPI_OPCODE_READ >> 8) | (len >> 8) );
-	spi_transfer(len & 0xFF);
-	for (i=0; i < len; i++) {
-		bufptr[i] = spi_transfer(0xFF);
-	}
+	wiznet_io_header(addr, W52_SPI_OPCODE_READ, len);
+	spi_transfer_block(NULL, buf, len);
 	W52_CS_HIGH;
 	W52_SPI_UNSET;
+	W52_IO_RELEASE;
 }
 
 uint16_t wiznet_search_r_buf(uint16_t addr, uint16_t len, void *buf, uint8_t searchchar)
 {
-	uint8_t *bufptr = (uint8_t *)buf, keep_reading = 1;
-	uint16_t i, ttl=0;
+	uint8_t *bufptr = (uint8_t *)buf;
+	uint16_t ttl=0;
 
 	#if WIZNET_DEBUG > 5
 	const char *funcname = "wiznet_w_set()";
@@ -214,24 +490,21 @@ uint16_t wiznet_search_r_buf(uint16_t addr, uint16_t len, void *buf, uint8_t sea
 		wiznet_debug6_printf("%s: called with len=0!\n", funcname);
 		return 0;
 	}
+	W52_WC_SYNC(addr, len);
+	W52_IO_ACQUIRE;
 	W52_SPI_SET;
 	W52_CS_LOW;
-	spi_transfer(addr >> 8);
-	spi_transfer(addr & 0xFF);
-	spi_transfer( (W52_SPI_OPCODE_READ >> 8) | (len >> 8) );
-	spi_transfer(len & 0xFF);
-	for (i=0; i < len; i++) {
-		if (keep_reading) {
-			bufptr[i] = spi_transfer(0xFF);
-			ttl++;
-			if (bufptr[i] == searchchar)
-				keep_reading = 0;
-		} else {
-			spi_transfer(0xFF);  // Drain remaining bytes (W5200 doesn't like abrupt cessation of SPI transfers)
-		}
+	wiznet_io_header(addr, W52_SPI_OPCODE_READ, len);
+	while (ttl < len) {
+		bufptr[ttl] = spi_transfer(0xFF);
+		if (bufptr[ttl++] == searchchar)
+			break;
 	}
+	// Drain remaining bytes (W5200 doesn't like abrupt cessation of SPI transfers)
+	spi_transfer_block(NULL, NULL, len - ttl);
 	W52_CS_HIGH;
 	W52_SPI_UNSET;
+	W52_IO_RELEASE;
 
 	#if WIZNET_DEBUG > 5
 	if (ttl < len)
@@ -239,3 +512,316 @@ uint16_t wiznet_search_r_buf(uint16_t addr, uint16_t len, void *buf, uint8_t sea
 	#endif
 	return ttl;
 }
+
+
+/* Streamed read
+ * The data phase is handed to visitor() in chunks of up to W52_RECV_STREAM_CHUNK bytes as it comes off
+ * the bus.  A visitor returning less than the chunk length stops the stream; the rest of the frame is
+ * clocked out and discarded.  The visitor runs with the chip selected, so it must not do W5200 I/O itself.
+ * Returns the number of bytes the visitor consumed.
+ */
+uint16_t wiznet_visit_r_buf(uint16_t addr, uint16_t len, WIZNETVisitor visitor, void *ctx)
+{
+	uint8_t chunk[W52_RECV_STREAM_CHUNK];
+	uint16_t clocked = 0, ttl = 0, n, used;
+
+	#if WIZNET_DEBUG > 5
+	const char *funcname = "wiznet_visit_r_buf()";
+	#endif
+
+	if (!len) {
+		wiznet_debug6_printf("%s: called with len=0!\n", funcname);
+		return 0;
+	}
+	W52_WC_SYNC(addr, len);
+	W52_IO_ACQUIRE;
+	W52_SPI_SET;
+	W52_CS_LOW;
+	wiznet_io_header(addr, W52_SPI_OPCODE_READ, len);
+	while (clocked < len) {
+		n = len - clocked;
+		if (n > W52_RECV_STREAM_CHUNK)
+			n = W52_RECV_STREAM_CHUNK;
+		spi_transfer_block(NULL, chunk, n);
+		clocked += n;
+		used = visitor(ctx, chunk, n);
+		ttl += used;
+		if (used < n)
+			break;
+	}
+	// Drain remaining bytes (W5200 doesn't like abrupt cessation of SPI transfers)
+	spi_transfer_block(NULL, NULL, len - clocked);
+	W52_CS_HIGH;
+	W52_SPI_UNSET;
+	W52_IO_RELEASE;
+
+	wiznet_debug6_printf("%s: visitor consumed %u of %u bytes @%x\n", funcname, ttl, len, addr);
+	return ttl;
+}
+
+/* SPI bitrate calibration
+ * Each candidate divider must pass W52_SPI_CAL_PASSES rounds of: VERSIONR read, 16-bit pattern write/read
+ * on the last socket's MSS register (which is never shadowed) and a 16-byte block write/read in the
+ * last socket's TX memory.
+ * The first failing step ends the search; the fastest passing divider is then re-verified, backing off
+ * toward W52_SPI_SAFE_DIVIDER until it passes again.  Run this right after a chip reset, before any
+ * configuration is written, since a corrupted frame header could land anywhere in the register map.
+ */
+#if W52_SPI_AUTOCAL
+uint16_t w52_spi_divider = W52_SPI_SAFE_DIVIDER;
+
+static const uint16_t w52_spi_cal_patterns[] = { 0xA55A, 0x5AA5, 0xFF00, 0x00FF };
+
+static int wiznet_spi_verify(uint16_t div, uint8_t version)
+{
+	uint8_t i, pass, txbuf[16], rxbuf[16];
+	uint16_t pat;
+
+	w52_spi_divider = div;
+	for (pass=0; pass < W52_SPI_CAL_PASSES; pass++) {
+		if (wiznet_r_reg(W52_VERSIONR) != version)
+			return -1;
+		for (i=0; i < sizeof(w52_spi_cal_patterns)/sizeof(uint16_t); i++) {
+			pat = w52_spi_cal_patterns[i];
+			wiznet_w_sockreg16(W52_MAX_SOCKETS-1, W52_SOCK_MSS, pat);
+			if (wiznet_r_sockreg16(W52_MAX_SOCKETS-1, W52_SOCK_MSS) != pat)
+				return -1;
+		}
+		for (i=0; i < sizeof(txbuf); i++)
+			txbuf[i] = (i & 1 ? 0xAA : 0x55) ^ (i + pass);
+		wiznet_w_buf(W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * (W52_MAX_SOCKETS-1), sizeof(txbuf), txbuf);
+		wiznet_r_buf(W52_TXMEM_BASE + W52_SOCK_MEM_SIZE * (W52_MAX_SOCKETS-1), sizeof(rxbuf), rxbuf);
+		if (memcmp(txbuf, rxbuf, sizeof(txbuf)))
+			return -1;
+	}
+	return 0;
+}
+
+int wiznet_spi_calibrate()
+{
+	uint16_t div, good = W52_SPI_SAFE_DIVIDER;
+	uint8_t version;
+
+	#if WIZNET_DEBUG > 4
+	const char *funcname = "wiznet_spi_calibrate()";
+	#endif
+
+	w52_spi_divider = W52_SPI_SAFE_DIVIDER;
+	version = wiznet_r_reg(W52_VERSIONR);
+	if (!version)
+		return -EFAULT;  // Not even the safe divider works
+
+	for (div = W52_SPI_SAFE_DIVIDER - 1; div >= W52_SPI_MIN_DIVIDER && div > 0; div--) {
+		if (wiznet_spi_verify(div, version) != 0) {
+			wiznet_debug5_printf("%s: SMCLK/%u failed verification\n", funcname, div);
+			break;
+		}
+		good = div;
+	}
+
+	// Back off until the chosen divider passes a fresh round of verification
+	while (good < W52_SPI_SAFE_DIVIDER && wiznet_spi_verify(good, version) != 0) {
+		wiznet_debug5_printf("%s: SMCLK/%u failed re-verification, backing off\n", funcname, good);
+		good++;
+	}
+
+	w52_spi_divider = good;
+	wiznet_w_sockreg16(W52_MAX_SOCKETS-1, W52_SOCK_MSS, 0x0000);
+	return good;
+}
+#endif
+
+/* Multi-part frames
+ * A frame of 'len' bytes is opened with wiznet_frame_begin() and its data phase may be supplied in any
+ * number of pieces with wiznet_frame_w(); the pieces must add up to exactly 'len' before wiznet_frame_end().
+ */
+void wiznet_frame_begin(uint16_t addr, uint16_t len, uint16_t opcode)
+{
+	#if W52_REG_SHADOW
+	if (opcode == W52_SPI_OPCODE_WRITE)
+		wiznet_shadow_drop(addr, len);
+	#endif
+	W52_WC_FLUSH;
+	W52_IO_ACQUIRE;
+	W52_SPI_SET;
+	W52_CS_LOW;
+	wiznet_io_header(addr, opcode, len);
+}
+
+void wiznet_frame_w(const void *buf, uint16_t len)
+{
+	if (buf != NULL)
+		spi_transfer_block(buf, NULL, len);
+	else
+		spi_fill_block(0x00, len);
+}
+
+void wiznet_frame_end()
+{
+	W52_CS_HIGH;
+	W52_SPI_UNSET;
+	W52_IO_RELEASE;
+}
+
+/* Asynchronous buffer I/O
+ * Requests are kept in a single FIFO, so ordering is preserved per socket (and globally).  The request at
+ * the head owns the bus; its data phase is driven by spi_block_start() and completed by wiznet_io_isr().
+ * Ring-buffer wrap-around, the Sn_TX_WR/Sn_RX_RD update and the optional RECV command all happen in
+ * interrupt context once the data has moved, then the request's callback runs and the next one starts.
+ */
+#if W52_ASYNC_IO
+
+#define W52_IOQ_IDLE 0
+#define W52_IOQ_DATA 1
+#define W52_IOQ_WRAP 2
+
+static WIZNETIOReq * volatile w52_ioq_head;
+static WIZNETIOReq *w52_ioq_tail;
+static volatile uint8_t w52_ioq_state, w52_ioq_running, w52_io_locked;
+
+// 8 or 16-bit register write issued from the queue (no debug output; may run in interrupt context)
+static void wiznet_io_w_raw(uint16_t addr, uint16_t len, uint16_t val)
+{
+	W52_CS_LOW;
+	wiznet_io_header(addr, W52_SPI_OPCODE_WRITE, len);
+	if (len > 1)
+		spi_transfer(val >> 8);
+	spi_transfer(val & 0xFF);
+	W52_CS_HIGH;
+}
+
+// Begin the current segment of 'req'; returns 0 if the data phase has already completed
+static int wiznet_io_start(WIZNETIOReq *req)
+{
+	uint16_t addr = req->addr, len = req->len;
+	uint8_t *bufptr = req->buf;
+
+	if (w52_ioq_state == W52_IOQ_WRAP) {
+		addr = req->wrap_addr;
+		bufptr += len;
+		len = req->wrap_len;
+	}
+	W52_CS_LOW;
+	wiznet_io_header(addr, req->opcode, len);
+	if (req->opcode == W52_SPI_OPCODE_READ)
+		return spi_block_start(NULL, bufptr, len);
+	return spi_block_start(bufptr, NULL, len);
+}
+
+/* Run the queue forward until a data phase is left in flight or the queue is empty.
+ * Must be called with interrupts disabled or from the completion ISR.
+ */
+static int wiznet_io_run()
+{
+	WIZNETIOReq *req;
+	int completed = 0;
+
+	w52_ioq_running = 1;
+	while ( (req = w52_ioq_head) != NULL && !w52_io_locked ) {
+		if (w52_ioq_state == W52_IOQ_IDLE) {
+			W52_SPI_SET;
+			w52_ioq_state = W52_IOQ_DATA;
+			if (wiznet_io_start(req))
+				break;
+		}
+		W52_CS_HIGH;
+		if (w52_ioq_state == W52_IOQ_DATA && req->wrap_len) {
+			w52_ioq_state = W52_IOQ_WRAP;
+			if (wiznet_io_start(req))
+				break;
+			W52_CS_HIGH;
+		}
+		if (req->ptr_reg)
+			wiznet_io_w_raw(req->ptr_reg, 2, req->ptr_val);
+		if (req->flags & W52_IOREQ_FLAG_RECV) {
+			wiznet_io_w_raw(W52_SOCK_REG_RESOLVE(req->sockfd, W52_SOCK_IR), 1, W52_SOCK_IR_RECV);  // Clear RECV IRQ
+			wiznet_io_w_raw(W52_SOCK_REG_RESOLVE(req->sockfd, W52_SOCK_CR), 1, W52_SOCK_CMD_RECV); // Let more data in!
+		}
+		W52_SPI_UNSET;
+
+		w52_ioq_state = W52_IOQ_IDLE;
+		w52_ioq_head = req->next;
+		req->status = W52_IOREQ_DONE;
+		completed++;
+		if (req->callback != NULL)
+			req->callback(req);  // May submit further requests; they're picked up by this loop
+	}
+	w52_ioq_running = 0;
+	return completed;
+}
+
+void wiznet_io_submit(WIZNETIOReq *req)
+{
+	uint16_t sr;
+
+	W52_WC_FLUSH;  // Queued requests may issue commands that depend on held-back register writes
+	sr = __get_SR_register();
+	req->next = NULL;
+	req->status = W52_IOREQ_QUEUED;
+	_DINT();
+	if (w52_ioq_head == NULL)
+		w52_ioq_head = req;
+	else
+		w52_ioq_tail->next = req;
+	w52_ioq_tail = req;
+	if (w52_ioq_state == W52_IOQ_IDLE && !w52_ioq_running)
+		wiznet_io_run();
+	if (sr & GIE)
+		_EINT();
+}
+
+int wiznet_io_isr()
+{
+	if (!spi_block_isr())
+		return 0;
+	return wiznet_io_run();
+}
+
+// With GIE clear the completion ISR can't run, so drive the queue by polling it instead
+#define W52_IOQ_POLL if ( !(__get_SR_register() & GIE) ) wiznet_io_isr()
+
+void wiznet_io_wait(WIZNETIOReq *req)
+{
+	if (req != NULL) {
+		while (req->status == W52_IOREQ_QUEUED)
+			W52_IOQ_POLL;
+	} else {
+		while (w52_ioq_head != NULL)
+			W52_IOQ_POLL;
+	}
+}
+
+/* Synchronous I/O waits for the queue to drain, then holds it off until the frame is done.
+ * Requests submitted in the meantime are started by wiznet_io_release().
+ * Completion callbacks must not do synchronous I/O (wiznet_r_reg() et al); they should submit requests
+ * instead.  If one does anyway, the bus is idle between requests so the lock is taken without waiting.
+ */
+void wiznet_io_acquire()
+{
+	uint16_t sr;
+
+	do {
+		sr = __get_SR_register();
+		_DINT();
+		if (w52_ioq_head == NULL || (w52_ioq_running && w52_ioq_state == W52_IOQ_IDLE))
+			w52_io_locked = 1;
+		if (sr & GIE)
+			_EINT();
+		else if (!w52_io_locked)
+			wiznet_io_isr();
+	} while (!w52_io_locked);
+}
+
+void wiznet_io_release()
+{
+	uint16_t sr = __get_SR_register();
+
+	_DINT();
+	w52_io_locked = 0;
+	if (w52_ioq_head != NULL && !w52_ioq_running)
+		wiznet_io_run();
+	if (sr & GIE)
+		_EINT();
+}
+
+#endif
@@ -20,8 +20,23 @@
 
 /* Architecture-specific Init */
 void wiznet_io_init();
+#if W52_SPI_AUTOCAL
+int wiznet_spi_calibrate();  // Returns the chosen SPI divider, or -EFAULT
+#endif
 
 /* Register I/O primitives */
+#if W52_REG_SHADOW
+void wiznet_shadow_invalidate();  // Forget all shadowed register values (e.g. after a hardware reset)
+#endif
+#if W52_WRITE_COMBINE
+void wiznet_wc_begin();  // Start holding back configuration register writes (nests)
+void wiznet_wc_end();    // End of the outermost begin flushes whatever is pending
+void wiznet_wc_flush();
+#else
+#define wiznet_wc_begin()
+#define wiznet_wc_end()
+#define wiznet_wc_flush()
+#endif
 void wiznet_w_reg(uint16_t, uint8_t);
 uint8_t wiznet_r_reg(uint16_t);
 void wiznet_w_reg16(uint16_t, uint16_t);
@@ -37,6 +52,22 @@ void wiznet_w_set(uint16_t, uint16_t, uint8_t);
 void wiznet_w_buf(uint16_t, uint16_t, void *);
 void wiznet_r_buf(uint16_t, uint16_t, void *);
 uint16_t wiznet_search_r_buf(uint16_t, uint16_t, void *, uint8_t);
+uint16_t wiznet_visit_r_buf(uint16_t, uint16_t, WIZNETVisitor, void *);
+
+/* Multi-part frames (write data in pieces under a single 4-byte frame header) */
+void wiznet_frame_begin(uint16_t, uint16_t, uint16_t);  // Address, total length, W52_SPI_OPCODE_READ/WRITE
+void wiznet_frame_w(const void *, uint16_t);  // NULL buffer writes zeroes
+void wiznet_frame_end();
+
+#if W52_ASYNC_IO
+/* Asynchronous (interrupt-completed) Buffer I/O */
+void wiznet_io_submit(WIZNETIOReq *);
+int wiznet_io_isr();  // Call from the DMA/USCI RX ISR; returns # of requests completed
+void wiznet_io_wait(WIZNETIOReq *);  // Wait for one request, or the whole queue if NULL
+#define wiznet_io_done(req) ((req)->status == W52_IOREQ_DONE)
+void wiznet_io_acquire();
+void wiznet_io_release();
+#endif
 
 
 
@@ -0,0 +1,199 @@
+/* w5200_reactor.c
+ * WizNet W5200 Ethernet Controller Driver for MSP430
+ * Interrupt-driven event dispatch with per-socket handlers
+ *
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <msp430.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "w5200_config.h"
+#include "w5200_buf.h"
+#include "w5200_sock.h"
+#include "w5200_reactor.h"
+#include "w5200_debug.h"
+
+/* Handlers are looked up by socket number.  IR2 bits outside w52_reactor_mask are never touched, so
+ * sockets the application drives with wiznet_accept()/wiznet_recv() et al. keep their Sn_IR bits.
+ */
+static const WIZNETHandlers *w52_reactor_ops[W52_MAX_SOCKETS];
+static void *w52_reactor_ctx[W52_MAX_SOCKETS];
+static uint8_t w52_reactor_mask;
+
+// Handlers may unregister their own socket, so the table entry is checked on every call
+#define W52_REACTOR_HANDLER(sock, ev) (w52_reactor_ops[sock] != NULL ? w52_reactor_ops[sock]->ev : NULL)
+#define W52_REACTOR_CALL(sock, ev) do { if (W52_REACTOR_HANDLER(sock, ev) != NULL) w52_reactor_ops[sock]->ev(sock, w52_reactor_ctx[sock]); } while (0)
+
+int wiznet_reactor_register(int sockfd, const WIZNETHandlers *ops, void *ctx)
+{
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_reactor_register()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	w52_reactor_ops[sockfd] = ops;
+	w52_reactor_ctx[sockfd] = ctx;
+	if (ops != NULL)
+		w52_reactor_mask |= 1 << sockfd;
+	else
+		w52_reactor_mask &= ~(1 << sockfd);
+	wiznet_debug5_printf("%s: Socket %d %s\n", funcname, sockfd, (ops != NULL ? "registered" : "unregistered"));
+	return 0;
+}
+
+// Drive wiznet_connect_poll() and call the handler for however it finished
+static int _wiznet_reactor_connect(int sockfd)
+{
+	int ret;
+
+	ret = wiznet_connect_poll(sockfd);
+	switch (ret) {
+		case -EINPROGRESS:
+			break;
+		case 0:
+			W52_REACTOR_CALL(sockfd, on_accept);
+			W52_REACTOR_CALL(sockfd, on_writable);
+			break;
+		case -ETIMEDOUT:
+			W52_REACTOR_CALL(sockfd, on_timeout);
+			break;
+		default:
+			W52_REACTOR_CALL(sockfd, on_closed);
+	}
+	return ret;
+}
+
+static void _wiznet_reactor_service(int sockfd)
+{
+	uint8_t irq, ack;
+	int ret;
+
+	#if WIZNET_DEBUG > 4
+	const char *funcname = "wiznet_reactor_dispatch()";
+	#endif
+
+	irq = wiznet_r_sockreg(sockfd, W52_SOCK_IR);
+	wiznet_debug5_printf("%s: Socket %d IR=%x\n", funcname, sockfd, irq);
+
+	/* Acknowledge up front so anything arriving while a handler runs raises IR2 again.  Bits that a
+	 * pending connect, accept or async send still has to see are left for those functions to clear.
+	 */
+	ack = irq;
+	if (w52_sockets[sockfd].connecting == W52_CONN_SYNSENT)
+		ack &= ~(W52_SOCK_IR_CON | W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT);
+	else if (w52_sockets[sockfd].mode == W52_SOCK_MR_PROTO_TCP)
+		ack &= ~W52_SOCK_IR_CON;
+	if ( (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT) && !(irq & (W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT)) )
+		ack &= ~W52_SOCK_IR_SEND_OK;
+	if (ack)
+		wiznet_w_sockreg(sockfd, W52_SOCK_IR, ack);
+
+	if (w52_sockets[sockfd].connecting) {
+		if (_wiznet_reactor_connect(sockfd))
+			return;  // Still in progress, or failed and already closed
+	} else if (irq & W52_SOCK_IR_CON) {
+		if (wiznet_accept(sockfd) == 0) {
+			W52_REACTOR_CALL(sockfd, on_accept);
+			W52_REACTOR_CALL(sockfd, on_writable);
+		}
+	}
+
+	if (irq & W52_SOCK_IR_RECV)
+		W52_REACTOR_CALL(sockfd, on_readable);
+
+	if (irq & W52_SOCK_IR_SEND_OK) {
+		ret = 0;
+		if (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT && !(irq & (W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT)))
+			ret = wiznet_tx_poll(sockfd);  // Chains the next SEND if more was committed
+		if (ret >= 0) {
+			W52_REACTOR_CALL(sockfd, on_writable);
+			if (!ret)
+				W52_REACTOR_CALL(sockfd, on_sent);
+		} else if (ret == -ETIMEDOUT) {
+			W52_REACTOR_CALL(sockfd, on_timeout);  // wiznet_tx_poll() already closed the connection
+		} else {
+			W52_REACTOR_CALL(sockfd, on_closed);
+		}
+	}
+
+	if (irq & (W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT)) {
+		w52_sockets[sockfd].tx_state = 0;
+		if (irq & W52_SOCK_IR_TIMEOUT) {
+			if (W52_REACTOR_HANDLER(sockfd, on_timeout) != NULL) {
+				W52_REACTOR_CALL(sockfd, on_timeout);
+				return;
+			}
+		} else if (W52_REACTOR_HANDLER(sockfd, on_closed) != NULL) {
+			W52_REACTOR_CALL(sockfd, on_closed);
+			return;
+		}
+		if (w52_sockets[sockfd].mode == W52_SOCK_MR_PROTO_TCP) {
+			wiznet_w_command(sockfd, W52_SOCK_CMD_DISCON);
+			if (w52_sockets[sockfd].is_bind) {
+				wiznet_quickbind(sockfd);
+				wiznet_debug5_printf("%s: Socket %d closed with no handler; quickbinding\n", funcname, sockfd);
+			}
+		}
+	}
+}
+
+int wiznet_reactor_dispatch(uint8_t do_sleep)
+{
+	uint8_t ir2, opening;
+	int i, serviced = 0;
+
+	while (1) {
+		w5200_irq = 0x00;
+
+		// OPEN completing raises no IRQ, so connects still waiting on it are checked every pass
+		opening = 0;
+		for (i=0; i < W52_MAX_SOCKETS; i++) {
+			if ( (w52_reactor_mask & (1 << i)) && w52_sockets[i].connecting == W52_CONN_OPENING &&
+			     _wiznet_reactor_connect(i) == -EINPROGRESS )
+				opening = 1;
+		}
+
+		ir2 = wiznet_r_reg(W52_IR2);
+		if (ir2 & w52_reactor_mask) {
+			for (i=0; i < W52_MAX_SOCKETS; i++) {
+				if (ir2 & w52_reactor_mask & (1 << i)) {
+					_wiznet_reactor_service(i);
+					serviced++;
+				}
+			}
+			continue;  // INTn stays asserted until IR2 reads clear; sleeping before then would miss the next edge
+		}
+
+		// Bits left in IR2 belong to sockets the application services itself; keep them visible to wiznet_irq_getsocket()
+		if (ir2)
+			w5200_irq = 0x01;
+		if (serviced || !do_sleep || opening || ir2)
+			break;
+		if (!w5200_irq)
+			WIZNET_CPU_WAIT;
+	}
+	return serviced;
+}
+
+void wiznet_reactor_run()
+{
+	while (1)
+		wiznet_reactor_dispatch(1);
+}
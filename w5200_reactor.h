@@ -0,0 +1,52 @@
+/* w5200_reactor.h
+ * WizNet W5200 Ethernet Controller Driver for MSP430
+ * Interrupt-driven event dispatch with per-socket handlers
+ *
+ *
+ * Copyright (c) 2013, Eric Brundick <spirilis@linux.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT,
+ * OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS
+ * ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef W5200_REACTOR_H
+#define W5200_REACTOR_H
+
+#include <msp430.h>
+#include <stdint.h>
+#include "w5200_config.h"
+
+/* Event handlers; any may be NULL.  Each is called with the socket and the ctx pointer given at registration.
+ * on_accept    TCP connection established (listener accepted, or wiznet_connect_nb() completed)
+ * on_readable  RX data arrived
+ * on_writable  TX space was freed (SEND_OK), or the connection just came up
+ * on_sent      Everything committed so far has been sent
+ * on_closed    Peer disconnected or connect refused; default (NULL) is DISCON + quickbind for bound sockets
+ * on_timeout   ARP/TCP timeout; default (NULL) as for on_closed
+ */
+typedef void (*WIZNETHandler)(int, void *);
+
+typedef struct {
+	WIZNETHandler on_accept;
+	WIZNETHandler on_readable;
+	WIZNETHandler on_writable;
+	WIZNETHandler on_sent;
+	WIZNETHandler on_closed;
+	WIZNETHandler on_timeout;
+} WIZNETHandlers;
+
+/* Functions */
+int wiznet_reactor_register(int, const WIZNETHandlers *, void *);  // NULL handlers unregisters the socket
+int wiznet_reactor_dispatch(uint8_t);  // Service pending IRQs, optionally sleeping until there are some; returns # sockets serviced
+void wiznet_reactor_run();             // wiznet_reactor_dispatch(1) forever
+
+
+#endif
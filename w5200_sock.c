@@ -21,10 +21,13 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdarg.h>
 #include "w5200_config.h"
 #include "w5200_buf.h"
 #include "w5200_io.h"
 #include "w5200_sock.h"
+#include "w5200_bufpolicy.h"
+#include "w5200_fmt.h"
 #include "w5200_debug.h"
 
 /* Default IPs and utility subnets */
@@ -67,42 +70,127 @@ const uint8_t wiznet_tcp_state_idx[] = {
 WIZNETSocketState w52_sockets[W52_MAX_SOCKETS];
 
 
+/* IRQ servicing order.  wiznet_irq_getsocket() reads IR2 once per round and carries the pending set
+ * forward; the policy picks which pending socket goes next and drops it from the set once it has had
+ * its turn, so every socket flagged in a round is handed out before IR2 is read again.
+ */
+uint16_t w52_irq_count[W52_MAX_SOCKETS];
+uint8_t w52_irq_weight[W52_MAX_SOCKETS];
+uint8_t w52_irq_class[W52_MAX_SOCKETS];
+
+static WIZNETIrqPolicy w52_irqpol = wiznet_irqpol_roundrobin;
+static uint8_t w52_irq_pending;
+static uint8_t w52_irqpol_last = W52_MAX_SOCKETS - 1;  // Scan starts at socket 0
+static uint8_t w52_irqpol_turns[W52_MAX_SOCKETS];  // Left this round, wiznet_irqpol_weighted()
+
+// First pending socket after w52_irqpol_last, wrapping around
+static uint8_t _wiznet_irqpol_next(uint8_t pending)
+{
+	uint8_t i, sock = 0;
+
+	for (i=1; i <= W52_MAX_SOCKETS; i++) {
+		sock = (w52_irqpol_last + i) % W52_MAX_SOCKETS;
+		if (pending & (1 << sock))
+			break;
+	}
+	return sock;
+}
+
+int wiznet_irqpol_roundrobin(uint8_t *pending)
+{
+	w52_irqpol_last = _wiznet_irqpol_next(*pending);
+	*pending &= ~(1 << w52_irqpol_last);
+	return w52_irqpol_last;
+}
+
+/* Offered up to w52_irq_weight[] times per round (0 counts as 1), interleaved with the other pending sockets;
+ * each turn after the first needs Sn_IR to still show unhandled events.  Returns -EAGAIN if that empties the
+ * pending set.
+ */
+int wiznet_irqpol_weighted(uint8_t *pending)
+{
+	uint8_t sock;
+
+	while (*pending) {
+		sock = _wiznet_irqpol_next(*pending);
+		w52_irqpol_last = sock;
+		if (!w52_irqpol_turns[sock]) {
+			w52_irqpol_turns[sock] = (w52_irq_weight[sock] ? w52_irq_weight[sock] : 1);
+		} else if (!wiznet_r_sockreg(sock, W52_SOCK_IR)) {
+			w52_irqpol_turns[sock] = 0;  // Handled already; its remaining turns lapse
+			*pending &= ~(1 << sock);
+			continue;
+		}
+		if (!--w52_irqpol_turns[sock])
+			*pending &= ~(1 << sock);
+		return sock;
+	}
+	return -EAGAIN;
+}
+
+// Highest w52_irq_class[] first, round-robin within a class
+int wiznet_irqpol_priority(uint8_t *pending)
+{
+	uint8_t i, sock = 0, top = 0;
+
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		if ( (*pending & (1 << i)) && w52_irq_class[i] > top )
+			top = w52_irq_class[i];
+	}
+	for (i=1; i <= W52_MAX_SOCKETS; i++) {
+		sock = (w52_irqpol_last + i) % W52_MAX_SOCKETS;
+		if ( (*pending & (1 << sock)) && w52_irq_class[sock] == top )
+			break;
+	}
+	w52_irqpol_last = sock;
+	*pending &= ~(1 << sock);
+	return sock;
+}
+
+void wiznet_irqpol_set(WIZNETIrqPolicy policy)
+{
+	uint8_t i;
+
+	w52_irqpol = (policy != NULL ? policy : wiznet_irqpol_roundrobin);
+	for (i=0; i < W52_MAX_SOCKETS; i++)
+		w52_irqpol_turns[i] = 0;
+}
+
 /* Which socket did an IRQ refer to */
 int wiznet_irq_getsocket()
 {
-	uint8_t ir2, bit;
-	int i, sock = -1;
+	int sock;
 
 	#if WIZNET_DEBUG > 4
 	const char *funcname = "wiznet_irq_getsocket()";
 	#endif
 
-	if (w5200_irq) {
-		ir2 = wiznet_r_reg(W52_IR2);
-		if (!ir2) {
-			w5200_irq = 0x00;
-			wiznet_debug5_printf("%s: w5200_irq was set but IR2 cleared; clearing w5200_irq\n", funcname);
-			return -EAGAIN;  // No IRQs pending but w5200_irq was never cleared.
-		}
-		/* Return 1 socket at a time, lower socket # = higher priority
-		 * If more than 1 socket is pending, w5200_irq will not be cleared.
-		 */
-		for (i=0; i < W52_MAX_SOCKETS; i++) {
-			bit = 1 << i;
-			if ( (ir2 & bit) && sock < 0 ) {
-				sock = i;
-				w5200_irq = 0x00;
+	do {
+		if (!w52_irq_pending) {
+			if (!w5200_irq) {
+				wiznet_debug5_printf("%s: w5200_irq not set\n", funcname);
+				return -EAGAIN;  // No IRQ fired; nothing more to see here!
 			}
-			if ( (ir2 & bit) && sock >= 0 ) {
-				wiznet_debug5_printf("%s: Multiple sockets pending IRQ\n", funcname);
-				w5200_irq = 0x01;
+			w5200_irq = 0x00;
+			w52_irq_pending = wiznet_r_reg(W52_IR2);
+			if (!w52_irq_pending) {
+				wiznet_debug5_printf("%s: w5200_irq was set but IR2 cleared; clearing w5200_irq\n", funcname);
+				return -EAGAIN;  // No IRQs pending but w5200_irq was never cleared.
 			}
 		}
-		return sock;
-	} else {
-		wiznet_debug5_printf("%s: w5200_irq not set\n", funcname);
-	}
-	return -EAGAIN;  // No IRQ fired; nothing more to see here!
+
+		sock = w52_irqpol(&w52_irq_pending);
+		if (sock < 0)
+			w5200_irq = 0x01;  // The policy dropped the rest of the round; start the next one
+	} while (sock < 0);
+	w52_irq_count[sock]++;
+	/* INTn gives no new edge for events arriving while it is already asserted, so IR2 is read once more
+	 * after the last socket of a round is handed out.
+	 */
+	if (!w52_irq_pending)
+		w5200_irq = 0x01;
+	wiznet_debug5_printf("%s: Socket %d\n", funcname, sock);
+	return sock;
 }
 
 int wiznet_phystate()
@@ -120,6 +208,158 @@ int wiznet_phystate()
 	return -ENETDOWN;
 }
 
+#if W52_SOCKOPT
+/* Socket options are cached per socket.  MSS/TTL/TOS live in the socket's own registers and are written before
+ * every OPEN (the chip replaces Sn_MSSR with the negotiated value); RTR/RCR exist once for the whole chip, so
+ * they are switched to the values of whichever socket issues the next LISTEN, CONNECT, SEND or DISCON.  The
+ * switch also applies to retransmissions already under way on every other socket.
+ */
+static uint16_t w52_rtr_cur = W52_RTR_DEFAULT;  // Values currently in the chip
+static uint8_t w52_rcr_cur = W52_RCR_DEFAULT;
+
+static void _wiznet_sockopt_defaults(int sockfd)
+{
+	w52_sockets[sockfd].opts.mss = 0;
+	w52_sockets[sockfd].opts.rtr = W52_RTR_DEFAULT;
+	w52_sockets[sockfd].opts.rcr = W52_RCR_DEFAULT;
+	w52_sockets[sockfd].opts.ttl = W52_TTL_DEFAULT;
+	w52_sockets[sockfd].opts.tos = 0;
+	w52_sockets[sockfd].opts.cork = 0;
+	w52_sockets[sockfd].cork_held = 0;
+}
+
+// Written to the TX ring but not committed yet
+static uint16_t _wiznet_tx_held(int sockfd)
+{
+	if (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT)
+		return w52_sockets[sockfd].tx_wr - w52_sockets[sockfd].tx_commit;
+	return w52_sockets[sockfd].tx_wr - w52_sockets[sockfd].tx_rd;
+}
+
+// Auto-corked data must reach the wire before DISCON/CLOSE; returns the wiznet_txcommit() error if it can't
+static int _wiznet_cork_drain(int sockfd)
+{
+	if (!w52_sockets[sockfd].opts.cork || !_wiznet_tx_held(sockfd))
+		return 0;
+	return wiznet_txcommit(sockfd);
+}
+
+int wiznet_setsockopt(int sockfd, uint8_t opt, uint16_t val)
+{
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_setsockopt()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	switch (opt) {
+		case W52_SO_MSS:
+			w52_sockets[sockfd].opts.mss = val;
+			break;
+		case W52_SO_TTL:
+			if (!val || val > 0xFF)
+				return -EINVAL;
+			w52_sockets[sockfd].opts.ttl = val;
+			wiznet_w_sockreg(sockfd, W52_SOCK_TTL, val);  // Takes effect at once
+			break;
+		case W52_SO_TOS:
+			if (val > 0xFF)
+				return -EINVAL;
+			w52_sockets[sockfd].opts.tos = val;
+			wiznet_w_sockreg(sockfd, W52_SOCK_TOS, val);
+			break;
+		case W52_SO_RTR:
+			if (!val)
+				return -EINVAL;
+			w52_sockets[sockfd].opts.rtr = val;
+			break;
+		case W52_SO_RCR:
+			if (val > 0xFF)  // 8-bit register
+				return -EINVAL;
+			w52_sockets[sockfd].opts.rcr = val;
+			break;
+		case W52_SO_CORK:
+			if (val > 0xFF)  // 256 would truncate to 0, turning corking off
+				return -EINVAL;
+			w52_sockets[sockfd].opts.cork = val;
+			w52_sockets[sockfd].cork_age = 0;
+			break;
+		default:
+			wiznet_debug4_printf("%s: Unknown option %u\n", funcname, opt);
+			return -EINVAL;
+	}
+	wiznet_debug5_printf("%s: Socket %d option %u = %u\n", funcname, sockfd, opt, val);
+	return 0;
+}
+
+int wiznet_getsockopt(int sockfd, uint8_t opt, uint16_t *val)
+{
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS)
+		return -EBADF;
+
+	switch (opt) {
+		case W52_SO_MSS:
+			*val = w52_sockets[sockfd].opts.mss;
+			break;
+		case W52_SO_TTL:
+			*val = w52_sockets[sockfd].opts.ttl;
+			break;
+		case W52_SO_TOS:
+			*val = w52_sockets[sockfd].opts.tos;
+			break;
+		case W52_SO_RTR:
+			*val = w52_sockets[sockfd].opts.rtr;
+			break;
+		case W52_SO_RCR:
+			*val = w52_sockets[sockfd].opts.rcr;
+			break;
+		case W52_SO_CORK:
+			*val = w52_sockets[sockfd].opts.cork;
+			break;
+		default:
+			return -EINVAL;
+	}
+	return 0;
+}
+
+// Backs wiznet_w_command(): applies the socket's options the command depends on, then issues it
+void wiznet_sockopt_command(int sockfd, uint8_t cmd)
+{
+	uint8_t timers[3];
+	WIZNETSockOpts *opts = &w52_sockets[sockfd].opts;
+
+	switch (cmd) {
+		case W52_SOCK_CMD_OPEN:
+			wiznet_wc_begin();
+			wiznet_w_sockreg16(sockfd, W52_SOCK_MSS, opts->mss);
+			wiznet_w_sockreg(sockfd, W52_SOCK_TOS, opts->tos);
+			wiznet_w_sockreg(sockfd, W52_SOCK_TTL, opts->ttl);
+			wiznet_wc_end();
+			break;
+
+		case W52_SOCK_CMD_LISTEN:  // SYN-ACK retransmissions
+		case W52_SOCK_CMD_CONNECT:
+		case W52_SOCK_CMD_DISCON:
+		case W52_SOCK_CMD_SEND:
+		case W52_SOCK_CMD_SEND_MAC:
+		case W52_SOCK_CMD_SEND_KEEP:
+			if (opts->rtr != w52_rtr_cur || opts->rcr != w52_rcr_cur) {
+				timers[0] = opts->rtr >> 8;  // RTR0, RTR1, RCR in one frame
+				timers[1] = opts->rtr & 0xFF;
+				timers[2] = opts->rcr;
+				wiznet_w_buf(W52_RTR0, 3, timers);
+				w52_rtr_cur = opts->rtr;
+				w52_rcr_cur = opts->rcr;
+			}
+			break;
+	}
+	wiznet_w_sockreg(sockfd, W52_SOCK_CR, cmd);
+}
+#endif
+
 int wiznet_socket(int protocol)
 {
 	int i;
@@ -133,6 +373,10 @@ int wiznet_socket(int protocol)
 			wiznet_debug4_printf("%s: %s requested but socket#0 already taken!\n", funcname, (protocol == W52_SOCK_MR_PROTO_MACRAW ? "MACRAW" : "PPPoE"));
 			return -EADDRINUSE;
 		}
+		if (!W52_SOCK_TXSIZE(0) || !W52_SOCK_RXSIZE(0)) {
+			wiznet_debug4_printf("%s: %s requested but socket#0 has no buffer memory!\n", funcname, (protocol == W52_SOCK_MR_PROTO_MACRAW ? "MACRAW" : "PPPoE"));
+			return -ENOBUFS;
+		}
 	}
 
 	switch (protocol) {
@@ -140,10 +384,19 @@ int wiznet_socket(int protocol)
 		case W52_SOCK_MR_PROTO_UDP:
 		case W52_SOCK_MR_PROTO_IPRAW:
 			for (i = W52_MAX_SOCKETS - 1; i >= 0; i--) {
-				if (w52_sockets[i].mode == 0x00) {
+				if (w52_sockets[i].mode == 0x00 && W52_SOCK_TXSIZE(i) && W52_SOCK_RXSIZE(i)) {
 					w52_sockets[i].mode = protocol & 0x0F;
 					w52_sockets[i].is_bind = 0;
+					w52_sockets[i].connecting = 0;
+					w52_sockets[i].tx_state = 0;
+					#if W52_SOCKOPT
+					_wiznet_sockopt_defaults(i);
+					#endif
+					#if W52_BUF_POLICY
+					wiznet_bufpol_open(i);
+					#endif
 					w52_sockets[i].tx_wr = wiznet_r_sockreg16(i, W52_SOCK_TX_WRITEPTR);
+					w52_sockets[i].tx_rd = w52_sockets[i].tx_wr;
 					w52_sockets[i].rx_rd = wiznet_r_sockreg16(i, W52_SOCK_RX_READPTR);
 
 					wiznet_w_sockreg(i, W52_SOCK_MR, w52_sockets[i].mode);
@@ -160,12 +413,19 @@ int wiznet_socket(int protocol)
 		case W52_SOCK_MR_PROTO_PPPOE:
 			w52_sockets[0].mode = protocol;
 			w52_sockets[0].is_bind = 0;
+			#if W52_SOCKOPT
+			_wiznet_sockopt_defaults(0);
+			#endif
+			#if W52_BUF_POLICY
+			wiznet_bufpol_open(0);
+			#endif
 			wiznet_w_sockreg(0, W52_SOCK_MR, w52_sockets[0].mode);
 			wiznet_w_command(0, W52_SOCK_CMD_CLOSE);
 			wiznet_w_sockreg(0, W52_SOCK_IMR, (protocol == W52_SOCK_MR_PROTO_MACRAW ? 0x1F : 0xFF));
 			wiznet_w_reg(W52_IMR2, (protocol == W52_SOCK_MR_PROTO_MACRAW ? 0x00 : 0xA0));
 			wiznet_w_reg(W52_IMR, wiznet_r_reg(W52_IMR) | 1);
 			w52_sockets[0].tx_wr = wiznet_r_sockreg16(0, W52_SOCK_TX_WRITEPTR);
+			w52_sockets[0].tx_rd = w52_sockets[0].tx_wr;
 			w52_sockets[0].rx_rd = wiznet_r_sockreg16(0, W52_SOCK_RX_READPTR);
 			wiznet_debug5_printf("%s: socket 0 configured for protocol %u, is_bind=0, tx_wr/rx_rd loaded\n", funcname, protocol);
 			return 0;
@@ -181,6 +441,7 @@ int wiznet_socket(int protocol)
 int wiznet_close(int sockfd)
 {
 	uint8_t sr, irq;
+	int ret = 0;
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_close()";
@@ -203,6 +464,9 @@ int wiznet_close(int sockfd)
 			wiznet_w_command(sockfd, W52_SOCK_CMD_CLOSE);
 		} else {
 			if (sr == W52_SOCK_SR_SOCK_ESTABLISHED) {
+				#if W52_SOCKOPT
+				ret = _wiznet_cork_drain(sockfd);  // Held data is lost (and reported) if this fails
+				#endif
 				wiznet_w_command(sockfd, W52_SOCK_CMD_DISCON);
 				if (!w5200_irq)
 					WIZNET_CPU_WAIT;
@@ -217,18 +481,50 @@ int wiznet_close(int sockfd)
 
 	// Mask any IRQs from this socket
 	wiznet_w_reg(W52_IMR, wiznet_r_reg(W52_IMR) & ~(1 << sockfd));
+	#if W52_BUF_POLICY
+	wiznet_bufpol_account(sockfd);
+	#endif
 	// Set socket as unused
 	w52_sockets[sockfd].mode = 0x00;
+	w52_sockets[sockfd].connecting = 0;
+	w52_sockets[sockfd].tx_state = 0;
+	#if W52_SOCKOPT
+	w52_sockets[sockfd].cork_held = 0;
+	#endif
+	w52_irq_pending &= ~(1 << sockfd);
+	w52_irqpol_turns[sockfd] = 0;
 	wiznet_debug5_printf("%s: Socket %d now closed\n", funcname, sockfd);
-	return 0;
+	#if W52_BUF_POLICY
+	wiznet_bufpol_rebalance();  // Only does anything once every socket is closed
+	#endif
+	return ret;
 }
 
 int wiznet_connect(int sockfd, uint16_t *addr, uint16_t dport)
 {
-	uint8_t sr, irq;
+	int ret;
+
+	ret = wiznet_connect_nb(sockfd, addr, dport);
+	while (ret == -EINPROGRESS) {
+		if (!w5200_irq)
+			__delay_cycles(1000);
+		ret = wiznet_connect_poll(sockfd);
+	}
+	return ret;
+}
+
+/* Non-blocking connect
+ * For TCP this issues OPEN and CONNECT and returns -EINPROGRESS straight away; wiznet_connect_poll() then reports
+ * the outcome, so several connections can be brought up at once.  The socket's CON, DISCON and TIMEOUT
+ * interrupts (see wiznet_irq_getsocket()) signal when polling is worthwhile.  UDP has no handshake and
+ * completes immediately.
+ */
+int wiznet_connect_nb(int sockfd, uint16_t *addr, uint16_t dport)
+{
+	uint8_t sr;
 
 	#if WIZNET_DEBUG > 3
-	const char *funcname = "wiznet_close()";
+	const char *funcname = "wiznet_connect_nb()";
 	#endif
 
 	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
@@ -247,6 +543,8 @@ int wiznet_connect(int sockfd, uint16_t *addr, uint16_t dport)
 
 	switch (w52_sockets[sockfd].mode) {
 		case W52_SOCK_MR_PROTO_TCP:
+			if (w52_sockets[sockfd].connecting)
+				return -EALREADY;
 			switch (sr) {
 				case W52_SOCK_SR_SOCK_ESTABLISHED:
 					return -EISCONN;
@@ -263,44 +561,15 @@ int wiznet_connect(int sockfd, uint16_t *addr, uint16_t dport)
 			wiznet_debug5_printf("%s: Socket %d using SRCPORT=%u\n", funcname, sockfd, w52_sockets[sockfd].srcport_idx * W52_MAX_SOCKETS + sockfd + W52_TCP_SRCPORT_BASE + w52_portoffset);
 			wiznet_w_command(sockfd, W52_SOCK_CMD_OPEN);
 
-			do {
-				sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
-				__delay_cycles(100);
-			} while (sr != W52_SOCK_SR_SOCK_INIT);
-
-			// Load dest IP, port
+			// Load dest IP, port (one frame); plain register writes, only latched by CONNECT
+			wiznet_wc_begin();
 			wiznet_ip_bin_w_sockreg(sockfd, W52_SOCK_DESTIP, addr);
 			wiznet_w_sockreg16(sockfd, W52_SOCK_DESTPORT, dport);
+			wiznet_wc_end();
 
-			// Connect
 			w52_sockets[sockfd].is_bind = 0;  // This is definitely not a listener port!
-			wiznet_w_command(sockfd, W52_SOCK_CMD_CONNECT);
-
-			// Wait and see what happens
-			do {
-				irq = wiznet_r_sockreg(sockfd, W52_SOCK_IR);
-
-				if (!irq && !w5200_irq) {
-					__delay_cycles(1000);
-				} else {
-					if (irq & (W52_SOCK_IR_TIMEOUT | W52_SOCK_IR_DISCON)) {
-						wiznet_w_sockreg(sockfd, W52_SOCK_IR, irq);
-						wiznet_w_command(sockfd, W52_SOCK_CMD_CLOSE);
-						wiznet_debug4_printf("%s: IRQ received = %x (%s)\n", funcname, irq, (irq & W52_SOCK_IR_TIMEOUT ? "TIMEOUT" : "DISCON"));
-						return (irq & W52_SOCK_IR_TIMEOUT ? -ETIMEDOUT : -ECONNREFUSED);
-					}
-				}
-				sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
-			} while (sr != W52_SOCK_SR_SOCK_ESTABLISHED && !(irq & W52_SOCK_IR_CON));
-
-			// Clear connect IRQ
-			wiznet_w_sockreg(sockfd, W52_SOCK_IR, W52_SOCK_IR_CON);
-			w52_sockets[sockfd].tx_wr = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR);
-			w52_sockets[sockfd].rx_rd = wiznet_r_sockreg16(sockfd, W52_SOCK_RX_READPTR);
-			wiznet_debug5_printf("%s: Connection established, tx_wr/rx_rd loaded\n", funcname);
-			return 0; // Connection established!
-
-			break;
+			w52_sockets[sockfd].connecting = W52_CONN_OPENING;
+			return wiznet_connect_poll(sockfd);  // Issues CONNECT if OPEN has already reached INIT
 
 		case W52_SOCK_MR_PROTO_UDP:
 			if (sr != W52_SOCK_SR_SOCK_CLOSED)
@@ -316,11 +585,14 @@ int wiznet_connect(int sockfd, uint16_t *addr, uint16_t dport)
 			if (sr != W52_SOCK_SR_SOCK_UDP)
 				return -EFAULT;
 
-			// Load dest IP, port
+			// Load dest IP, port (one frame)
+			wiznet_wc_begin();
 			wiznet_ip_bin_w_sockreg(sockfd, W52_SOCK_DESTIP, addr);
 			wiznet_w_sockreg16(sockfd, W52_SOCK_DESTPORT, dport);
+			wiznet_wc_end();
 			wiznet_debug5_printf("%s: Socket %d UDP dest = %u.%u.%u.%u:%u\n", funcname, sockfd, addr[0] >> 8, addr[0] & 0xFF, addr[1] >> 8, addr[1] & 0xFF, dport);
 			w52_sockets[sockfd].tx_wr = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR);
+			w52_sockets[sockfd].tx_rd = w52_sockets[sockfd].tx_wr;
 			w52_sockets[sockfd].rx_rd = wiznet_r_sockreg16(sockfd, W52_SOCK_RX_READPTR);
 			wiznet_debug5_printf("%s: Socket %d UDP configured, tx_wr/rx_rd loaded\n", funcname, sockfd);
 			return 0;
@@ -331,6 +603,62 @@ int wiznet_connect(int sockfd, uint16_t *addr, uint16_t dport)
 	// It's expected that IPRAW users know what they're doing and can load the dest IP into socket registers by themself.
 }
 
+/* Advance a wiznet_connect_nb() in progress: -EINPROGRESS until the handshake finishes, then 0 or the failure
+ * (-ETIMEDOUT, -ECONNREFUSED).  With no connect pending, reports whether the socket is connected.
+ */
+int wiznet_connect_poll(int sockfd)
+{
+	uint8_t sr, irq;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_connect_poll()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	switch (w52_sockets[sockfd].connecting) {
+		case W52_CONN_OPENING:
+			if (wiznet_r_sockreg(sockfd, W52_SOCK_SR) != W52_SOCK_SR_SOCK_INIT)
+				return -EINPROGRESS;  // OPEN not done yet
+			wiznet_w_command(sockfd, W52_SOCK_CMD_CONNECT);
+			w52_sockets[sockfd].connecting = W52_CONN_SYNSENT;
+			return -EINPROGRESS;
+
+		case W52_CONN_SYNSENT:
+			wiznet_sock_snapshot(sockfd, &snap);
+			irq = snap.ir;
+			sr = snap.sr;
+			if (irq & (W52_SOCK_IR_TIMEOUT | W52_SOCK_IR_DISCON) || sr == W52_SOCK_SR_SOCK_CLOSED) {
+				w52_sockets[sockfd].connecting = 0;
+				if (irq)
+					wiznet_w_sockreg(sockfd, W52_SOCK_IR, irq);
+				wiznet_w_command(sockfd, W52_SOCK_CMD_CLOSE);
+				wiznet_debug4_printf("%s: IRQ received = %x (%s)\n", funcname, irq, (irq & W52_SOCK_IR_TIMEOUT ? "TIMEOUT" : "DISCON"));
+				return (irq & W52_SOCK_IR_TIMEOUT ? -ETIMEDOUT : -ECONNREFUSED);
+			}
+			if (sr != W52_SOCK_SR_SOCK_ESTABLISHED && !(irq & W52_SOCK_IR_CON))
+				return -EINPROGRESS;
+
+			// Clear connect IRQ; the snapshot already holds the fresh pointers
+			w52_sockets[sockfd].connecting = 0;
+			wiznet_w_sockreg(sockfd, W52_SOCK_IR, W52_SOCK_IR_CON);
+			w52_sockets[sockfd].tx_wr = snap.tx_wr;
+			w52_sockets[sockfd].tx_rd = snap.tx_rd;
+			w52_sockets[sockfd].rx_rd = snap.rx_rd;
+			wiznet_debug5_printf("%s: Connection established, tx_wr/rx_rd loaded\n", funcname);
+			return 0; // Connection established!
+	}
+
+	sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
+	if (sr == W52_SOCK_SR_SOCK_ESTABLISHED || sr == W52_SOCK_SR_SOCK_UDP)
+		return 0;
+	return -ENOTCONN;
+}
+
 // Quickly re-establish SOCK_LISTEN state after a server connection is disconnected.
 // Can be used by user to quickly close an accepted connection when finished and re-establish LISTEN.
 int wiznet_quickbind(int sockfd)
@@ -367,6 +695,7 @@ int wiznet_quickbind(int sockfd)
 		return -EFAULT;
 
 	w52_sockets[sockfd].tx_wr = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR);
+	w52_sockets[sockfd].tx_rd = w52_sockets[sockfd].tx_wr;
 	w52_sockets[sockfd].rx_rd = wiznet_r_sockreg16(sockfd, W52_SOCK_RX_READPTR);
 	wiznet_debug5_printf("%s: Socket %d reconfigured for LISTEN, tx_wr/rx_rd loaded\n", funcname, sockfd);
 
@@ -401,6 +730,7 @@ int wiznet_bind(int sockfd, uint16_t srcport)
 
 			// Set srcport, open in LISTEN mode
 			wiznet_w_sockreg16(sockfd, W52_SOCK_SRCPORT, srcport);
+			W52_BUFPOL_BIND(sockfd, srcport);
 			wiznet_w_command(sockfd, W52_SOCK_CMD_OPEN);
 			sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
 			break;
@@ -434,6 +764,7 @@ int wiznet_bind(int sockfd, uint16_t srcport)
 				wiznet_w_command(sockfd, W52_SOCK_CMD_CLOSE);
 
 			wiznet_w_sockreg(sockfd, W52_SOCK_PROTO, srcport);
+			W52_BUFPOL_BIND(sockfd, srcport);
 			wiznet_w_command(sockfd, W52_SOCK_CMD_OPEN);
 			sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
 			if (sr != W52_SOCK_SR_SOCK_IPRAW)
@@ -447,9 +778,282 @@ int wiznet_bind(int sockfd, uint16_t srcport)
 	}
 }
 
+/* Listener pools: several TCP sockets bound to the same port, all kept in LISTEN so concurrent clients
+ * each land on their own socket.  Membership and state are bitmasks by socket number.
+ */
+
+/* Bring a released member back to LISTEN without waiting on it: from CLOSED it is reopened, from INIT it
+ * listens; anything else is still shutting down, and wiznet_pool_accept() tries again later.
+ */
+static int _wiznet_pool_rearm(WIZNETListenPool *pool, int sockfd, uint8_t sr)
+{
+	switch (sr) {
+		case W52_SOCK_SR_SOCK_CLOSED:
+			wiznet_w_sockreg(sockfd, W52_SOCK_IR, 0xFF);  // Stale RECV/SEND_OK/DISCON would keep IR2 set
+			w52_sockets[sockfd].tx_state = 0;
+			#if W52_SOCKOPT
+			w52_sockets[sockfd].cork_held = 0;
+			#endif
+			wiznet_w_command(sockfd, W52_SOCK_CMD_OPEN);
+			if (wiznet_r_sockreg(sockfd, W52_SOCK_SR) != W52_SOCK_SR_SOCK_INIT)
+				break;
+			// fall through
+		case W52_SOCK_SR_SOCK_INIT:
+			wiznet_w_command(sockfd, W52_SOCK_CMD_LISTEN);
+			// fall through
+		case W52_SOCK_SR_SOCK_LISTEN:
+			pool->arming &= ~(1 << sockfd);
+			return 0;
+	}
+	pool->arming |= 1 << sockfd;
+	return -EINPROGRESS;
+}
+
+int wiznet_listen_pool(WIZNETListenPool *pool, uint16_t srcport, uint8_t nsockets)
+{
+	int sockfd, ret = 0, count = 0;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_listen_pool()";
+	#endif
+
+	pool->port = srcport;
+	pool->members = pool->busy = pool->arming = pool->next = 0;
+
+	while (nsockets--) {
+		sockfd = wiznet_socket(IPPROTO_TCP);
+		if (sockfd < 0) {
+			ret = sockfd;
+			break;
+		}
+		ret = wiznet_bind(sockfd, srcport);
+		if (ret < 0) {
+			wiznet_close(sockfd);
+			break;
+		}
+		pool->members |= 1 << sockfd;
+		count++;
+	}
+
+	if (!count) {
+		wiznet_debug4_printf("%s: No socket could be bound to port %u (%d)\n", funcname, srcport, ret);
+		return ret;
+	}
+	if (ret < 0)
+		wiznet_debug4_printf("%s: Pool on port %u short of sockets (%d)\n", funcname, srcport, ret);
+	return count;
+}
+
+int wiznet_pool_accept(WIZNETListenPool *pool)
+{
+	uint8_t ir2 = 0, bit, i;
+	int sockfd;
+
+	#if WIZNET_DEBUG > 4
+	const char *funcname = "wiznet_pool_accept()";
+	#endif
+
+	// Only listening members with an IRQ pending are worth a snapshot
+	if (pool->members & ~(pool->busy | pool->arming))
+		ir2 = wiznet_r_reg(W52_IR2);
+
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		sockfd = (pool->next + i) % W52_MAX_SOCKETS;  // Round-robin so one busy socket can't starve the rest
+		bit = 1 << sockfd;
+		if ( !(pool->members & bit) || (pool->busy & bit) )
+			continue;
+
+		if (pool->arming & bit) {
+			if (_wiznet_pool_rearm(pool, sockfd, wiznet_r_sockreg(sockfd, W52_SOCK_SR)) == 0)
+				wiznet_debug5_printf("%s: Socket %d back in LISTEN\n", funcname, sockfd);
+			continue;
+		}
+
+		if ( (ir2 & bit) && wiznet_accept(sockfd) == 0 ) {
+			pool->busy |= bit;
+			pool->next = (sockfd + 1) % W52_MAX_SOCKETS;
+			wiznet_debug5_printf("%s: Socket %d accepted on port %u\n", funcname, sockfd, pool->port);
+			return sockfd;
+		}
+	}
+	return -EAGAIN;
+}
+
+int wiznet_pool_release(WIZNETListenPool *pool, int sockfd)
+{
+	WIZNETSockSnapshot snap;
+	#if W52_SOCKOPT
+	int ret;
+	#endif
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_pool_release()";
+	#endif
+
+	if ( sockfd < 0 || sockfd >= W52_MAX_SOCKETS || !(pool->members & (1 << sockfd)) ) {
+		wiznet_debug4_printf("%s: Socket %d is not in the pool\n", funcname, sockfd);
+		return -EBADF;
+	}
+	if ( !(pool->busy & (1 << sockfd)) )
+		return 0;
+	pool->busy &= ~(1 << sockfd);
+
+	/* A disconnect seen by wiznet_recv()/wiznet_send() has already quickbound the socket, and a new
+	 * client may have connected since; leave either for wiznet_pool_accept().
+	 */
+	wiznet_sock_snapshot(sockfd, &snap);
+	if (snap.sr == W52_SOCK_SR_SOCK_LISTEN || (snap.ir & W52_SOCK_IR_CON))
+		return 0;
+
+	wiznet_debug5_printf("%s: Socket %d released (SR=%x); re-arming\n", funcname, sockfd, snap.sr);
+	if (snap.sr == W52_SOCK_SR_SOCK_ESTABLISHED || snap.sr == W52_SOCK_SR_SOCK_CLOSE_WAIT) {
+		#if W52_SOCKOPT
+		ret = _wiznet_cork_drain(sockfd);
+		if (ret < 0)
+			return ret;  // Connection already gone (and quickbound)
+		#endif
+		// Orderly shutdown: FIN goes out after the committed TX data, as in wiznet_close()
+		wiznet_w_command(sockfd, W52_SOCK_CMD_DISCON);
+		pool->arming |= 1 << sockfd;
+		return -EINPROGRESS;
+	}
+	return _wiznet_pool_rearm(pool, sockfd, snap.sr);
+}
+
+int wiznet_pool_close(WIZNETListenPool *pool)
+{
+	int sockfd;
+
+	for (sockfd=0; sockfd < W52_MAX_SOCKETS; sockfd++) {
+		if (pool->members & (1 << sockfd))
+			wiznet_close(sockfd);
+	}
+	pool->members = pool->busy = pool->arming = 0;
+	return 0;
+}
+
+/* Read Sn_IR..Sn_RX_WR in a single burst; the recv/send/accept paths use this instead of separate
+ * IR, SR, TX_RD and RX_WR register reads.
+ */
+int wiznet_sock_snapshot(int sockfd, WIZNETSockSnapshot *snap)
+{
+	uint8_t raw[W52_SOCK_SNAPSHOT_LEN];
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS)
+		return -EBADF;
+
+	wiznet_r_buf(W52_SOCK_REG_RESOLVE(sockfd, W52_SOCK_IR), W52_SOCK_SNAPSHOT_LEN, raw);
+	snap->ir = raw[W52_SOCK_IR - W52_SOCK_IR];
+	snap->sr = raw[W52_SOCK_SR - W52_SOCK_IR];
+	snap->port = wiznet_ntohs(raw + W52_SOCK_SRCPORT - W52_SOCK_IR);
+	snap->dport = wiznet_ntohs(raw + W52_SOCK_DESTPORT - W52_SOCK_IR);
+	snap->tx_fsr = wiznet_ntohs(raw + W52_SOCK_TXFREE_SIZE - W52_SOCK_IR);
+	snap->tx_rd = wiznet_ntohs(raw + W52_SOCK_TX_READPTR - W52_SOCK_IR);
+	snap->tx_wr = wiznet_ntohs(raw + W52_SOCK_TX_WRITEPTR - W52_SOCK_IR);
+	snap->rx_rsr = wiznet_ntohs(raw + W52_SOCK_RX_RECVSIZE - W52_SOCK_IR);
+	snap->rx_rd = wiznet_ntohs(raw + W52_SOCK_RX_READPTR - W52_SOCK_IR);
+	snap->rx_wr = wiznet_ntohs(raw + W52_SOCK_RX_WRITEPTR - W52_SOCK_IR);
+	return 0;
+}
+
+// Snapshot-based equivalents of wiznet_recvsize() and wiznet_read_virtual_fsr()
+static uint16_t _wiznet_snap_recvsize(int sockfd, const WIZNETSockSnapshot *snap)
+{
+	uint16_t rx_wr, rx_rd;
+
+	rx_wr = snap->rx_wr & W52_SOCK_RXMASK(sockfd);
+	rx_rd = w52_sockets[sockfd].rx_rd & W52_SOCK_RXMASK(sockfd);
+	if (rx_rd > rx_wr)
+		rx_wr += W52_SOCK_RXSIZE(sockfd);
+	W52_BUFPOL_RXLEVEL(sockfd, rx_wr - rx_rd);
+	return (rx_wr - rx_rd);
+}
+
+static uint16_t _wiznet_snap_fsr(int sockfd, const WIZNETSockSnapshot *snap)
+{
+	uint16_t tx_rd, tx_wr;
+
+	tx_rd = snap->tx_rd & W52_SOCK_TXMASK(sockfd);
+	tx_wr = w52_sockets[sockfd].tx_wr & W52_SOCK_TXMASK(sockfd);
+	if (tx_wr >= tx_rd)
+		tx_rd += W52_SOCK_TXSIZE(sockfd);
+	W52_BUFPOL_TXLEVEL(sockfd, W52_SOCK_TXSIZE(sockfd) - (tx_rd - tx_wr));
+	return tx_rd - tx_wr;
+}
+
+/* Multi-socket readiness
+ * Every listed socket costs one register snapshot frame, which yields IR, SR, RX size and TX free together;
+ * all ready sockets are reported in one call.  Level conditions (data waiting, TX room, connected) are
+ * reported whether or not an interrupt fired, and nothing is acknowledged: the recv/send/accept calls
+ * that follow clear the IR bits as usual.
+ * With do_sleep set and nothing ready, the CPU waits in WIZNET_CPU_WAIT until an interrupt (the W5200 IRQ
+ * line, or a timer the application runs) wakes it, then rescans once; IR2 is read first so we don't sleep
+ * while the IRQ line is already held low, as no new edge would come.  Returns the number of sockets with
+ * revents set.
+ */
+int wiznet_poll(WIZNETPollFd *fds, uint8_t nfds, uint8_t do_sleep)
+{
+	uint8_t i, ev, pass;
+	int sockfd, ready;
+	uint16_t fsr;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 4
+	const char *funcname = "wiznet_poll()";
+	#endif
+
+	for (pass=0; ; pass++) {
+		ready = 0;
+		for (i=0; i < nfds; i++) {
+			sockfd = fds[i].sockfd;
+			fds[i].revents = 0;
+			if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS || !w52_sockets[sockfd].mode)
+				continue;
+
+			wiznet_sock_snapshot(sockfd, &snap);
+			ev = 0;
+			if (_wiznet_snap_recvsize(sockfd, &snap))
+				ev |= W52_POLLIN;
+			if (snap.sr == W52_SOCK_SR_SOCK_ESTABLISHED)
+				ev |= W52_POLLCON;
+			if ( (ev & W52_POLLCON) || snap.sr == W52_SOCK_SR_SOCK_CLOSE_WAIT ||
+			     (w52_sockets[sockfd].mode != W52_SOCK_MR_PROTO_TCP && snap.sr != W52_SOCK_SR_SOCK_CLOSED) ) {
+				fsr = _wiznet_snap_fsr(sockfd, &snap);
+				if (fsr && fsr >= fds[i].tx_min)
+					ev |= W52_POLLOUT;
+			}
+			if ( (snap.ir & W52_SOCK_IR_DISCON) || snap.sr == W52_SOCK_SR_SOCK_CLOSE_WAIT )
+				ev |= W52_POLLHUP;
+			if (snap.ir & W52_SOCK_IR_TIMEOUT)
+				ev |= W52_POLLTIMEOUT;
+
+			fds[i].revents = ev & (fds[i].events | W52_POLLHUP | W52_POLLTIMEOUT);  // Like poll(), errors always count
+			if (fds[i].revents)
+				ready++;
+		}
+
+		if (ready || !do_sleep || pass)
+			break;
+
+		/* w5200_irq is only cleared once IR2 reads clear; IRQs pending on other sockets keep INTn low with no
+		 * new edge, so the flag must stay set for wiznet_irq_getsocket() to find them.
+		 */
+		w5200_irq = 0x00;
+		if (wiznet_r_reg(W52_IR2)) {
+			w5200_irq = 0x01;
+			wiznet_debug5_printf("%s: IR2 pending with nothing ready; not sleeping\n", funcname);
+			break;
+		}
+		if (!w5200_irq)
+			WIZNET_CPU_WAIT;
+	}
+	return ready;
+}
+
 int wiznet_accept(int sockfd)
 {
 	uint8_t irq, sr;
+	WIZNETSockSnapshot snap;
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_accept()";
@@ -465,16 +1069,18 @@ int wiznet_accept(int sockfd)
 		return -EPROTONOSUPPORT;
 	}
 
-	irq = wiznet_r_sockreg(sockfd, W52_SOCK_IR);
+	wiznet_sock_snapshot(sockfd, &snap);
+	irq = snap.ir;
 	if (irq & W52_SOCK_IR_CON) {
 		wiznet_w_sockreg(sockfd, W52_SOCK_IR, W52_SOCK_IR_CON);
-		w52_sockets[sockfd].tx_wr = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR);
-		w52_sockets[sockfd].rx_rd = wiznet_r_sockreg16(sockfd, W52_SOCK_RX_READPTR);
+		w52_sockets[sockfd].tx_wr = snap.tx_wr;
+		w52_sockets[sockfd].tx_rd = snap.tx_rd;
+		w52_sockets[sockfd].rx_rd = snap.rx_rd;
 		wiznet_debug5_printf("%s: Socket %d connection accepted, tx_wr/rx_rd loaded\n", funcname, sockfd);
 		// Established!
 		return 0;
 	}
-	sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
+	sr = snap.sr;
 	if (sr == W52_SOCK_SR_SOCK_ESTABLISHED) {
 		wiznet_debug4_printf("%s: Socket %d accept attempted while live connection established!\n", funcname, sockfd);
 		return -EISCONN;
@@ -495,22 +1101,22 @@ int wiznet_accept(int sockfd)
 }
 
 #if WIZNET_DEBUG > 3
-static int _wiznet_check_for_disconnect(int sockfd, const char *funcname)
+static int _wiznet_check_for_disconnect(int sockfd, const WIZNETSockSnapshot *snap, const char *funcname)
 #else
-static int _wiznet_check_for_disconnect(int sockfd)
+static int _wiznet_check_for_disconnect(int sockfd, const WIZNETSockSnapshot *snap)
 #endif
 {
 	uint8_t irq, sr;
 
 	// Disconnect requested from the other end, timeout detected, or socket in process of closing?  Process.
 	if (w52_sockets[sockfd].mode == W52_SOCK_MR_PROTO_TCP) {
-		irq = wiznet_r_sockreg(sockfd, W52_SOCK_IR);
+		irq = snap->ir;
 		if (irq & (W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT)) {
 			wiznet_w_command(sockfd, W52_SOCK_CMD_DISCON);
 			wiznet_w_sockreg(sockfd, W52_SOCK_IR, irq);
 			wiznet_debug5_printf("%s: Socket %d connection closed (%s)\n", funcname, sockfd, (irq & W52_SOCK_IR_TIMEOUT ? "TIMEOUT" : "DISCON"));
 		}
-		sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
+		sr = snap->sr;
 		if (sr != W52_SOCK_SR_SOCK_ESTABLISHED) {
 			if (sr != W52_SOCK_SR_SOCK_LISTEN) {
 				if (w52_sockets[sockfd].is_bind) {
@@ -528,6 +1134,7 @@ int wiznet_recv(int sockfd, void *buf, uint16_t sz, uint8_t do_recv)
 {
 	uint16_t rsz, rsr;
 	int ret;
+	WIZNETSockSnapshot snap;
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_recv()";
@@ -538,7 +1145,8 @@ int wiznet_recv(int sockfd, void *buf, uint16_t sz, uint8_t do_recv)
 		return -EBADF;
 	}
 
-	rsr = wiznet_recvsize(sockfd);
+	wiznet_sock_snapshot(sockfd, &snap);
+	rsr = _wiznet_snap_recvsize(sockfd, &snap);
 	if (rsr) {
 		if (rsr < sz) {
 			wiznet_debug5_printf("%s: Socket %d requested %u, only %u avail\n", funcname, sockfd, sz, rsr);
@@ -552,9 +1160,9 @@ int wiznet_recv(int sockfd, void *buf, uint16_t sz, uint8_t do_recv)
 	}
 
 	#if WIZNET_DEBUG > 3
-	ret = _wiznet_check_for_disconnect(sockfd, funcname);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
 	#else
-	ret = _wiznet_check_for_disconnect(sockfd);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
 	#endif
 	if (ret != 0)
 		return ret;
@@ -567,6 +1175,7 @@ int wiznet_search_recv(int sockfd, void *buf, uint16_t sz, uint8_t searchchar, u
 {
 	uint16_t rsz, rsr;
 	int ret;
+	WIZNETSockSnapshot snap;
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_search_recv()";
@@ -577,7 +1186,8 @@ int wiznet_search_recv(int sockfd, void *buf, uint16_t sz, uint8_t searchchar, u
 		return -EBADF;
 	}
 
-	rsr = wiznet_recvsize(sockfd);
+	wiznet_sock_snapshot(sockfd, &snap);
+	rsr = _wiznet_snap_recvsize(sockfd, &snap);
 	if (rsr) {
 		if (rsr < sz) {
 			wiznet_debug5_printf("%s: Socket %d requested %u, only %u avail\n", funcname, sockfd, sz, rsr);
@@ -592,9 +1202,9 @@ int wiznet_search_recv(int sockfd, void *buf, uint16_t sz, uint8_t searchchar, u
 	}
 
 	#if WIZNET_DEBUG > 3
-	ret = _wiznet_check_for_disconnect(sockfd, funcname);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
 	#else
-	ret = _wiznet_check_for_disconnect(sockfd);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
 	#endif
 	if (ret != 0)
 		return ret;
@@ -603,21 +1213,110 @@ int wiznet_search_recv(int sockfd, void *buf, uint16_t sz, uint8_t searchchar, u
 	return -EAGAIN;
 }
 
-int wiznet_peek(int sockfd, uint16_t offset, void *buf, uint16_t sz)
+/* Multi-byte search: looks for 'needle' (or, with W52_SEARCH_CLASS, any one of its bytes) in up to sz waiting
+ * bytes, reading in small frames and stopping at the match (see wiznet_search_rxbuf_pattern()).  On a match
+ * the data through the end of it is consumed into buf (which must hold sz bytes) and released from the RX
+ * buffer, with RECV if W52_SEARCH_RECV is set; with W52_SEARCH_PEEK nothing is consumed and buf may be NULL.
+ * Returns the length through the end of the match, 0 if the waiting data doesn't contain it yet, or -ENOBUFS
+ * if sz bytes are already waiting without it (the match can no longer fit in buf).
+ */
+int wiznet_search_recv_pattern(int sockfd, void *buf, uint16_t sz, const void *needle, uint8_t nlen, uint8_t flags)
 {
 	uint16_t rsz, rsr;
 	int ret;
+	WIZNETSockSnapshot snap;
 
 	#if WIZNET_DEBUG > 3
-	const char *funcname = "wiznet_peek()";
+	const char *funcname = "wiznet_search_recv_pattern()";
 	#endif
 
 	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
 		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
 		return -EBADF;
 	}
+	if (!nlen || nlen > W52_SEARCH_MAX_NEEDLE || (buf == NULL && !(flags & W52_SEARCH_PEEK)))
+		return -EINVAL;
 
-	rsr = wiznet_recvsize(sockfd);
+	wiznet_sock_snapshot(sockfd, &snap);
+	rsr = _wiznet_snap_recvsize(sockfd, &snap);
+	if (rsr) {
+		rsz = (rsr < sz ? rsr : sz);
+		rsz = wiznet_search_rxbuf_pattern(sockfd, rsz, buf, (const uint8_t *)needle, nlen, flags);
+		if (rsz && !(flags & W52_SEARCH_PEEK))
+			wiznet_commit_rxbuf(sockfd, rsz, flags & W52_SEARCH_RECV);
+		wiznet_debug5_printf("%s: Socket %d searched %u of %u bytes, match ends at %u\n", funcname, sockfd, (rsr < sz ? rsr : sz), rsr, rsz);
+		if (!rsz && rsr >= sz)
+			return -ENOBUFS;
+		return rsz;
+	}
+
+	#if WIZNET_DEBUG > 3
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
+	#else
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
+	#endif
+	if (ret != 0)
+		return ret;
+
+	// This signals that we should try again later; sockets are non-blocking in this library.
+	return -EAGAIN;
+}
+
+/* Zero-copy receive: up to maxlen bytes are passed to visitor() straight off the SPI bus (see
+ * wiznet_visit_r_buf()).  Only the bytes the visitor consumed are released from the RX buffer, and the RECV
+ * command is always issued.  Returns the number of bytes consumed.
+ */
+int wiznet_recv_stream(int sockfd, uint16_t maxlen, WIZNETVisitor visitor, void *ctx)
+{
+	uint16_t rsz, rsr;
+	int ret;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_recv_stream()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	rsr = _wiznet_snap_recvsize(sockfd, &snap);
+	if (rsr) {
+		rsz = (rsr < maxlen ? rsr : maxlen);
+		return wiznet_visit_rxbuf(sockfd, rsz, visitor, ctx, 1);
+	}
+
+	#if WIZNET_DEBUG > 3
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
+	#else
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
+	#endif
+	if (ret != 0)
+		return ret;
+
+	// This signals that we should try again later; sockets are non-blocking in this library.
+	return -EAGAIN;
+}
+
+int wiznet_peek(int sockfd, uint16_t offset, void *buf, uint16_t sz)
+{
+	uint16_t rsz, rsr;
+	int ret;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_peek()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	rsr = _wiznet_snap_recvsize(sockfd, &snap);
 	if (rsr) {
 		if (rsr <= offset) {
 			wiznet_debug5_printf("%s: Socket %d attempted to peek beyond end (offset=%u, rsr=%u)\n", funcname, sockfd, offset, rsr);
@@ -635,9 +1334,9 @@ int wiznet_peek(int sockfd, uint16_t offset, void *buf, uint16_t sz)
 	}
 
 	#if WIZNET_DEBUG > 3
-	ret = _wiznet_check_for_disconnect(sockfd, funcname);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
 	#else
-	ret = _wiznet_check_for_disconnect(sockfd);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
 	#endif
 	if (ret != 0)
 		return ret;
@@ -650,6 +1349,7 @@ int wiznet_flush(int sockfd, uint16_t sz, uint8_t do_recv)
 {
 	uint16_t rsz, rsr;
 	int ret;
+	WIZNETSockSnapshot snap;
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_peek()";
@@ -660,7 +1360,8 @@ int wiznet_flush(int sockfd, uint16_t sz, uint8_t do_recv)
 		return -EBADF;
 	}
 
-	rsr = wiznet_recvsize(sockfd);
+	wiznet_sock_snapshot(sockfd, &snap);
+	rsr = _wiznet_snap_recvsize(sockfd, &snap);
 	if (rsr) {
 		if (rsr < sz) {
 			rsz = rsr;
@@ -674,9 +1375,9 @@ int wiznet_flush(int sockfd, uint16_t sz, uint8_t do_recv)
 	}
 
 	#if WIZNET_DEBUG > 3
-	ret = _wiznet_check_for_disconnect(sockfd, funcname);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
 	#else
-	ret = _wiznet_check_for_disconnect(sockfd);
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
 	#endif
 	if (ret != 0)
 		return ret;
@@ -685,6 +1386,166 @@ int wiznet_flush(int sockfd, uint16_t sz, uint8_t do_recv)
 	return -EAGAIN;
 }
 
+/* Buffered reader
+ * Parsers that pull a packet apart a few bytes at a time would pay a register snapshot, a data frame and an
+ * RX_RD write for every field with wiznet_recv().  wiznet_reader_begin() takes one snapshot; reads, peeks
+ * and skips are then served from a W52_READER_WINDOW-byte window refilled in one burst from the RX buffer
+ * (wiznet_peek_rxbuf(), which leaves the chip pointers alone).  Nothing is released until
+ * wiznet_reader_commit() writes RX_RD once and optionally issues RECV.  The reader only sees the data that
+ * was waiting when it began.
+ */
+int wiznet_reader_begin(WIZNETReader *rd, int sockfd)
+{
+	uint16_t rsr;
+	int ret;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_reader_begin()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	rd->sockfd = sockfd;
+	rd->avail = rd->fetched = 0;
+	rd->pos = rd->len = 0;
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	rsr = _wiznet_snap_recvsize(sockfd, &snap);
+	if (rsr) {
+		rd->avail = rsr;
+		return rsr;
+	}
+
+	#if WIZNET_DEBUG > 3
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
+	#else
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
+	#endif
+	if (ret != 0)
+		return ret;
+
+	return -EAGAIN;
+}
+
+// Move the unread bytes to the front of the window and top it up; returns the number of bytes held
+static uint8_t _wiznet_reader_fill(WIZNETReader *rd)
+{
+	uint16_t n;
+
+	if (rd->pos) {
+		memmove(rd->window, rd->window + rd->pos, rd->len - rd->pos);
+		rd->len -= rd->pos;
+		rd->pos = 0;
+	}
+	n = W52_READER_WINDOW - rd->len;
+	if (n > rd->avail - rd->fetched)
+		n = rd->avail - rd->fetched;
+	if (n) {
+		wiznet_peek_rxbuf(rd->sockfd, rd->fetched, n, rd->window + rd->len);
+		rd->fetched += n;
+		rd->len += n;
+	}
+	return rd->len;
+}
+
+/* Returns the number of bytes copied, which is short only at the end of the data, or -EAGAIN if
+ * there was nothing left at all.
+ */
+int wiznet_reader_read(WIZNETReader *rd, void *buf, uint16_t len)
+{
+	uint8_t *bufptr = (uint8_t *)buf;
+	uint16_t n, total = 0;
+
+	while (total < len) {
+		if (rd->pos == rd->len) {
+			n = len - total;
+			if (n >= W52_READER_WINDOW) {
+				// Window is empty and the rest won't fit it anyway; copy straight from the RX buffer
+				if (n > rd->avail - rd->fetched)
+					n = rd->avail - rd->fetched;
+				if (!n)
+					break;
+				wiznet_peek_rxbuf(rd->sockfd, rd->fetched, n, bufptr + total);
+				rd->fetched += n;
+				total += n;
+				continue;
+			}
+			if (!_wiznet_reader_fill(rd))
+				break;
+		}
+		n = rd->len - rd->pos;
+		if (n > len - total)
+			n = len - total;
+		memcpy(bufptr + total, rd->window + rd->pos, n);
+		rd->pos += n;
+		total += n;
+	}
+
+	if (len && !total)
+		return -EAGAIN;
+	return total;
+}
+
+// Look ahead without consuming; at most W52_READER_WINDOW bytes
+int wiznet_reader_peek(WIZNETReader *rd, void *buf, uint16_t len)
+{
+	uint16_t n;
+
+	if (len > W52_READER_WINDOW)
+		return -EINVAL;
+	if (rd->len - rd->pos < len)
+		_wiznet_reader_fill(rd);
+
+	n = rd->len - rd->pos;
+	if (n > len)
+		n = len;
+	if (len && !n)
+		return -EAGAIN;
+	memcpy(buf, rd->window + rd->pos, n);
+	return n;
+}
+
+// Skipping past the window just moves the fetch offset; no SPI traffic.  Returns the number of bytes skipped.
+uint16_t wiznet_reader_skip(WIZNETReader *rd, uint16_t len)
+{
+	uint16_t n, total;
+
+	n = rd->len - rd->pos;
+	if (n > len)
+		n = len;
+	rd->pos += n;
+	total = n;
+
+	if (total < len) {
+		n = len - total;
+		if (n > rd->avail - rd->fetched)
+			n = rd->avail - rd->fetched;
+		rd->fetched += n;
+		total += n;
+	}
+	return total;
+}
+
+/* Release everything read or skipped so far.  The reader stays usable; its offsets are rebased onto the
+ * new RX_RD.  Returns the number of bytes released.
+ */
+uint16_t wiznet_reader_commit(WIZNETReader *rd, uint8_t do_recv)
+{
+	uint16_t consumed;
+
+	consumed = rd->fetched - (rd->len - rd->pos);
+	if (consumed) {
+		wiznet_commit_rxbuf(rd->sockfd, consumed, do_recv);
+		rd->avail -= consumed;
+		rd->fetched -= consumed;
+	}
+	return consumed;
+}
+
 // Variant of wiznet_recv() with auto-fill-in of source IP/port - Reads UDP and IPRAW preambles
 int wiznet_recvfrom(int sockfd, void *buf, uint16_t sz, uint16_t *srcaddr, uint16_t *srcport, uint8_t do_recv)
 {
@@ -801,6 +1662,7 @@ int wiznet_txcommit(int sockfd)
 {
 	uint16_t tsz, tx_rdring, tx_rdring2;
 	uint8_t irq;
+	WIZNETSockSnapshot snap;
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_txcommit()";
@@ -808,19 +1670,27 @@ int wiznet_txcommit(int sockfd)
 
 	// Committing the whole TX buffer-
 	tsz = wiznet_read_virtual_tsz(sockfd);
-	tx_rdring = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_READPTR) & W52_SOCK_MEM_MASK;
-
-	// Send data and continue sending until TX buffer is fully flushed
-	wiznet_w_command(sockfd, W52_SOCK_CMD_SEND);
+	tx_rdring = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_READPTR) & W52_SOCK_TXMASK(sockfd);
+
+	// Send data and continue sending until TX buffer is fully flushed; an async SEND in flight is just waited on
+	if (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT)
+		wiznet_w_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR, w52_sockets[sockfd].tx_wr);  // Held back during the flight
+	else
+		wiznet_w_command(sockfd, W52_SOCK_CMD_SEND);
+	w52_sockets[sockfd].tx_state = 0;
+	#if W52_SOCKOPT
+	w52_sockets[sockfd].cork_held = 0;
+	#endif
 	do {
-		irq = wiznet_r_sockreg(sockfd, W52_SOCK_IR);
+		wiznet_sock_snapshot(sockfd, &snap);  // IR and TX_RD in one frame
+		irq = snap.ir;
 		if (!irq && !w5200_irq)  // If other IRQs are waiting, we can't sleep here b/c the IRQ line won't get pulsed
 			__delay_cycles(1000);
 
 		if (irq & W52_SOCK_IR_SEND_OK) {
-			tx_rdring2 = wiznet_r_sockreg16(sockfd, W52_SOCK_TX_READPTR) & W52_SOCK_MEM_MASK;
+			tx_rdring2 = snap.tx_rd & W52_SOCK_TXMASK(sockfd);
 			if (tx_rdring2 < tx_rdring)  // Ring buffer wrap-around
-				tsz -= (W52_SOCK_MEM_SIZE + tx_rdring2) - tx_rdring;
+				tsz -= (W52_SOCK_TXSIZE(sockfd) + tx_rdring2) - tx_rdring;
 			else
 				tsz -= tx_rdring2 - tx_rdring;
 			tx_rdring = tx_rdring2;
@@ -840,13 +1710,194 @@ int wiznet_txcommit(int sockfd)
 			return (irq & W52_SOCK_IR_DISCON ? -ECONNABORTED : -ETIMEDOUT);
 		}
 	} while (tsz);
+	w52_sockets[sockfd].tx_rd = w52_sockets[sockfd].tx_wr;
 	return 0;  // Success
 }
 
+/* SEND everything up to the committed end.  Sn_TX_WR is moved there first, since a chained SEND must not
+ * pick up data written without a commit while the previous one was in flight (see wiznet_txbuf_advance()).
+ */
+static void _wiznet_tx_send(int sockfd)
+{
+	if (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT)
+		wiznet_w_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR, w52_sockets[sockfd].tx_commit);
+	w52_sockets[sockfd].tx_sent = w52_sockets[sockfd].tx_commit;
+	w52_sockets[sockfd].tx_state = W52_TX_INFLIGHT;
+	wiznet_w_command(sockfd, W52_SOCK_CMD_SEND);
+}
+
+// Commit everything written so far: SEND now, or flag it for the chain if a SEND is already in flight
+static void _wiznet_tx_queue(int sockfd)
+{
+	w52_sockets[sockfd].tx_commit = w52_sockets[sockfd].tx_wr;
+	#if W52_SOCKOPT
+	w52_sockets[sockfd].cork_held = 0;
+	#endif
+	if (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT)
+		w52_sockets[sockfd].tx_state |= W52_TX_PENDING;
+	else if (w52_sockets[sockfd].tx_rd != w52_sockets[sockfd].tx_wr)
+		_wiznet_tx_send(sockfd);
+}
+
+#if W52_SOCKOPT
+/* Auto-cork
+ * With W52_SO_CORK set, a committing wiznet_send()/wiznet_sendv() on a TCP socket only writes to the TX ring;
+ * the held data is committed (through the wiznet_txcommit_async() chain) once a full segment has built up,
+ * once it has waited W52_SO_CORK ticks (see wiznet_cork_poll()), or by an explicit wiznet_txcommit() or
+ * wiznet_txcommit_async().
+ */
+
+static int _wiznet_cork(int sockfd)
+{
+	uint16_t held, seg;
+
+	held = _wiznet_tx_held(sockfd);
+	seg = (w52_sockets[sockfd].opts.mss ? w52_sockets[sockfd].opts.mss : W52_CORK_SEGMENT);
+	if (seg > W52_SOCK_TXSIZE(sockfd) / 2)
+		seg = W52_SOCK_TXSIZE(sockfd) / 2;  // Small rings: don't let held data fill them
+	if (held >= seg)
+		_wiznet_tx_queue(sockfd);
+	return 0;  // Otherwise the delay runs from the first held byte (cork_held, set by the TX ring writers)
+}
+
+// Call at a fixed rate, e.g. from a timer ISR; no SPI traffic
+void wiznet_cork_tick()
+{
+	uint8_t i;
+
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		if (w52_sockets[i].cork_age < 0xFF)
+			w52_sockets[i].cork_age++;
+	}
+}
+
+/* Call from the main loop: commits held data whose delay has run out and keeps each corked socket's SEND
+ * chain going.  Returns the number of sockets committed.
+ */
+int wiznet_cork_poll()
+{
+	int i, count = 0;
+
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		if (w52_sockets[i].mode != W52_SOCK_MR_PROTO_TCP || !w52_sockets[i].opts.cork)
+			continue;
+		if ( (w52_sockets[i].tx_state & W52_TX_INFLIGHT) && wiznet_tx_poll(i) < 0 )
+			continue;
+		if (_wiznet_tx_held(i) && w52_sockets[i].cork_age >= w52_sockets[i].opts.cork) {
+			_wiznet_tx_queue(i);
+			count++;
+		}
+	}
+	return count;
+}
+#endif
+
+/* Asynchronous commit
+ * Issues SEND for everything written so far and returns at once.  wiznet_tx_poll(), called when the socket
+ * interrupts (see wiznet_irq_getsocket()) or periodically, handles SEND_OK and chains the next SEND while
+ * committed data remains.  The application can keep writing to the TX buffer meanwhile; data committed while
+ * a SEND is in flight goes out with the next SEND in the chain, and data written without a commit stays
+ * behind until the next commit.  On UDP/IPRAW/MACRAW each SEND is one datagram, so a second commit while one
+ * is in flight is refused with -EBUSY rather than merged into the next.
+ */
+int wiznet_txcommit_async(int sockfd)
+{
+	int ret;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_txcommit_async()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	if (w52_sockets[sockfd].tx_state & W52_TX_INFLIGHT) {
+		if (w52_sockets[sockfd].mode != W52_SOCK_MR_PROTO_TCP) {
+			wiznet_debug4_printf("%s: Socket %d has a datagram in flight\n", funcname, sockfd);
+			return -EBUSY;
+		}
+		_wiznet_tx_queue(sockfd);
+		return 0;
+	}
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	#if WIZNET_DEBUG > 3
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
+	#else
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
+	#endif
+	if (ret != 0)
+		return ret;
+
+	w52_sockets[sockfd].tx_rd = snap.tx_rd;
+	_wiznet_tx_queue(sockfd);
+	return 0;
+}
+
+/* Returns the number of committed bytes not yet acknowledged by SEND_OK (0 once everything is out), or
+ * -ECONNABORTED/-ETIMEDOUT if the connection went down.  With a SEND in flight the rest is then dropped and
+ * the socket shut down as wiznet_txcommit() would; with nothing in flight the state is only reported and
+ * the interrupt left for the application's own recv()/send() to handle, as unread data may remain.
+ */
+int wiznet_tx_poll(int sockfd)
+{
+	uint8_t irq, state;
+	uint16_t end;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_tx_poll()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	irq = snap.ir;
+	state = w52_sockets[sockfd].tx_state;
+	if ( (irq & (W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT)) && !(state & W52_TX_INFLIGHT) )
+		return (irq & W52_SOCK_IR_DISCON ? -ECONNABORTED : -ETIMEDOUT);
+	if (irq & (W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT)) {
+		w52_sockets[sockfd].tx_state = 0;
+		wiznet_w_command(sockfd, W52_SOCK_CMD_DISCON);
+		wiznet_w_sockreg(sockfd, W52_SOCK_IR, irq);
+		wiznet_debug5_printf("%s: Socket %d closed (%s)\n", funcname, sockfd, (irq & W52_SOCK_IR_TIMEOUT ? "TIMEOUT" : "DISCON"));
+		if (w52_sockets[sockfd].is_bind) {
+			wiznet_quickbind(sockfd);
+			wiznet_debug5_printf("%s: Socket %d not open but is_bind=1; quickbinding\n", funcname, sockfd);
+		}
+		return (irq & W52_SOCK_IR_DISCON ? -ECONNABORTED : -ETIMEDOUT);
+	}
+
+	w52_sockets[sockfd].tx_rd = snap.tx_rd;
+	if (!(state & W52_TX_INFLIGHT))
+		return 0;
+
+	end = (state & W52_TX_PENDING ? w52_sockets[sockfd].tx_commit : w52_sockets[sockfd].tx_sent);
+	if (irq & W52_SOCK_IR_SEND_OK) {
+		wiznet_w_sockreg(sockfd, W52_SOCK_IR, W52_SOCK_IR_SEND_OK);
+		if (snap.tx_rd != end) {
+			_wiznet_tx_send(sockfd);  // Partial send, or more was committed meanwhile
+		} else {
+			w52_sockets[sockfd].tx_state = 0;
+			if (w52_sockets[sockfd].tx_wr != end)  // Uncommitted data written during the flight; no SEND
+				wiznet_w_sockreg16(sockfd, W52_SOCK_TX_WRITEPTR, w52_sockets[sockfd].tx_wr);
+			wiznet_debug5_printf("%s: Socket %d TX complete\n", funcname, sockfd);
+		}
+	}
+	return (uint16_t)(end - snap.tx_rd);
+}
+
 int wiznet_send(int sockfd, void *buf, uint16_t sz, uint8_t do_commit)
 {
 	uint16_t fsr;
 	uint8_t irq, sr;
+	WIZNETSockSnapshot snap;
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_send()";
@@ -864,7 +1915,8 @@ int wiznet_send(int sockfd, void *buf, uint16_t sz, uint8_t do_commit)
 	}
 
 	// Disconnect requested or timeout detected?
-	irq = wiznet_r_sockreg(sockfd, W52_SOCK_IR);
+	wiznet_sock_snapshot(sockfd, &snap);
+	irq = snap.ir;
 	if (irq & (W52_SOCK_IR_DISCON | W52_SOCK_IR_TIMEOUT)) {
 		wiznet_w_command(sockfd, W52_SOCK_CMD_DISCON);
 		wiznet_w_sockreg(sockfd, W52_SOCK_IR, irq);
@@ -876,10 +1928,10 @@ int wiznet_send(int sockfd, void *buf, uint16_t sz, uint8_t do_commit)
 		return (irq & W52_SOCK_IR_DISCON ? -ECONNABORTED : -ETIMEDOUT);
 	}
 
-	sr = wiznet_r_sockreg(sockfd, W52_SOCK_SR);
+	sr = snap.sr;
 	if (sr != W52_SOCK_SR_SOCK_ESTABLISHED)
 		return -ENOTCONN;
-	fsr = wiznet_read_virtual_fsr(sockfd);
+	fsr = _wiznet_snap_fsr(sockfd, &snap);
 	if (fsr < sz) {
 		wiznet_debug4_printf("%s: Socket %d attempting to write %u (TX free = %u)!\n", funcname, sockfd, sz, fsr);
 		return -ENFILE;  // Too much for the buffer!
@@ -887,12 +1939,317 @@ int wiznet_send(int sockfd, void *buf, uint16_t sz, uint8_t do_commit)
 
 	wiznet_w_txbuf(sockfd, sz, buf);
 
+	#if W52_SOCKOPT
+	if (do_commit && w52_sockets[sockfd].opts.cork)
+		return _wiznet_cork(sockfd);
+	#endif
 	if (do_commit)
 		return wiznet_txcommit(sockfd);
 
 	return 0;
 }
 
+/* Partial write, like POSIX write() on a non-blocking socket: queues as much of buf as the TX ring has
+ * room for and returns that count, or -EAGAIN if the ring is full.  With do_commit the data goes out
+ * through the wiznet_txcommit_async() chain, so nothing here waits on SEND_OK.
+ */
+int wiznet_send_partial(int sockfd, void *buf, uint16_t sz, uint8_t do_commit)
+{
+	uint16_t fsr;
+	int ret;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_send_partial()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	if (w52_sockets[sockfd].mode != W52_SOCK_MR_PROTO_TCP) {
+		wiznet_debug4_printf("%s: Attempted on socket %d with protocol = %u (TCP only)\n", funcname, sockfd, w52_sockets[sockfd].mode);
+		return -EPROTONOSUPPORT;
+	}
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	#if WIZNET_DEBUG > 3
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
+	#else
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
+	#endif
+	if (ret != 0)
+		return ret;
+
+	w52_sockets[sockfd].tx_rd = snap.tx_rd;
+	fsr = _wiznet_snap_fsr(sockfd, &snap);
+	if (sz > fsr)
+		sz = fsr;
+	if (!sz)
+		return (fsr ? 0 : -EAGAIN);
+
+	wiznet_w_txbuf(sockfd, sz, buf);
+	if (do_commit)
+		_wiznet_tx_queue(sockfd);
+	return sz;
+}
+
+/* Blocking send of any size: refills the TX ring as SEND_OK frees space, with wiznet_tx_poll() chaining
+ * the next SEND the moment the previous one completes, so the W5200 always has data queued.  Returns once
+ * the last of buf is in the ring and covered by a SEND (the final SEND_OK is left to wiznet_tx_poll() or
+ * a later wiznet_txcommit()).  Returns sz, or the bytes accepted before the connection failed; the error
+ * itself if none were.
+ */
+int wiznet_send_stream(int sockfd, void *buf, uint16_t sz)
+{
+	uint16_t done = 0, tx_rd;
+	int ret = 0;
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS)
+		return -EBADF;
+
+	while (done < sz || (w52_sockets[sockfd].tx_state & W52_TX_PENDING)) {
+		if (done < sz) {
+			ret = wiznet_send_partial(sockfd, (uint8_t *)buf + done, sz - done, 1);
+			if (ret > 0) {
+				done += ret;
+				continue;
+			}
+			if (ret != -EAGAIN)
+				break;
+			_wiznet_tx_queue(sockfd);  // Ring may be full of data written earlier without a commit
+		}
+
+		// Ring full, or the tail not yet under a SEND: wait for SEND_OK
+		tx_rd = w52_sockets[sockfd].tx_rd;
+		ret = wiznet_tx_poll(sockfd);
+		if (ret < 0)
+			break;
+		if (ret && w52_sockets[sockfd].tx_rd == tx_rd && !w5200_irq)
+			__delay_cycles(1000);  // No progress; can't sleep, as in wiznet_txcommit()
+	}
+
+	if (ret < 0 && !done)
+		return ret;
+	return done;
+}
+
+/* Scatter-gather send for TCP, UDP and IPRAW; UDP/IPRAW destinations are set beforehand with
+ * wiznet_sendto(sockfd, NULL, 0, address, dport, 0).
+ */
+int wiznet_sendv(int sockfd, const WIZNETIOVec *iov, uint8_t iovcnt, uint8_t do_commit)
+{
+	uint16_t sz, fsr;
+	int ret;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_sendv()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	switch (w52_sockets[sockfd].mode) {
+		case W52_SOCK_MR_PROTO_TCP:
+		case W52_SOCK_MR_PROTO_UDP:
+		case W52_SOCK_MR_PROTO_IPRAW:
+			break;
+		default:
+			wiznet_debug4_printf("%s: Socket %d attempted with protocol = %u (TCP, UDP, IPRAW only)\n", funcname, sockfd, w52_sockets[sockfd].mode);
+			return -EPROTONOSUPPORT;
+	}
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	#if WIZNET_DEBUG > 3
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
+	#else
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
+	#endif
+	if (ret != 0)
+		return ret;
+
+	sz = wiznet_iov_len(iov, iovcnt);
+	fsr = _wiznet_snap_fsr(sockfd, &snap);
+	if (fsr < sz) {
+		wiznet_debug4_printf("%s: Socket %d attempting to write %u (TX free = %u)!\n", funcname, sockfd, sz, fsr);
+		return -ENFILE;  // Too much for the buffer!
+	}
+
+	wiznet_w_txbufv(sockfd, iov, iovcnt);
+
+	#if W52_SOCKOPT
+	if (do_commit && w52_sockets[sockfd].opts.cork && w52_sockets[sockfd].mode == W52_SOCK_MR_PROTO_TCP)
+		return _wiznet_cork(sockfd);
+	#endif
+	if (do_commit)
+		return wiznet_txcommit(sockfd);
+
+	return 0;
+}
+
+/* Zero-copy send of computed content: producer() writes up to len_hint bytes, in small pieces, straight into
+ * the SPI frame feeding the TX buffer (see wiznet_generate_txbuf()); it runs with the chip selected and must
+ * not do SPI I/O.  Less is taken if the TX buffer has less room; call again to continue.  Returns the number
+ * of bytes produced.  do_commit goes through the auto-cork like wiznet_send().
+ */
+int wiznet_send_generate(int sockfd, uint16_t len_hint, WIZNETProducer producer, void *ctx, uint8_t do_commit)
+{
+	uint16_t fsr, sz;
+	int ret;
+	WIZNETSockSnapshot snap;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_send_generate()";
+	#endif
+
+	if (sockfd < 0 || sockfd >= W52_MAX_SOCKETS) {
+		wiznet_debug4_printf("%s: Invalid socket %d specified\n", funcname, sockfd);
+		return -EBADF;
+	}
+
+	switch (w52_sockets[sockfd].mode) {
+		case W52_SOCK_MR_PROTO_TCP:
+		case W52_SOCK_MR_PROTO_UDP:
+		case W52_SOCK_MR_PROTO_IPRAW:
+			break;
+		default:
+			wiznet_debug4_printf("%s: Socket %d attempted with protocol = %u (TCP, UDP, IPRAW only)\n", funcname, sockfd, w52_sockets[sockfd].mode);
+			return -EPROTONOSUPPORT;
+	}
+
+	wiznet_sock_snapshot(sockfd, &snap);
+	#if WIZNET_DEBUG > 3
+	ret = _wiznet_check_for_disconnect(sockfd, &snap, funcname);
+	#else
+	ret = _wiznet_check_for_disconnect(sockfd, &snap);
+	#endif
+	if (ret != 0)
+		return ret;
+
+	fsr = _wiznet_snap_fsr(sockfd, &snap);
+	if (!fsr)
+		return -EAGAIN;  // TX buffer full; try again once some of it has gone out
+	sz = (len_hint < fsr ? len_hint : fsr);
+	sz = wiznet_generate_txbuf(sockfd, sz, producer, ctx);
+	wiznet_debug5_printf("%s: Socket %d produced %u of %u bytes\n", funcname, sockfd, sz, len_hint);
+
+	if (!do_commit || !sz)
+		return sz;
+	#if W52_SOCKOPT
+	if (w52_sockets[sockfd].opts.cork && w52_sockets[sockfd].mode == W52_SOCK_MR_PROTO_TCP) {
+		_wiznet_cork(sockfd);
+		return sz;
+	}
+	#endif
+	ret = wiznet_txcommit(sockfd);
+	if (ret < 0)
+		return ret;
+	return sz;
+}
+
+/* Buffered writer
+ * Small writes are staged in a W52_WRITER_BUFSIZE-byte RAM buffer instead of each costing a register
+ * snapshot, a data frame and a TX_WR write.  A write that doesn't fit goes out together with whatever is
+ * staged in one wiznet_sendv() (one TX_WR update), so large blocks are never copied through the buffer.
+ * Nothing is sent until the buffer overflows, wiznet_writer_flush() or wiznet_writer_commit().
+ * If a flush fails (e.g. -ENFILE with the TX buffer full) the staged bytes are kept and may be retried.
+ * Works on TCP, UDP and IPRAW sockets; set the UDP/IPRAW destination beforehand as with wiznet_sendv().
+ */
+void wiznet_writer_begin(WIZNETWriter *w, int sockfd)
+{
+	w->sockfd = sockfd;
+	w->len = 0;
+}
+
+int wiznet_writer_flush(WIZNETWriter *w)
+{
+	WIZNETIOVec iov;
+	int ret;
+
+	if (!w->len)
+		return 0;
+	iov.base = w->buf;
+	iov.len = w->len;
+	if ( (ret = wiznet_sendv(w->sockfd, &iov, 1, 0)) < 0 )
+		return ret;
+	w->len = 0;
+	return 0;
+}
+
+int wiznet_writer_commit(WIZNETWriter *w)
+{
+	int ret;
+
+	if ( (ret = wiznet_writer_flush(w)) < 0 )
+		return ret;
+	return wiznet_txcommit(w->sockfd);
+}
+
+// Returns the number of bytes accepted, or a negative error from the flush
+int wiznet_writer_write(WIZNETWriter *w, const void *buf, uint16_t len)
+{
+	WIZNETIOVec iov[2];
+	int ret;
+
+	if (len <= W52_WRITER_BUFSIZE - w->len) {
+		if (buf != NULL)
+			memcpy(w->buf + w->len, buf, len);
+		else
+			memset(w->buf + w->len, 0, len);
+		w->len += len;
+		return len;
+	}
+
+	iov[0].base = w->buf;
+	iov[0].len = w->len;
+	iov[1].base = buf;
+	iov[1].len = len;
+	if ( (ret = wiznet_sendv(w->sockfd, iov, 2, 0)) < 0 )
+		return ret;
+	w->len = 0;
+	return len;
+}
+
+int wiznet_writer_putc(WIZNETWriter *w, uint8_t c)
+{
+	int ret;
+
+	if (w->len == W52_WRITER_BUFSIZE) {
+		if ( (ret = wiznet_writer_flush(w)) < 0 )
+			return ret;
+	}
+	w->buf[w->len++] = c;
+	return 1;
+}
+
+int wiznet_writer_puts(WIZNETWriter *w, const char *str)
+{
+	return wiznet_writer_write(w, str, strlen(str));
+}
+
+static int _wiznet_writer_out(void *w, uint8_t c)
+{
+	return wiznet_writer_putc((WIZNETWriter *)w, c);
+}
+
+/* printf-lite with the same conversions as wiznet_debug_printf(); output is staged like any other write.
+ * Returns 0, or the first negative error from a flush.
+ */
+int wiznet_writer_printf(WIZNETWriter *w, const char *format, ...)
+{
+	va_list a;
+	int ret;
+
+	va_start(a, format);
+	ret = wiznet_vformat(_wiznet_writer_out, w, format, a);
+	va_end(a);
+	return ret;
+}
+
 int wiznet_sendto(int sockfd, void *buf, uint16_t sz, uint16_t *address, uint16_t dport, uint8_t do_commit)
 {
 
@@ -905,7 +2262,7 @@ int wiznet_sendto(int sockfd, void *buf, uint16_t sz, uint16_t *address, uint16_
 		return -EBADF;
 	}
 
-	if (sz > W52_SOCK_MEM_SIZE) {
+	if (sz > W52_SOCK_TXSIZE(sockfd)) {
 		wiznet_debug4_printf("%s: Socket %d attempting to write more than TX buffer size!\n", funcname, sockfd);
 		return -ENFILE;  // Too much for the buffer!
 	}
@@ -914,8 +2271,10 @@ int wiznet_sendto(int sockfd, void *buf, uint16_t sz, uint16_t *address, uint16_
 		case W52_SOCK_MR_PROTO_UDP:
 		case W52_SOCK_MR_PROTO_IPRAW:
 			if (address != NULL) {
+				wiznet_wc_begin();
 				wiznet_ip_bin_w_sockreg(sockfd, W52_SOCK_DESTIP, address);
 				wiznet_w_sockreg16(sockfd, W52_SOCK_DESTPORT, dport);
+				wiznet_wc_end();
 				wiznet_debug5_printf("%s: Socket %d UDP dest = %u.%u.%u.%u:%u\n", funcname, sockfd,
 					address[0] >> 8, address[0] & 0xFF, address[1] >> 8, address[1] & 0xFF, dport);
 			}
@@ -975,9 +2334,82 @@ int wiznet_mac_sendto(void *buf, uint16_t sz, uint16_t *dstmac, uint16_t framety
 	return 0;
 }
 
+/* Socket buffer memory allocation
+ * rxkb[] and txkb[] hold W52_MAX_SOCKETS buffer sizes in KB (0, 1, 2, 4, 8 or 16); NULL gives every socket
+ * W52_SOCK_MEM_SIZE.  Each side may total at most 16KB and any chip sockets beyond W52_MAX_SOCKETS get
+ * none.  Sockets with no memory are skipped by wiznet_socket().  All sockets must be closed.
+ */
+#if W52_BUF_SIZING
+int wiznet_set_bufsizes(const uint8_t *rxkb, const uint8_t *txkb)
+{
+	int i;
+	uint8_t rx, tx, rxttl = 0, txttl = 0;
+	uint16_t rxbase = W52_RXMEM_BASE, txbase = W52_TXMEM_BASE;
+
+	#if WIZNET_DEBUG > 3
+	const char *funcname = "wiznet_set_bufsizes()";
+	#endif
+
+	for (i=0; i < W52_MAX_SOCKETS; i++) {
+		if (w52_sockets[i].mode) {
+			wiznet_debug4_printf("%s: socket %d is open\n", funcname, i);
+			return -EBUSY;
+		}
+		rx = (rxkb != NULL ? rxkb[i] : W52_SOCK_MEM_SIZE / 1024);
+		tx = (txkb != NULL ? txkb[i] : W52_SOCK_MEM_SIZE / 1024);
+		if (rx > 16 || (rx & (rx-1)) || tx > 16 || (tx & (tx-1))) {
+			wiznet_debug4_printf("%s: socket %d invalid size RX=%uKB TX=%uKB\n", funcname, i, rx, tx);
+			return -EINVAL;
+		}
+		rxttl += rx;
+		txttl += tx;
+	}
+	if (rxttl > 16 || txttl > 16) {
+		wiznet_debug4_printf("%s: total RX=%uKB TX=%uKB exceeds 16KB\n", funcname, rxttl, txttl);
+		return -EINVAL;
+	}
+
+	// The chip lays socket buffers out back to back in socket order; all 8 of its size registers are set.
+	for (i=0; i < 8; i++) {
+		rx = tx = 0;
+		if (i < W52_MAX_SOCKETS) {
+			rx = (rxkb != NULL ? rxkb[i] : W52_SOCK_MEM_SIZE / 1024);
+			tx = (txkb != NULL ? txkb[i] : W52_SOCK_MEM_SIZE / 1024);
+			w52_sockets[i].rx_base = rxbase;
+			w52_sockets[i].rx_size = rx * 1024;
+			w52_sockets[i].tx_base = txbase;
+			w52_sockets[i].tx_size = tx * 1024;
+		}
+		wiznet_w_sockreg16(i, W52_SOCK_RXMEM_SIZE, (rx << 8) | tx);  // Sn_RXMEM_SIZE, Sn_TXMEM_SIZE
+		rxbase += rx * 1024;
+		txbase += tx * 1024;
+		wiznet_debug5_printf("%s: socket %d RX=%uKB TX=%uKB\n", funcname, i, rx, tx);
+	}
+	return 0;
+}
+#else
+// Without W52_BUF_SIZING the layout is fixed at W52_SOCK_MEM_SIZE per socket; only NULL (the default) is accepted
+int wiznet_set_bufsizes(const uint8_t *rxkb, const uint8_t *txkb)
+{
+	int i;
+	uint8_t kb;
+
+	if (rxkb != NULL || txkb != NULL)
+		return -EINVAL;
+	for (i=0; i < 8; i++) {
+		kb = (i < W52_MAX_SOCKETS ? W52_SOCK_MEM_SIZE / 1024 : 0);
+		wiznet_w_sockreg16(i, W52_SOCK_RXMEM_SIZE, (kb << 8) | kb);  // Sn_RXMEM_SIZE, Sn_TXMEM_SIZE
+	}
+	return 0;
+}
+#endif
+
 int wiznet_init()
 {
 	uint16_t i, ipzero[2];
+	#if W52_SPI_AUTOCAL
+	int div;
+	#endif
 
 	#if WIZNET_DEBUG > 3
 	const char *funcname = "wiznet_init()";
@@ -989,6 +2421,7 @@ int wiznet_init()
 	// Perform device reset
 	__delay_cycles(100);  // Assuming 25MHz MCLK; slower clock speeds will just produce longer delays, which is OK.
 	w5200_irq = 0x00;
+	w52_irq_pending = 0;
 	w52_portoffset = 0;
 	W52_RESET_PORTOUT |= W52_RESET_PORTBIT;
 	wiznet_debug6_printf("%s: Device RESET DEASSERT\n", funcname);
@@ -999,6 +2432,16 @@ int wiznet_init()
 	if (!i)
 		return -EFAULT;  // Init failed; can't ascertain chip version, possibly SPI fault?
 
+	#if W52_SPI_AUTOCAL
+	div = wiznet_spi_calibrate();
+	if (div < 0) {
+		wiznet_debug4_printf("%s: SPI calibration failed (%d); chip lost even at SMCLK/%u\n", funcname, div, W52_SPI_SAFE_DIVIDER);
+		return div;
+	}
+	wiznet_debug5_printf("%s: SPI calibrated to SMCLK/%d\n", funcname, div);
+	#endif
+
+	// Soft reset; also clears anything a failed calibration step may have written
 	wiznet_w_reg(W52_MR, 0x80);
 	while (wiznet_r_reg(W52_MR) & 0x80)
 		__delay_cycles(10000);
@@ -1008,17 +2451,24 @@ int wiznet_init()
 
 	wiznet_w_reg(W52_MR, 0x00);  // Ping enabled
 	wiznet_debug5_printf("%s: Ping enabled\n", funcname);
-	wiznet_ip_bin_w_reg(W52_SUBNETMASK, w52_const_subnet_classC);
+	// GAR, SUBR, SHAR, SIPR in address order so they go out as a single frame
 	ipzero[0] = ipzero[1] = 0x0000;
+	wiznet_wc_begin();
 	wiznet_ip_bin_w_reg(W52_GATEWAY, ipzero);
-	wiznet_ip_bin_w_reg(W52_SOURCEIP,w52_const_ip_default);
+	wiznet_ip_bin_w_reg(W52_SUBNETMASK, w52_const_subnet_classC);
 	wiznet_mac_bin_w_reg(W52_SOURCEMAC, w52_const_mac_default);
+	wiznet_ip_bin_w_reg(W52_SOURCEIP,w52_const_ip_default);
+	wiznet_wc_end();
 	wiznet_debug5_printf("%s: Default MAC address set to %x%x%x\n", funcname,
 		w52_const_mac_default[0] >> 8, w52_const_mac_default[0] & 0xFF,
 		w52_const_mac_default[1] >> 8, w52_const_mac_default[1] & 0xFF,
 		w52_const_mac_default[2] >> 8, w52_const_mac_default[2] & 0xFF);
 
 	// Trusting default values for RTR and RCR (0x07D0, 0x08)
+	#if W52_SOCKOPT
+	w52_rtr_cur = W52_RTR_DEFAULT;
+	w52_rcr_cur = W52_RCR_DEFAULT;
+	#endif
 
 	wiznet_w_reg(W52_PHYSTATUS, 0x00);
 	wiznet_w_reg(W52_IMR2, 0x00);  // Don't trigger IRQ for any system-wide errors e.g. IP conflict
@@ -1027,7 +2477,14 @@ int wiznet_init()
 	for (i=0; i < W52_MAX_SOCKETS; i++) {
 		wiznet_w_command(i, W52_SOCK_CMD_CLOSE);
 		wiznet_w_sockreg(i, W52_SOCK_MR, 0x00);
+		w52_sockets[i].mode = 0x00;
+		w52_sockets[i].connecting = 0;
+		w52_sockets[i].tx_state = 0;
+		#if W52_SOCKOPT
+		_wiznet_sockopt_defaults(i);
+		#endif
 	}
+	wiznet_set_bufsizes(NULL, NULL);
 
 	// Ready to roll
 	wiznet_debug6_printf("%s: Init complete\n", funcname);
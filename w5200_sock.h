@@ -28,30 +28,166 @@ extern const uint16_t w52_const_mac_default[3];
 extern const char *wiznet_tcp_state[10];
 extern const uint8_t wiznet_tcp_state_idx[10];
 
+/* Socket register window Sn_IR..Sn_RX_WR (0x02-0x2B), read in a single burst by wiznet_sock_snapshot() */
+#define W52_SOCK_SNAPSHOT_LEN (W52_SOCK_RX_WR1 - W52_SOCK_IR + 1)
+
+typedef struct {
+	uint8_t ir;
+	uint8_t sr;
+	uint16_t port;
+	uint16_t dport;
+	uint16_t tx_fsr;
+	uint16_t tx_rd;
+	uint16_t tx_wr;
+	uint16_t rx_rsr;
+	uint16_t rx_rd;
+	uint16_t rx_wr;
+} WIZNETSockSnapshot;
+
+/* WIZNETSocketState.connecting */
+#define W52_CONN_OPENING 1  // OPEN issued, waiting for INIT to send CONNECT
+#define W52_CONN_SYNSENT 2  // CONNECT issued
+
+/* WIZNETSocketState.tx_state */
+#define W52_TX_INFLIGHT 0x01  // SEND issued, waiting for SEND_OK
+#define W52_TX_PENDING 0x02   // More data committed meanwhile; chain another SEND at SEND_OK
+
+/* wiznet_setsockopt() options */
+#define W52_SO_MSS 1  // Max segment size, 0 = chip default
+#define W52_SO_TTL 2
+#define W52_SO_TOS 3
+#define W52_SO_RTR 4  // Retransmission timeout, 100us units; chip-wide, see below
+#define W52_SO_RCR 5  // Retransmission count (0-255); chip-wide, see below
+#define W52_SO_CORK 6  // Auto-cork delay in wiznet_cork_tick() ticks, 0 = off (TCP)
+
+#define W52_CORK_SEGMENT 1460  // Commit threshold when W52_SO_MSS is 0
+
+/* The W5200 has one RTR/RCR pair for all sockets.  Each socket's values are loaded before it issues LISTEN,
+ * CONNECT, SEND or DISCON, and that also changes the timers of retransmissions already in progress on other
+ * sockets.
+ */
+#define W52_RTR_DEFAULT 2000  // 200ms; chip reset values
+#define W52_RCR_DEFAULT 8
+#define W52_TTL_DEFAULT 128
+
+/* wiznet_poll() set entry */
+typedef struct {
+	int sockfd;
+	uint8_t events;   // W52_POLL* conditions of interest
+	uint8_t revents;  // Conditions found; W52_POLLHUP and W52_POLLTIMEOUT are always reported
+	uint16_t tx_min;  // W52_POLLOUT needs at least this much TX free (and at least 1 byte)
+} WIZNETPollFd;
+
+#define W52_POLLIN 0x01       // RX data waiting
+#define W52_POLLOUT 0x02      // Connected/open with TX free >= tx_min
+#define W52_POLLCON 0x04      // TCP connection established
+#define W52_POLLHUP 0x08      // Peer disconnected (DISCON or CLOSE_WAIT)
+#define W52_POLLTIMEOUT 0x10  // ARP or TCP retransmission timeout
+
+/* Listener pool; see wiznet_listen_pool().  Bitmasks are by socket number. */
+typedef struct {
+	uint16_t port;
+	uint8_t members;  // Sockets bound to port
+	uint8_t busy;     // Handed out by wiznet_pool_accept(), not yet released
+	uint8_t arming;   // Released, not yet back in LISTEN
+	uint8_t next;     // Round-robin scan start
+} WIZNETListenPool;
+
+/* IRQ servicing policy: picks the next socket from the pending set and clears its bit once it is done with it;
+ * a negative return means it emptied the set without picking one.
+ */
+typedef int (*WIZNETIrqPolicy)(uint8_t *);
+
+extern uint16_t w52_irq_count[W52_MAX_SOCKETS];  // Times wiznet_irq_getsocket() returned each socket
+extern uint8_t w52_irq_weight[W52_MAX_SOCKETS];  // Used by wiznet_irqpol_weighted(); turns per round, 0 = 1
+extern uint8_t w52_irq_class[W52_MAX_SOCKETS];   // Used by wiznet_irqpol_priority(); higher goes first
+
+/* Buffered reader state; see wiznet_reader_begin() */
+typedef struct {
+	int sockfd;
+	uint16_t avail;    // RX bytes waiting when the reader began
+	uint16_t fetched;  // Offset past RX_RD of the first byte not yet pulled into the window
+	uint8_t pos;       // Next unread byte in window[]
+	uint8_t len;       // Bytes held in window[]
+	uint8_t window[W52_READER_WINDOW];
+} WIZNETReader;
+
+/* Buffered writer state; see wiznet_writer_begin() */
+typedef struct {
+	int sockfd;
+	uint8_t len;       // Bytes staged in buf[]
+	uint8_t buf[W52_WRITER_BUFSIZE];
+} WIZNETWriter;
+
 /* Functions */
 int wiznet_irq_getsocket();
+void wiznet_irqpol_set(WIZNETIrqPolicy);  // NULL restores round-robin
+int wiznet_irqpol_roundrobin(uint8_t *);  // Default
+int wiznet_irqpol_weighted(uint8_t *);
+int wiznet_irqpol_priority(uint8_t *);
+int wiznet_poll(WIZNETPollFd *, uint8_t, uint8_t);  // Returns # of entries with revents set
+#if W52_SOCKOPT
+void wiznet_sockopt_command(int, uint8_t);
+#define wiznet_w_command(sock, cmdval) wiznet_sockopt_command(sock, cmdval)
+#else
 #define wiznet_w_command(sock, cmdval) wiznet_w_sockreg(sock, W52_SOCK_CR, cmdval)
+#endif
 int wiznet_phystate();
 
 int wiznet_socket(int);
-int wiznet_close(int);
+int wiznet_close(int);  // Error if auto-corked data could not be sent first
 int wiznet_connect(int, uint16_t *, uint16_t);
+int wiznet_connect_nb(int, uint16_t *, uint16_t);  // Returns -EINPROGRESS for TCP; finish with wiznet_connect_poll()
+int wiznet_connect_poll(int);
 int wiznet_quickbind(int);
+#if W52_SOCKOPT
+int wiznet_setsockopt(int, uint8_t, uint16_t);    // W52_SO_*; MSS applies from the next OPEN, -EINVAL if out of range
+int wiznet_getsockopt(int, uint8_t, uint16_t *);
+void wiznet_cork_tick();  // ISR-safe
+int wiznet_cork_poll();   // Commits corked data past its delay; returns # sockets committed
+#endif
+int wiznet_sock_snapshot(int, WIZNETSockSnapshot *);
 int wiznet_bind(int, uint16_t);
 int wiznet_accept(int);
+int wiznet_listen_pool(WIZNETListenPool *, uint16_t, uint8_t);  // Bind up to N sockets to one port; returns # bound
+int wiznet_pool_accept(WIZNETListenPool *);       // Next newly connected member, or -EAGAIN
+int wiznet_pool_release(WIZNETListenPool *, int);  // Done with a connection; DISCON, then back to LISTEN via wiznet_pool_accept()
+int wiznet_pool_close(WIZNETListenPool *);
 int wiznet_recv(int, void *, uint16_t, uint8_t);
 int wiznet_search_recv(int, void *, uint16_t, uint8_t, uint8_t);
+int wiznet_search_recv_pattern(int, void *, uint16_t, const void *, uint8_t, uint8_t);  // Multi-byte/class search, W52_SEARCH_* flags
+int wiznet_recv_stream(int, uint16_t, WIZNETVisitor, void *);  // Zero-copy; visitor sees data straight off the bus
 int wiznet_peek(int, uint16_t, void *, uint16_t);
 int wiznet_flush(int, uint16_t, uint8_t);
+int wiznet_reader_begin(WIZNETReader *, int);
+int wiznet_reader_read(WIZNETReader *, void *, uint16_t);
+int wiznet_reader_peek(WIZNETReader *, void *, uint16_t);
+uint16_t wiznet_reader_skip(WIZNETReader *, uint16_t);
+uint16_t wiznet_reader_commit(WIZNETReader *, uint8_t);  // Releases what was read/skipped in one RX_RD write
 int wiznet_recvfrom(int, void *, uint16_t, uint16_t *, uint16_t *, uint8_t);
 int wiznet_txcommit(int);
+int wiznet_txcommit_async(int);  // Issue SEND and return; progress via wiznet_tx_poll()
+int wiznet_tx_poll(int);          // Handle SEND_OK; returns committed bytes still unsent, or error
+#define wiznet_tx_unsent(sock) ((uint16_t)(w52_sockets[sock].tx_wr - w52_sockets[sock].tx_rd))  // No SPI; cached TX_RD
 int wiznet_send(int, void *, uint16_t, uint8_t);
+int wiznet_send_partial(int, void *, uint16_t, uint8_t);  // Writes what fits, returns count (-EAGAIN if full); commit is async
+int wiznet_send_stream(int, void *, uint16_t);            // Any size; blocks refilling the ring as SEND_OK frees space
 int wiznet_sendto(int, void *, uint16_t, uint16_t *, uint16_t, uint8_t);
+int wiznet_sendv(int, const WIZNETIOVec *, uint8_t, uint8_t);
+int wiznet_send_generate(int, uint16_t, WIZNETProducer, void *, uint8_t);  // Zero-copy; producer writes into the TX frame
+void wiznet_writer_begin(WIZNETWriter *, int);
+int wiznet_writer_putc(WIZNETWriter *, uint8_t);
+int wiznet_writer_write(WIZNETWriter *, const void *, uint16_t);  // NULL buffer writes zeroes
+int wiznet_writer_puts(WIZNETWriter *, const char *);
+int wiznet_writer_printf(WIZNETWriter *, const char *, ...);  // %s %c %d %i %u %l %n %x %h, as wiznet_debug_printf()
+int wiznet_writer_flush(WIZNETWriter *);
+int wiznet_writer_commit(WIZNETWriter *);  // Flush + wiznet_txcommit()
 
 // Ethernet MACRAW I/O
 int wiznet_mac_recvfrom(void *, uint16_t, uint16_t *, uint16_t *, uint16_t *, uint8_t, uint8_t);
 int wiznet_mac_sendto(void *, uint16_t, uint16_t *, uint16_t, uint16_t, uint8_t, uint8_t);
 
+int wiznet_set_bufsizes(const uint8_t *, const uint8_t *);  // Per-socket RX/TX sizes in KB, NULL = default
 int wiznet_init();
 
 #endif